@@ -0,0 +1,127 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "app/syscall.h"
+
+/* Reads the same local file once with blocking reads and once with up
+ * to QUEUE_DEPTH asynchronous reads in flight, and compares the cycles
+ * both took. */
+
+#define TEST_FILE "async-io.dat"
+#define FILE_SIZE (4 * 1024 * 1024)
+#define BLOCK_SIZE 4096
+#define QUEUE_DEPTH 8
+
+static char block[QUEUE_DEPTH][BLOCK_SIZE];
+
+static unsigned long
+read_cycles(void) {
+  unsigned long cycles;
+  asm volatile("rdcycle %0" : "=r"(cycles));
+  return cycles;
+}
+
+static unsigned long
+checksum(const char* buf, size_t len) {
+  unsigned long sum = 0;
+  size_t i;
+  for (i = 0; i < len; i++) sum = sum * 31 + (unsigned char)buf[i];
+  return sum;
+}
+
+static int
+create_file(void) {
+  int fd = open(TEST_FILE, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  size_t off;
+
+  if (fd < 0) return -1;
+  for (off = 0; off < FILE_SIZE; off += BLOCK_SIZE) {
+    memset(block[0], (int)(off / BLOCK_SIZE), BLOCK_SIZE);
+    if (write(fd, block[0], BLOCK_SIZE) != BLOCK_SIZE) {
+      close(fd);
+      return -1;
+    }
+  }
+  fsync(fd);
+  return close(fd);
+}
+
+static unsigned long
+read_sync(int fd, unsigned long* sum) {
+  unsigned long start = read_cycles();
+  size_t off;
+
+  *sum = 0;
+  lseek(fd, 0, SEEK_SET);
+  for (off = 0; off < FILE_SIZE; off += BLOCK_SIZE) {
+    if (read(fd, block[0], BLOCK_SIZE) != BLOCK_SIZE) return 0;
+    *sum += checksum(block[0], BLOCK_SIZE);
+  }
+  return read_cycles() - start;
+}
+
+static unsigned long
+read_async(int fd, unsigned long* sum) {
+  unsigned long start = read_cycles();
+  size_t next = 0, done = 0;
+  int buf_of_tag[QUEUE_DEPTH];
+  int free_bufs[QUEUE_DEPTH];
+  int nfree = QUEUE_DEPTH;
+  int tag, i;
+  int64_t res;
+
+  for (i = 0; i < QUEUE_DEPTH; i++) free_bufs[i] = i;
+
+  *sum = 0;
+  while (done < FILE_SIZE) {
+    while (nfree > 0 && next < FILE_SIZE) {
+      int buf = free_bufs[nfree - 1];
+      tag     = async_submit(
+          ASYNC_IO_READ, fd, block[buf], BLOCK_SIZE, (int64_t)next);
+      if (tag < 0 || tag >= QUEUE_DEPTH) break;
+      buf_of_tag[tag] = buf;
+      nfree--;
+      next += BLOCK_SIZE;
+    }
+    if (nfree == QUEUE_DEPTH) return 0;
+
+    tag = async_complete(&res, 1);
+    if (tag < 0 || tag >= QUEUE_DEPTH || res != BLOCK_SIZE) return 0;
+    *sum += checksum(block[buf_of_tag[tag]], BLOCK_SIZE);
+    free_bufs[nfree++] = buf_of_tag[tag];
+    done += BLOCK_SIZE;
+  }
+  return read_cycles() - start;
+}
+
+int
+main() {
+  unsigned long sync_sum, async_sum, sync_cycles, async_cycles;
+  int fd;
+
+  if (create_file() != 0 || (fd = open(TEST_FILE, O_RDONLY)) < 0) {
+    printf("async-io: cannot set up %s\n", TEST_FILE);
+    return -1;
+  }
+
+  sync_cycles  = read_sync(fd, &sync_sum);
+  async_cycles = read_async(fd, &async_sum);
+  close(fd);
+  unlink(TEST_FILE);
+
+  if (!sync_cycles || !async_cycles || sync_sum != async_sum) {
+    printf("async-io: reads failed or data mismatch\n");
+    return -1;
+  }
+
+  printf("blocking reads: %lu cycles\n", sync_cycles);
+  printf("async reads (depth %d): %lu cycles\n", QUEUE_DEPTH, async_cycles);
+  return 0;
+}
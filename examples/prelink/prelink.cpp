@@ -0,0 +1,65 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#include <getopt.h>
+#include <cstdio>
+#include "host/keystone.h"
+
+/* Builds a prelinked image of an eapp and the Eyrie runtime for
+ * Enclave::initPrelinked(), and optionally prints the measurement the
+ * enclave will have when it is booted with the given loader. */
+int
+main(int argc, char** argv) {
+  if (argc != 4 && argc != 6) {
+    printf(
+        "Usage: %s <eapp> <runtime> <image> [--measure <loader>]\n", argv[0]);
+    return 1;
+  }
+
+  char* ld_file = NULL;
+
+  static struct option long_options[] = {
+      {"measure", required_argument, 0, 'm'}, {0, 0, 0, 0}};
+
+  int c;
+  while ((c = getopt_long(argc, argv, "m:", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'm':
+        ld_file = optarg;
+        break;
+      default:
+        return 1;
+    }
+  }
+  if (argc - optind != 3) {
+    printf(
+        "Usage: %s <eapp> <runtime> <image> [--measure <loader>]\n", argv[0]);
+    return 1;
+  }
+
+  char* eapp_file  = argv[optind];
+  char* rt_file    = argv[optind + 1];
+  char* image_file = argv[optind + 2];
+
+  if (Keystone::Prelinker::build(eapp_file, rt_file, image_file) !=
+      Keystone::Error::Success) {
+    printf("failed to prelink %s and %s\n", eapp_file, rt_file);
+    return 1;
+  }
+
+  if (ld_file) {
+    char hash[MDSIZE];
+    if (Keystone::Enclave::measurePrelinked(hash, image_file, ld_file) !=
+        Keystone::Error::Success) {
+      printf("failed to measure %s\n", image_file);
+      return 1;
+    }
+    for (int i = 0; i < MDSIZE; i++) {
+      printf("%02x", (unsigned char)hash[i]);
+    }
+    printf("\n");
+  }
+
+  return 0;
+}
@@ -0,0 +1,17 @@
+#!/bin/sh
+# Runs fib-bench with different runtime timeslices and reports the
+# cycles spent for the same amount of work (lower is better).
+# The enclave return value is the number of cycles fib(35) took as seen
+# from inside the enclave, which includes the time spent outside of it
+# while the enclave was interrupted.
+# A timeslice of 0 is tickless: the runtime does not arm its own timer.
+
+TIMESLICES=${TIMESLICES:-"10000 100000 1000000 10000000 0"}
+
+printf "%-12s %-16s %-16s\n" "timeslice" "host cycles" "enclave cycles"
+for ts in $TIMESLICES; do
+  out=$(./test-runner test-fib-bench eyrie-rt loader.bin --time --timeslice $ts)
+  host=$(echo "$out" | sed -n 's/.*Runtime: \([0-9]*\) cycles.*/\1/p')
+  encl=$(echo "$out" | sed -n 's/.*Enclave returned: \([0-9]*\).*/\1/p')
+  printf "%-12s %-16s %-16s\n" "$ts" "$host" "$encl"
+done
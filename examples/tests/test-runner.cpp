@@ -55,10 +55,11 @@ copy_report(void* buffer) {
 
 int
 main(int argc, char** argv) {
-  if (argc < 4 || argc > 9) {
+  if (argc < 4 || argc > 11) {
     printf(
         "Usage: %s <eapp> <runtime> [--utm-size SIZE(K)] [--freemem-size "
-        "SIZE(K)] [--time] [--load-only] [--utm-ptr 0xPTR] [--retval EXPECTED]\n",
+        "SIZE(K)] [--time] [--load-only] [--utm-ptr 0xPTR] [--retval EXPECTED] "
+        "[--timeslice CYCLES (0 = tickless)]\n",
         argv[0]);
     return 0;
   }
@@ -68,6 +69,7 @@ main(int argc, char** argv) {
 
   size_t untrusted_size = 2 * 1024 * 1024;
   size_t freemem_size   = 48 * 1024 * 1024;
+  unsigned long timeslice = DEFAULT_TIMESLICE;
   bool retval_exist = false;
   unsigned long retval = 0;
 
@@ -77,6 +79,7 @@ main(int argc, char** argv) {
       {"utm-size", required_argument, 0, 'u'},
       {"freemem-size", required_argument, 0, 'f'},
       {"retval", required_argument, 0, 'r'},
+      {"timeslice", required_argument, 0, 't'},
       {0, 0, 0, 0}};
 
   char* eapp_file = argv[1];
@@ -103,6 +106,9 @@ main(int argc, char** argv) {
         retval_exist = true;
         retval = atoi(optarg);
         break;
+      case 't':
+        timeslice = strtoul(optarg, NULL, 0);
+        break;
     }
   }
 
@@ -112,6 +118,7 @@ main(int argc, char** argv) {
 
   params.setFreeMemSize(freemem_size);
   params.setUntrustedSize(untrusted_size);
+  params.setTimeslice(timeslice);
 
   if (self_timing) {
     asm volatile("rdcycle %0" : "=r"(cycles1));
@@ -140,6 +147,9 @@ main(int argc, char** argv) {
     asm volatile("rdcycle %0" : "=r"(cycles4));
     printf("[keystone-test] Init: %lu cycles\r\n", cycles2 - cycles1);
     printf("[keystone-test] Runtime: %lu cycles\r\n", cycles4 - cycles3);
+    if (!load_only) {
+      printf("[keystone-test] Enclave returned: %lu\r\n", encl_ret);
+    }
   }
 
   return 0;
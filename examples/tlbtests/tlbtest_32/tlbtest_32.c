@@ -3,6 +3,8 @@
 #include <string.h>
 #include <limits.h>
 #include <stdint.h>
+#include <malloc.h>
+#include "app/syscall.h"
 
 #define asm __asm__
 
@@ -16,6 +18,9 @@
 #define SIZE 32
 #define RUNS 1000
 
+/* largest page size the runtime may map the buffers with */
+static const uint64_t page_sizes[] = { 1UL << 12, 1UL << 21, 1UL << 30 };
+
 void tlb_check(uint32_t size, uint64_t runs);
 void random_fetch(uint64_t size, uint64_t runs);
 
@@ -24,8 +29,19 @@ int main() {
 	uint32_t size = SIZE;
 	uint64_t runs = RUNS;
 
-	tlb_check(size, runs);
-	random_fetch(size, runs);
+	/* give every buffer its own mmap so that it gets the current
+	 * page size policy rather than memory left over from the last one */
+	mallopt(M_MMAP_THRESHOLD, PAGE_SIZE);
+
+	for (int i = 0; i < sizeof(page_sizes) / sizeof(page_sizes[0]); i++) {
+		if (SYSCALL_1(RUNTIME_SYSCALL_SET_MAX_PAGE_SIZE, page_sizes[i]) == -1) {
+			printf("\nMax page size %lu KiB not supported\n", page_sizes[i] >> 10);
+			continue;
+		}
+		printf("\n=== Max page size %lu KiB ===\n", page_sizes[i] >> 10);
+		tlb_check(size, runs);
+		random_fetch(size, runs);
+	}
 	
 	return 0;
 }
@@ -0,0 +1,32 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include <string.h>
+
+#include "app/worker.h"
+
+/* A small request: checksum the input a few times over, the kind of job
+ * where enclave creation would otherwise dominate. */
+#define ROUNDS 16
+
+static int64_t
+checksum_job(const void* input, size_t len, void* output, size_t* out_len) {
+  const unsigned char* in = (const unsigned char*)input;
+  uint64_t sum            = 0;
+  size_t i, r;
+
+  for (r = 0; r < ROUNDS; r++)
+    for (i = 0; i < len; i++) sum = sum * 31 + in[i] + r;
+
+  if (*out_len < sizeof(sum)) return -1;
+  memcpy(output, &sum, sizeof(sum));
+  *out_len = sizeof(sum);
+  return 0;
+}
+
+int
+main() {
+  return worker_loop(checksum_job);
+}
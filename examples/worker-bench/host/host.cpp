@@ -0,0 +1,129 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <vector>
+
+#include "edge/edge_common.h"
+#include "host/keystone.h"
+#include "shared/worker_call.h"
+
+using namespace Keystone;
+
+/* Compares job throughput of a fresh enclave per request against the
+ * persistent workers of WorkerScheduler, running the same eapp. */
+
+#define DEFAULT_JOBS 256
+#define JOB_SIZE 1024
+
+static Params
+workerParams() {
+  Params params;
+  params.setFreeMemSize(256 * 1024);
+  params.setUntrustedSize(16 * 1024);
+  return params;
+}
+
+/* Serves the worker protocol for exactly one job, then tells the
+ * worker to exit, the way a create-per-request service would. */
+static void
+serveOneJob(Enclave* enclave, void* buffer, bool* sent) {
+  struct edge_call* call = (struct edge_call*)buffer;
+  struct worker_msg* reply =
+      (struct worker_msg*)((uintptr_t)enclave->getSharedBuffer() +
+                           sizeof(struct edge_call));
+
+  if (call->call_id != WORKER_CALL_NEXT_JOB) {
+    call->return_data.call_status = CALL_STATUS_BAD_CALL_ID;
+    return;
+  }
+
+  reply->job_id = *sent ? WORKER_JOB_NONE : 0;
+  reply->flags  = *sent ? WORKER_MSG_EXIT : 0;
+  reply->status = 0;
+  reply->len    = *sent ? 0 : JOB_SIZE;
+  memset(reply->data, 0x5a, reply->len);
+  *sent = true;
+
+  call->return_data.call_ret_offset = sizeof(struct edge_call);
+  call->return_data.call_ret_size   = sizeof(struct worker_msg) + reply->len;
+  call->return_data.call_status     = CALL_STATUS_OK;
+}
+
+static double
+runBaseline(char** argv, size_t jobs) {
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < jobs; i++) {
+    Enclave enclave;
+    bool sent = false;
+
+    if (enclave.init(argv[1], argv[2], argv[3], workerParams()) !=
+        Error::Success) {
+      printf("enclave init failed\n");
+      return 0;
+    }
+    enclave.registerOcallDispatch([&enclave, &sent](void* buffer) {
+      serveOneJob(&enclave, buffer, &sent);
+    });
+    enclave.run();
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return jobs / elapsed.count();
+}
+
+static double
+runScheduler(char** argv, size_t jobs) {
+  WorkerScheduler scheduler(argv[1], argv[2], argv[3], workerParams());
+  std::vector<std::future<JobResult>> results(jobs);
+  std::vector<unsigned char> input(JOB_SIZE, 0x5a);
+
+  /* worker creation is a one-time cost, keep it out of the numbers */
+  if (scheduler.start() != Error::Success) {
+    printf("failed to start the workers\n");
+    return 0;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < jobs; i++) {
+    scheduler.submit(input.data(), input.size(), &results[i]);
+  }
+  for (auto& result : results) {
+    result.wait();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  printf(
+      "%zu workers, %lu jobs stolen\n", scheduler.getWorkers(),
+      (unsigned long)scheduler.getSteals());
+  scheduler.stop();
+  return jobs / elapsed.count();
+}
+
+int
+main(int argc, char** argv) {
+  size_t jobs = DEFAULT_JOBS;
+
+  if (argc < 4) {
+    printf("usage: %s <eapp> <runtime> <loader> [jobs]\n", argv[0]);
+    return 1;
+  }
+  if (argc > 4) {
+    jobs = strtoul(argv[4], NULL, 0);
+  }
+
+  double baseline  = runBaseline(argv, jobs);
+  double scheduled = runScheduler(argv, jobs);
+
+  printf("create per request: %.1f jobs/s\n", baseline);
+  printf("persistent workers: %.1f jobs/s\n", scheduled);
+  return 0;
+}
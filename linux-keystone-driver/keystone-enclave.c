@@ -27,6 +27,11 @@ int destroy_enclave(struct enclave* enclave)
     epm_destroy(epm);
     kfree(epm);
   }
+  if (enclave->ckpt)
+  {
+    epm_destroy(enclave->ckpt);
+    kfree(enclave->ckpt);
+  }
   if (utm)
   {
     utm_destroy(utm);
@@ -48,6 +53,7 @@ struct enclave* create_enclave(unsigned long min_pages)
 
   enclave->eid = -1;
   enclave->utm = NULL;
+  enclave->ckpt = NULL;
   enclave->close_on_pexit = 1;
 
   enclave->epm = kmalloc(sizeof(struct epm), GFP_KERNEL);
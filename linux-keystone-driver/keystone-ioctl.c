@@ -8,6 +8,9 @@
 #include <asm/sbi.h>
 #include <linux/uaccess.h>
 #include <linux/string.h>
+#include <linux/sched.h>
+#include <linux/sched/signal.h>
+#include <linux/vmalloc.h>
 
 int __keystone_destroy_enclave(unsigned int ueid);
 
@@ -73,6 +76,24 @@ int keystone_finalize_enclave(unsigned long arg)
   create_args.user_paddr = enclp->user_paddr;
   create_args.free_paddr = enclp->free_paddr;
   create_args.free_requested = enclp->free_requested;
+  create_args.timeslice = enclp->timeslice;
+
+  /* the SM copies everything below free memory into the checkpoint */
+  create_args.checkpoint_region.paddr = 0;
+  create_args.checkpoint_region.size = 0;
+  if (enclp->checkpoint && enclp->free_paddr > enclave->epm->pa) {
+    enclave->ckpt = kmalloc(sizeof(struct epm), GFP_KERNEL);
+    if (!enclave->ckpt ||
+        epm_init(enclave->ckpt,
+                 PAGE_UP(enclp->free_paddr - enclave->epm->pa) >> PAGE_SHIFT)) {
+      keystone_err("failed to allocate the enclave checkpoint\n");
+      kfree(enclave->ckpt);
+      enclave->ckpt = NULL;
+      goto error_destroy_enclave;
+    }
+    create_args.checkpoint_region.paddr = enclave->ckpt->pa;
+    create_args.checkpoint_region.size = enclave->ckpt->size;
+  }
 
   pr_info("[Driver] Runtime PA: 0x%lx, Eapp PA: 0x%lx, FreeMem PA: 0x%lx size %llu B\n",\
           enclp->runtime_paddr, enclp->user_paddr, enclp->free_paddr, enclp->free_requested);
@@ -96,6 +117,158 @@ error_destroy_enclave:
 
 }
 
+int keystone_clone_enclave(unsigned long arg)
+{
+  struct sbiret ret;
+  struct enclave *enclave, *tmpl;
+  struct keystone_sbi_create_t create_args;
+
+  struct keystone_ioctl_create_enclave *enclp = (struct keystone_ioctl_create_enclave *) arg;
+
+  enclave = get_enclave_by_id(enclp->eid);
+  tmpl = get_enclave_by_id(enclp->template_eid);
+  if(!enclave || !tmpl) {
+    keystone_err("invalid enclave id\n");
+    return -EINVAL;
+  }
+
+  if (tmpl->eid < 0) {
+    keystone_err("template enclave does not exist\n");
+    return -EINVAL;
+  }
+
+  enclave->is_init = false;
+
+  /* the SM takes the layout and parameters from the template */
+  memset(&create_args, 0, sizeof(create_args));
+  create_args.epm_region.paddr = enclave->epm->pa;
+  create_args.epm_region.size = enclave->epm->size;
+
+  if (enclave->utm) {
+    create_args.utm_region.paddr = __pa(enclave->utm->ptr);
+    create_args.utm_region.size = enclave->utm->size;
+  }
+
+  ret = sbi_sm_clone_enclave(tmpl->eid, &create_args);
+
+  if (ret.error) {
+    keystone_err("keystone_clone_enclave: SBI call failed with error code %ld\n", ret.error);
+    goto error_destroy_enclave;
+  }
+
+  enclave->eid = ret.value;
+
+  return 0;
+
+error_destroy_enclave:
+  destroy_enclave(enclave);
+
+  return -EINVAL;
+}
+
+/* The SM reads and writes checkpoint images through kernel memory, so
+ * they are staged in a vmalloc'd buffer. vzalloc also makes sure every
+ * page is mapped before the SM touches it. */
+int keystone_checkpoint_enclave(unsigned long arg)
+{
+  struct sbiret ret;
+  struct enclave *enclave;
+  void *image;
+  size_t size;
+  int err = 0;
+
+  struct keystone_ioctl_checkpoint *ckp = (struct keystone_ioctl_checkpoint *) arg;
+
+  enclave = get_enclave_by_id(ckp->eid);
+  if (!enclave) {
+    keystone_err("invalid enclave id\n");
+    return -EINVAL;
+  }
+
+  if (enclave->eid < 0) {
+    keystone_err("real enclave does not exist\n");
+    return -EINVAL;
+  }
+
+  size = SM_CHECKPOINT_SIZE(enclave->epm->size);
+  if (ckp->size < size)
+    return -EINVAL;
+
+  image = vzalloc(size);
+  if (!image)
+    return -ENOMEM;
+
+  ret = sbi_sm_checkpoint_enclave(enclave->eid, image, size);
+  if (ret.error) {
+    keystone_err("keystone_checkpoint_enclave: SBI call failed with error code %ld\n", ret.error);
+    err = -EINVAL;
+  } else if (copy_to_user((void __user *) ckp->image, image, size)) {
+    err = -EFAULT;
+  }
+
+  vfree(image);
+  return err;
+}
+
+int keystone_restore_enclave(unsigned long arg)
+{
+  struct sbiret ret;
+  struct enclave *enclave;
+  struct keystone_sbi_create_t create_args;
+  void *image;
+  size_t size;
+
+  struct keystone_ioctl_checkpoint *ckp = (struct keystone_ioctl_checkpoint *) arg;
+
+  enclave = get_enclave_by_id(ckp->eid);
+  if (!enclave) {
+    keystone_err("invalid enclave id\n");
+    return -EINVAL;
+  }
+
+  size = SM_CHECKPOINT_SIZE(enclave->epm->size);
+  if (ckp->size < size)
+    return -EINVAL;
+
+  image = vzalloc(size);
+  if (!image)
+    return -ENOMEM;
+
+  if (copy_from_user(image, (void __user *) ckp->image, size)) {
+    vfree(image);
+    return -EFAULT;
+  }
+
+  enclave->is_init = false;
+
+  /* the SM takes the layout and parameters from the image */
+  memset(&create_args, 0, sizeof(create_args));
+  create_args.epm_region.paddr = enclave->epm->pa;
+  create_args.epm_region.size = enclave->epm->size;
+
+  if (enclave->utm) {
+    create_args.utm_region.paddr = __pa(enclave->utm->ptr);
+    create_args.utm_region.size = enclave->utm->size;
+  }
+
+  ret = sbi_sm_restore_enclave(&create_args, image, size);
+  vfree(image);
+
+  if (ret.error) {
+    keystone_err("keystone_restore_enclave: SBI call failed with error code %ld\n", ret.error);
+    goto error_destroy_enclave;
+  }
+
+  enclave->eid = ret.value;
+
+  return 0;
+
+error_destroy_enclave:
+  destroy_enclave(enclave);
+
+  return -EINVAL;
+}
+
 int keystone_run_enclave(unsigned long data)
 {
   struct sbiret ret;
@@ -124,6 +297,46 @@ int keystone_run_enclave(unsigned long data)
   return 0;
 }
 
+/* Run or resume the enclave and keep resuming it here as long as it only
+ * stops because of a timer interrupt. This saves a user/kernel round trip
+ * per timeslice. We still return on a pending signal so that the process
+ * stays killable; the host then simply resumes again. */
+int keystone_run_until_edge(unsigned long data, bool resume)
+{
+  struct sbiret ret;
+  struct keystone_ioctl_run_enclave *arg = (struct keystone_ioctl_run_enclave*) data;
+  unsigned long ueid = arg->eid;
+  struct enclave* enclave;
+  enclave = get_enclave_by_id(ueid);
+
+  if (!enclave) {
+    keystone_err("invalid enclave id\n");
+    return -EINVAL;
+  }
+
+  if (enclave->eid < 0) {
+    keystone_err("real enclave does not exist\n");
+    return -EINVAL;
+  }
+
+  if (resume)
+    ret = sbi_sm_resume_enclave(enclave->eid);
+  else
+    ret = sbi_sm_run_enclave(enclave->eid);
+
+  while (ret.error == SBI_ERR_SM_ENCLAVE_INTERRUPTED) {
+    if (signal_pending(current))
+      break;
+    cond_resched();
+    ret = sbi_sm_resume_enclave(enclave->eid);
+  }
+
+  arg->error = ret.error;
+  arg->value = ret.value;
+
+  return 0;
+}
+
 int utm_init_ioctl(struct file *filp, unsigned long arg)
 {
   int ret = 0;
@@ -186,6 +399,11 @@ int __keystone_destroy_enclave(unsigned int ueid)
       keystone_err("fatal: cannot destroy enclave: SBI failed with error code %ld\n", ret.error);
       return -EINVAL;
     }
+    /* the SM has cleared the EPM, so a pooled chunk needs no memset */
+    if (enclave->epm->chunk)
+      enclave->epm->chunk->dirty = 0;
+    if (enclave->ckpt && enclave->ckpt->chunk)
+      enclave->ckpt->chunk->dirty = 0;
   } else {
     keystone_warn("keystone_destroy_enclave: skipping (enclave does not exist)\n");
   }
@@ -197,6 +415,32 @@ int __keystone_destroy_enclave(unsigned int ueid)
   return 0;
 }
 
+int keystone_reset_enclave(unsigned long arg)
+{
+  struct sbiret ret;
+  struct enclave *enclave;
+  struct keystone_ioctl_create_enclave *enclp = (struct keystone_ioctl_create_enclave *) arg;
+
+  enclave = get_enclave_by_id(enclp->eid);
+  if (!enclave) {
+    keystone_err("invalid enclave id\n");
+    return -EINVAL;
+  }
+
+  if (enclave->eid < 0 || !enclave->ckpt) {
+    keystone_err("enclave cannot be reset\n");
+    return -EINVAL;
+  }
+
+  ret = sbi_sm_reset_enclave(enclave->eid);
+  if (ret.error) {
+    keystone_err("keystone_reset_enclave: SBI call failed with error code %ld\n", ret.error);
+    return -EINVAL;
+  }
+
+  return 0;
+}
+
 int keystone_resume_enclave(unsigned long data)
 {
   struct sbiret ret;
@@ -257,6 +501,24 @@ long keystone_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
     case KEYSTONE_IOC_RESUME_ENCLAVE:
       ret = keystone_resume_enclave((unsigned long) data);
       break;
+    case KEYSTONE_IOC_RUN_UNTIL_EDGE:
+      ret = keystone_run_until_edge((unsigned long) data, false);
+      break;
+    case KEYSTONE_IOC_RESUME_UNTIL_EDGE:
+      ret = keystone_run_until_edge((unsigned long) data, true);
+      break;
+    case KEYSTONE_IOC_CLONE_ENCLAVE:
+      ret = keystone_clone_enclave((unsigned long) data);
+      break;
+    case KEYSTONE_IOC_RESET_ENCLAVE:
+      ret = keystone_reset_enclave((unsigned long) data);
+      break;
+    case KEYSTONE_IOC_CHECKPOINT_ENCLAVE:
+      ret = keystone_checkpoint_enclave((unsigned long) data);
+      break;
+    case KEYSTONE_IOC_RESTORE_ENCLAVE:
+      ret = keystone_restore_enclave((unsigned long) data);
+      break;
     /* Note that following commands could have been implemented as a part of ADD_PAGE ioctl.
      * However, there was a weird bug in compiler that generates a wrong control flow
      * that ends up with an illegal instruction if we combine switch-case and if statements.
@@ -14,6 +14,11 @@ int epm_destroy(struct epm* epm) {
   if(!epm->ptr || !epm->size)
     return 0;
 
+  if (epm->chunk) {
+    epm_pool_put(epm);
+    return 0;
+  }
+
   /* free the EPM hold by the enclave */
   if (epm->is_cma) {
     dma_free_coherent(keystone_dev.this_device,
@@ -21,7 +26,7 @@ int epm_destroy(struct epm* epm) {
         (void*) epm->ptr,
         epm->pa);
   } else {
-    free_pages(epm->ptr, epm->order);
+    free_pages_exact((void*) epm->ptr, epm->size);
   }
 
   return 0;
@@ -35,10 +40,16 @@ int epm_init(struct epm* epm, unsigned long min_pages)
   unsigned long count = min_pages;
   phys_addr_t device_phys_addr = 0;
 
-  /* try to allocate contiguous memory */
+  /* a preallocated chunk is the fast path */
+  epm->chunk = NULL;
+  if (!epm_pool_get(epm, min_pages))
+    return 0;
+
+  /* try to allocate contiguous memory. alloc_pages_exact() returns the
+   * tail of the underlying power-of-two block to the buddy allocator,
+   * so the EPM is exactly min_pages long */
   epm->is_cma = 0;
-  order = ilog2(min_pages - 1) + 1;
-  count = 0x1 << order;
+  order = get_order(count << PAGE_SHIFT);
 
   /* prevent kernel from complaining about an invalid argument */
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
@@ -46,24 +57,18 @@ int epm_init(struct epm* epm, unsigned long min_pages)
 #else
   if (order < MAX_ORDER)
 #endif
-    epm_vaddr = (vaddr_t) __get_free_pages(GFP_HIGHUSER, order);
+    epm_vaddr = (vaddr_t) alloc_pages_exact(count << PAGE_SHIFT,
+                                            GFP_USER);
 
 #ifdef CONFIG_CMA
   /* If buddy allocator fails, we fall back to the CMA */
   if (!epm_vaddr) {
     epm->is_cma = 1;
     pr_info("[Driver] EPM is allocated within CMA");
-  #if defined(MEGAPAGE_MAPPING)
-  /* When using megapages, count*PAGE_SIZE should be 2MB-aligned for
-   * the Free-Memory region's  end to have the same alignment. 
-   */
-  count = MEGAPAGE_UP(min_pages << PAGE_SHIFT) >> PAGE_SHIFT;
-  #elif defined(GIGAPAGE_MAPPING)
-  /* FreeMemory region's end address should be 1-GiB aligned as well */
-  count = GIGAPAGE_UP(min_pages << PAGE_SHIFT) >> PAGE_SHIFT;
-  #else
+    /* CMA allocations are not rounded to a power of two either. The
+     * runtime picks page sizes from whatever free memory it gets, so
+     * the EPM needs no padding to a large-page boundary. */
     count = min_pages;
-  #endif
     /*epm_vaddr = (vaddr_t) dma_alloc_coherent(keystone_dev.this_device,
       count << PAGE_SHIFT,
       &device_phys_addr,
@@ -112,16 +117,20 @@ int utm_init(struct utm* utm, size_t untrusted_size)
   unsigned long order = 0;
   unsigned long count;
   req_pages += PAGE_UP(untrusted_size)/PAGE_SIZE;
-  order = ilog2(req_pages - 1) + 1;
+  order = get_order(req_pages << PAGE_SHIFT);
   count = 0x1 << order;
 
   utm->order = order;
 
   /* Currently, UTM does not utilize CMA.
-   * It is always allocated from the buddy allocator */
+   * It is always allocated from the buddy allocator. Unlike the EPM it
+   * stays a naturally aligned power of two: the SM protects it with a
+   * single NAPOT PMP entry at the bottom priority, which cannot be a
+   * TOR range. */
   utm->ptr = (void*) __get_free_pages(GFP_HIGHUSER, order);
   if (!utm->ptr) {
-    keystone_err("failed to allocate UTM (size = %i bytes)\n",(1<<order));
+    keystone_err("failed to allocate UTM (size = %lu bytes)\n",
+                 count << PAGE_SHIFT);
     return -ENOMEM;
   }
 
@@ -0,0 +1,204 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#include "keystone.h"
+#include <linux/dma-mapping.h>
+#include <linux/list.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+
+/* Preallocated EPM pool.
+ *
+ * Contiguous chunks are reserved once at module load so that enclave
+ * creation does not depend on the buddy allocator staying unfragmented.
+ * Chunks are binned by size class; each class keeps a free list.
+ * A chunk remembers how much of it was handed out since it was last
+ * cleared (its dirty mark), and epm_pool_get clears up to that mark
+ * before handing it out again, whatever size is asked for. Destroying
+ * an enclave drops the mark, since the SM has cleared its regions.
+ *
+ * Example: insmod keystone-driver.ko epm_pool_mb=8,64 epm_pool_count=16,4 */
+
+#define EPM_POOL_CLASSES_MAX 8
+
+static unsigned int epm_pool_mb[EPM_POOL_CLASSES_MAX];
+static int epm_pool_nr_mb;
+module_param_array(epm_pool_mb, uint, &epm_pool_nr_mb, 0444);
+MODULE_PARM_DESC(epm_pool_mb, "EPM pool size classes in MiB (e.g. 8,64)");
+
+static unsigned int epm_pool_count[EPM_POOL_CLASSES_MAX];
+static int epm_pool_nr_count;
+module_param_array(epm_pool_count, uint, &epm_pool_nr_count, 0444);
+MODULE_PARM_DESC(epm_pool_count, "number of preallocated chunks per size class");
+
+struct epm_pool_class {
+  size_t size;
+  struct list_head free;
+  unsigned int nr_free;
+  unsigned int nr_total;
+};
+
+static struct epm_pool_class epm_pool[EPM_POOL_CLASSES_MAX];
+static int epm_pool_nr_classes;
+static DEFINE_MUTEX(epm_pool_lock);
+
+int epm_pool_init(void)
+{
+  int i, j;
+  unsigned int count;
+  struct epm_chunk* chunk;
+  struct epm_pool_class* class;
+  struct epm_pool_class tmp;
+
+  if (epm_pool_nr_mb != epm_pool_nr_count) {
+    keystone_err("epm_pool_mb and epm_pool_count must have the same length\n");
+    return -EINVAL;
+  }
+
+  for (i = 0; i < epm_pool_nr_mb; i++) {
+    if (!epm_pool_mb[i]) {
+      keystone_err("EPM pool size classes must be non-zero\n");
+      return -EINVAL;
+    }
+    epm_pool[i].size = (size_t) epm_pool_mb[i] << 20;
+    epm_pool[i].nr_total = epm_pool_count[i];
+  }
+
+  /* keep the classes ordered by size so that the first fit is the best fit */
+  for (i = 1; i < epm_pool_nr_mb; i++) {
+    for (j = i; j > 0 && epm_pool[j - 1].size > epm_pool[j].size; j--) {
+      tmp = epm_pool[j];
+      epm_pool[j] = epm_pool[j - 1];
+      epm_pool[j - 1] = tmp;
+    }
+  }
+
+  for (i = 0; i < epm_pool_nr_mb; i++) {
+    class = &epm_pool[i];
+    count = class->nr_total;
+    INIT_LIST_HEAD(&class->free);
+    class->nr_free = 0;
+    class->nr_total = 0;
+    epm_pool_nr_classes++;
+
+    for (j = 0; j < count; j++) {
+      chunk = kmalloc(sizeof(struct epm_chunk), GFP_KERNEL);
+      if (!chunk)
+        break;
+
+      chunk->ptr = (vaddr_t) dma_alloc_coherent(keystone_dev.this_device,
+          class->size, &chunk->pa, GFP_KERNEL);
+      if (!chunk->ptr) {
+        kfree(chunk);
+        break;
+      }
+
+      memset((void*) chunk->ptr, 0, class->size);
+      chunk->size = class->size;
+      chunk->dirty = 0;
+      list_add(&chunk->list, &class->free);
+      class->nr_free++;
+      class->nr_total++;
+    }
+
+    if (class->nr_total < count)
+      keystone_warn("EPM pool: only %u of %u %zu MiB chunk(s) reserved\n",
+                    class->nr_total, count, class->size >> 20);
+    else
+      keystone_info("EPM pool: %u x %zu MiB chunk(s) reserved\n",
+                    class->nr_total, class->size >> 20);
+  }
+
+  return 0;
+}
+
+void epm_pool_destroy(void)
+{
+  int i;
+  struct epm_chunk *chunk, *tmp;
+  struct epm_pool_class* class;
+
+  mutex_lock(&epm_pool_lock);
+  for (i = 0; i < epm_pool_nr_classes; i++) {
+    class = &epm_pool[i];
+    if (class->nr_free != class->nr_total)
+      keystone_warn("EPM pool: %u chunk(s) still in use\n",
+                    class->nr_total - class->nr_free);
+
+    list_for_each_entry_safe(chunk, tmp, &class->free, list) {
+      list_del(&chunk->list);
+      dma_free_coherent(keystone_dev.this_device, chunk->size,
+                        (void*) chunk->ptr, chunk->pa);
+      kfree(chunk);
+    }
+    class->nr_free = 0;
+    class->nr_total = 0;
+  }
+  epm_pool_nr_classes = 0;
+  mutex_unlock(&epm_pool_lock);
+}
+
+/* Take the smallest free chunk that fits min_pages and hand it to epm.
+ * Returns 0 on success, -ENOMEM if no pooled chunk is available. */
+int epm_pool_get(struct epm* epm, unsigned long min_pages)
+{
+  int i;
+  size_t size = min_pages << PAGE_SHIFT;
+  struct epm_chunk* chunk = NULL;
+  struct epm_pool_class* class;
+
+  mutex_lock(&epm_pool_lock);
+  for (i = 0; i < epm_pool_nr_classes; i++) {
+    class = &epm_pool[i];
+    if (class->size < size || list_empty(&class->free))
+      continue;
+
+    chunk = list_first_entry(&class->free, struct epm_chunk, list);
+    list_del(&chunk->list);
+    class->nr_free--;
+    break;
+  }
+  mutex_unlock(&epm_pool_lock);
+
+  if (!chunk)
+    return -ENOMEM;
+
+  /* a previous enclave may have been given more of the chunk than this
+   * one asks for; clear all of that so none of it is left behind */
+  if (chunk->dirty)
+    memset((void*) chunk->ptr, 0, chunk->dirty);
+
+  /* the host writes into the EPM before finalize */
+  chunk->dirty = size;
+
+  epm->chunk = chunk;
+  epm->is_cma = 0;
+  epm->ptr = chunk->ptr;
+  epm->pa = chunk->pa;
+  epm->size = size;
+  epm->order = get_order(size);
+  epm->root_page_table = (void*) chunk->ptr;
+  pr_info("[Driver] EPM is %lu pages long (pooled)", min_pages);
+
+  return 0;
+}
+
+/* Return a pooled chunk to its size class */
+void epm_pool_put(struct epm* epm)
+{
+  int i;
+  struct epm_chunk* chunk = epm->chunk;
+
+  mutex_lock(&epm_pool_lock);
+  for (i = 0; i < epm_pool_nr_classes; i++) {
+    if (epm_pool[i].size == chunk->size) {
+      list_add(&chunk->list, &epm_pool[i].free);
+      epm_pool[i].nr_free++;
+      break;
+    }
+  }
+  mutex_unlock(&epm_pool_lock);
+
+  epm->chunk = NULL;
+}
@@ -23,3 +23,30 @@ struct sbiret sbi_sm_resume_enclave(unsigned long eid) {
       SBI_SM_RESUME_ENCLAVE,
       eid, 0, 0, 0, 0, 0);
 }
+
+struct sbiret sbi_sm_reset_enclave(unsigned long eid) {
+  return sbi_ecall(SBI_EXT_EXPERIMENTAL_KEYSTONE_ENCLAVE,
+      SBI_SM_RESET_ENCLAVE,
+      eid, 0, 0, 0, 0, 0);
+}
+
+struct sbiret sbi_sm_clone_enclave(unsigned long template_eid,
+                                  struct keystone_sbi_create_t* args) {
+  return sbi_ecall(SBI_EXT_EXPERIMENTAL_KEYSTONE_ENCLAVE,
+      SBI_SM_CLONE_ENCLAVE,
+      template_eid, (unsigned long) args, 0, 0, 0, 0);
+}
+
+struct sbiret sbi_sm_checkpoint_enclave(unsigned long eid,
+                                       void* image, size_t size) {
+  return sbi_ecall(SBI_EXT_EXPERIMENTAL_KEYSTONE_ENCLAVE,
+      SBI_SM_CHECKPOINT_ENCLAVE,
+      eid, (unsigned long) image, size, 0, 0, 0);
+}
+
+struct sbiret sbi_sm_restore_enclave(struct keystone_sbi_create_t* args,
+                                    void* image, size_t size) {
+  return sbi_ecall(SBI_EXT_EXPERIMENTAL_KEYSTONE_ENCLAVE,
+      SBI_SM_RESTORE_ENCLAVE,
+      (unsigned long) args, (unsigned long) image, size, 0, 0, 0);
+}
@@ -14,5 +14,12 @@ struct sbiret sbi_sm_create_enclave(struct keystone_sbi_create_t* args);
 struct sbiret sbi_sm_destroy_enclave(unsigned long eid);
 struct sbiret sbi_sm_run_enclave(unsigned long eid);
 struct sbiret sbi_sm_resume_enclave(unsigned long eid);
+struct sbiret sbi_sm_reset_enclave(unsigned long eid);
+struct sbiret sbi_sm_clone_enclave(unsigned long template_eid,
+                                  struct keystone_sbi_create_t* args);
+struct sbiret sbi_sm_checkpoint_enclave(unsigned long eid,
+                                       void* image, size_t size);
+struct sbiret sbi_sm_restore_enclave(struct keystone_sbi_create_t* args,
+                                    void* image, size_t size);
 
 #endif
@@ -41,7 +41,7 @@ int keystone_mmap(struct file* filp, struct vm_area_struct *vma)
   struct utm* utm;
   struct epm* epm;
   struct enclave* enclave;
-  unsigned long vsize, psize;
+  unsigned long vsize, psize, offset;
   vaddr_t paddr;
   enclave = get_enclave_by_id((unsigned long) filp->private_data);
   if(!enclave) {
@@ -54,13 +54,17 @@ int keystone_mmap(struct file* filp, struct vm_area_struct *vma)
   vsize = vma->vm_end - vma->vm_start;
 
   if(enclave->is_init){
-    if (vsize > PAGE_SIZE)
+    /* staging mode: the host may map any range of the EPM (typically
+     * all of it at once) to copy in the enclave image before finalize */
+    offset = vma->vm_pgoff << PAGE_SHIFT;
+    psize = epm->size;
+    if (offset >= psize || vsize > psize - offset)
       return -EINVAL;
-    paddr = epm->pa + (vma->vm_pgoff << PAGE_SHIFT);
-    remap_pfn_range(vma,
-                    vma->vm_start,
-                    paddr >> PAGE_SHIFT,
-                    vsize, vma->vm_page_prot);
+    paddr = epm->pa + offset;
+    return remap_pfn_range(vma,
+                           vma->vm_start,
+                           paddr >> PAGE_SHIFT,
+                           vsize, vma->vm_page_prot);
   }
   else
   {
@@ -84,10 +88,19 @@ static int __init keystone_dev_init(void)
   if (ret < 0)
   {
     pr_err("keystone_enclave: misc_register() failed\n");
+    return ret;
   }
 
   keystone_dev.this_device->coherent_dma_mask = DMA_BIT_MASK(64);
 
+  ret = epm_pool_init();
+  if (ret < 0)
+  {
+    epm_pool_destroy();
+    misc_deregister(&keystone_dev);
+    return ret;
+  }
+
   pr_info("keystone_enclave: " DRV_DESCRIPTION " v" DRV_VERSION "\n");
   return ret;
 }
@@ -95,6 +108,7 @@ static int __init keystone_dev_init(void)
 static void __exit keystone_dev_exit(void)
 {
   pr_info("keystone_enclave: keystone_dev_exit()\n");
+  epm_pool_destroy();
   misc_deregister(&keystone_dev);
   return;
 }
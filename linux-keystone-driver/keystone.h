@@ -35,6 +35,16 @@ long keystone_ioctl(struct file* filep, unsigned int cmd, unsigned long arg);
 int keystone_release(struct inode *inode, struct file *file);
 int keystone_mmap(struct file *filp, struct vm_area_struct *vma);
 
+/* preallocated EPM chunk (see keystone-pool.c) */
+struct epm_chunk {
+  struct list_head list;
+  vaddr_t ptr;
+  dma_addr_t pa;
+  size_t size;
+  /* bytes at the front of the chunk that may not be zero */
+  size_t dirty;
+};
+
 /* enclave private memory */
 struct epm {
   pte_t* root_page_table;
@@ -43,6 +53,7 @@ struct epm {
   unsigned long order;
   paddr_t pa;
   bool is_cma;
+  struct epm_chunk* chunk;
 };
 
 struct utm {
@@ -59,6 +70,8 @@ struct enclave
   int close_on_pexit;
   struct utm* utm;
   struct epm* epm;
+  /* SM-only copy of the measured pages for reset, or NULL */
+  struct epm* ckpt;
   bool is_init;
 };
 
@@ -92,6 +105,11 @@ int utm_destroy(struct utm* utm);
 int utm_init(struct utm* utm, size_t untrusted_size);
 paddr_t epm_va_to_pa(struct epm* epm, vaddr_t addr);
 
+int epm_pool_init(void);
+void epm_pool_destroy(void);
+int epm_pool_get(struct epm* epm, unsigned long min_pages);
+void epm_pool_put(struct epm* epm);
+
 #define keystone_info(fmt, ...) \
   pr_info("keystone_enclave: " fmt, ##__VA_ARGS__)
 #define keystone_err(fmt, ...) \
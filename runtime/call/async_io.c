@@ -0,0 +1,191 @@
+#include "call/async_io.h"
+#include "call/syscall.h"
+#include "mm/vm.h"
+#include "sys/timex.h"
+#include "uaccess.h"
+
+_Static_assert(ASYNC_IO_READ == EDGE_ASYNC_OP_READ &&
+               ASYNC_IO_WRITE == EDGE_ASYNC_OP_WRITE &&
+               ASYNC_IO_FSYNC == EDGE_ASYNC_OP_FSYNC,
+               "eapp async ops are passed to the host as they are");
+_Static_assert(sizeof(struct edge_call) + sizeof(struct edge_async_submit) +
+               sizeof(struct edge_async_sqe) + sizeof(int64_t) <=
+               ASYNC_IO_CALL_SIZE,
+               "a submit and its return fit in the async I/O call slot");
+
+static struct edge_async_area* area;
+
+/* requests the eapp has in flight, one per data slot */
+static struct {
+  int busy;
+  unsigned long op;
+  void* buf;
+  size_t len;
+} slots[EDGE_ASYNC_SLOTS];
+static unsigned long inflight;
+
+void async_io_init(uintptr_t area_va)
+{
+  area = (struct edge_async_area*) area_va;
+  area->cq_head = 0;
+  area->cq_tail = 0;
+}
+
+/* Async I/O calls use a shared buffer slot of their own when there is
+ * one, so they leave the front call's arguments and returns alone */
+static struct edge_call* async_io_call(void)
+{
+  struct edge_call* edge_call = edge_call_slot_alloc();
+
+  return edge_call ? edge_call : (struct edge_call*)shared_buffer;
+}
+
+/* Send an EDGECALL_ASYNC_* call whose arguments are already at the
+ * start of the call's data, and give back its slot. Returns the host's
+ * return value for submits, or 0. */
+static int64_t async_io_edgecall(struct edge_call* edge_call,
+                                 unsigned long call_id, size_t args_len)
+{
+  uintptr_t ret_ptr;
+  size_t ret_len;
+  int64_t ret = -1;
+
+  edge_call->call_id = call_id;
+  if(edge_call_setup_call(edge_call, (void*)edge_call_data_ptr_of(edge_call),
+                          args_len) != 0 ||
+     dispatch_edgecall_to_host(edge_call) != 0 ||
+     edge_call->return_data.call_status != CALL_STATUS_OK)
+    goto done;
+
+  if(call_id != EDGECALL_ASYNC_SUBMIT){
+    ret = 0;
+    goto done;
+  }
+
+  if(edge_call_ret_ptr(edge_call, &ret_ptr, &ret_len) == 0 &&
+     ret_len >= sizeof(int64_t))
+    ret = *(int64_t*)ret_ptr;
+
+done:
+  edge_call_slot_free(edge_call);
+  return ret;
+}
+
+/* Queue a request on the host. Returns the tag (slot) that its
+ * completion will carry, or -1 if it could not be queued. Requests
+ * larger than a slot are shortened, like a short read or write. */
+uintptr_t async_io_submit(unsigned long op, int fd, void* buf, size_t len,
+                          int64_t offset)
+{
+  struct edge_call* edge_call;
+  struct edge_async_submit* args;
+  unsigned long slot;
+
+  if(!area || op < EDGE_ASYNC_OP_READ || op > EDGE_ASYNC_OP_FSYNC)
+    return -1;
+
+  for(slot = 0; slot < EDGE_ASYNC_SLOTS; slot++){
+    if(!slots[slot].busy)
+      break;
+  }
+  if(slot == EDGE_ASYNC_SLOTS)
+    return -1;
+
+  if(len > EDGE_ASYNC_SLOT_SIZE)
+    len = EDGE_ASYNC_SLOT_SIZE;
+
+  if(op == EDGE_ASYNC_OP_WRITE)
+    copy_from_user(area->data[slot], buf, len);
+
+  edge_call = async_io_call();
+  args = (struct edge_async_submit*)edge_call_data_ptr_of(edge_call);
+  args->area = (uintptr_t)area - shared_buffer;
+  args->count = 1;
+  args->sqes[0].op = op;
+  args->sqes[0].slot = slot;
+  args->sqes[0].fd = fd;
+  args->sqes[0].len = len;
+  args->sqes[0].offset = offset;
+
+  if(async_io_edgecall(edge_call, EDGECALL_ASYNC_SUBMIT,
+                       sizeof(struct edge_async_submit) +
+                       sizeof(struct edge_async_sqe)) != 1)
+    return -1;
+
+  slots[slot].busy = 1;
+  slots[slot].op = op;
+  slots[slot].buf = buf;
+  slots[slot].len = len;
+  inflight++;
+
+  print_strace("[runtime] async submit op %lu on %i (size: %lu) = %lu\r\n",
+               op, fd, len, slot);
+  return slot;
+}
+
+/* Consume one completion, copying read data back to the eapp. Returns
+ * its tag and stores its result in *res, or returns -1 if nothing has
+ * completed (and either wait is 0 or nothing is in flight). */
+uintptr_t async_io_complete(int64_t* res, int wait)
+{
+  struct edge_async_cqe cqe;
+  unsigned long head;
+  uint64_t start;
+
+  if(!area)
+    return -1;
+
+  head = area->cq_head;
+  start = get_cycles64();
+  while(head == __atomic_load_n(&area->cq_tail, __ATOMIC_ACQUIRE)){
+    if(!wait || inflight == 0)
+      return -1;
+    if(get_cycles64() - start < ASYNC_IO_SPIN_CYCLES)
+      continue;
+
+    /* nothing yet; block on the host instead of burning the hart */
+    struct edge_call* edge_call = async_io_call();
+    struct edge_async_wait* args =
+      (struct edge_async_wait*)edge_call_data_ptr_of(edge_call);
+    args->area = (uintptr_t)area - shared_buffer;
+    async_io_edgecall(edge_call, EDGECALL_ASYNC_WAIT,
+                      sizeof(struct edge_async_wait));
+    start = get_cycles64();
+  }
+
+  cqe = area->cq[head & (EDGE_ASYNC_SLOTS - 1)];
+  __atomic_store_n(&area->cq_head, head + 1, __ATOMIC_RELEASE);
+
+  if(cqe.slot >= EDGE_ASYNC_SLOTS || !slots[cqe.slot].busy)
+    return -1;
+
+  if(slots[cqe.slot].op == EDGE_ASYNC_OP_READ && cqe.res > 0){
+    copy_to_user(slots[cqe.slot].buf, area->data[cqe.slot],
+                 (size_t)cqe.res > slots[cqe.slot].len ?
+                 slots[cqe.slot].len : (size_t)cqe.res);
+  }
+  slots[cqe.slot].busy = 0;
+  inflight--;
+
+  if(res)
+    copy_to_user(res, &cqe.res, sizeof(int64_t));
+
+  print_strace("[runtime] async complete %lu = %li\r\n", cqe.slot, cqe.res);
+  return cqe.slot;
+}
+
+/* The host must not write into the shared buffer once we are gone */
+void async_io_drain()
+{
+  unsigned long i;
+
+  while(inflight > 0){
+    if(async_io_complete(NULL, 1) == (uintptr_t)-1)
+      break;
+  }
+
+  /* drop whatever a misbehaving host left unaccounted for */
+  for(i = 0; i < EDGE_ASYNC_SLOTS; i++)
+    slots[i].busy = 0;
+  inflight = 0;
+}
@@ -59,7 +59,11 @@ uintptr_t io_syscall_fsync(int fd){
   size_t totalsize = (sizeof(struct edge_syscall)+
                       sizeof(sargs_SYS_fsync));
 
+#ifdef USE_DEFER_SYSCALL
+  uintptr_t ret = dispatch_edgecall_syscall_deferred(edge_syscall, totalsize);
+#else
   uintptr_t ret = dispatch_edgecall_syscall(edge_syscall, totalsize);
+#endif /* USE_DEFER_SYSCALL */
   print_strace("[runtime] proxied fsync (%i) = %li\r\n", fd, ret);
   return ret;
 }
@@ -92,12 +96,16 @@ uintptr_t io_syscall_close(int fd){
   size_t totalsize = (sizeof(struct edge_syscall)+
                       sizeof(sargs_SYS_close));
 
+#ifdef USE_DEFER_SYSCALL
+  uintptr_t ret = dispatch_edgecall_syscall_deferred(edge_syscall, totalsize);
+#else
   uintptr_t ret = dispatch_edgecall_syscall(edge_syscall, totalsize);
+#endif /* USE_DEFER_SYSCALL */
   print_strace("[runtime] proxied close (%i) = %li\r\n", fd, ret);
   return ret;
 }
 
-uintptr_t io_syscall_read(int fd, void* buf, size_t len){
+static uintptr_t io_syscall_read_chunk(int fd, void* buf, size_t len){
   struct edge_syscall* edge_syscall = (struct edge_syscall*)edge_call_data_ptr();
   sargs_SYS_read* args = (sargs_SYS_read*)edge_syscall->data;
   uintptr_t ret = -1;
@@ -128,7 +136,7 @@ uintptr_t io_syscall_read(int fd, void* buf, size_t len){
   return ret;
 }
 
-uintptr_t io_syscall_write(int fd, void* buf, size_t len){
+static uintptr_t io_syscall_write_chunk(int fd, void* buf, size_t len){
   /* print_strace("[write] len :%lu\r\n", len); */
   /* if(len > 0){ */
   /*   size_t stracelen = len > MAX_STRACE_PRINT? MAX_STRACE_PRINT:len; */
@@ -164,6 +172,83 @@ uintptr_t io_syscall_write(int fd, void* buf, size_t len){
   return ret;
 }
 
+/* Regular files are read in several chunks; for pipes, sockets and
+ * ttys a second read could block where one large read would have
+ * returned what was available, so those just get a short read. */
+static int io_syscall_is_regular(int fd){
+  struct edge_syscall* edge_syscall = (struct edge_syscall*)edge_call_data_ptr();
+  sargs_SYS_fstat* args = (sargs_SYS_fstat*)edge_syscall->data;
+  edge_syscall->syscall_num = SYS_fstat;
+  args->fd = fd;
+
+  size_t totalsize = (sizeof(struct edge_syscall) +
+                      sizeof(sargs_SYS_fstat));
+
+  return dispatch_edgecall_syscall(edge_syscall, totalsize) == 0 &&
+    S_ISREG(args->stats.st_mode);
+}
+
+/* Transfers that don't fit in the shared buffer are split into
+ * buffer-sized chunks, one edge call each */
+uintptr_t io_syscall_read(int fd, void* buf, size_t len){
+  struct edge_syscall* edge_syscall = (struct edge_syscall*)edge_call_data_ptr();
+  sargs_SYS_read* args = (sargs_SYS_read*)edge_syscall->data;
+  size_t room = edge_call_room((uintptr_t)args->buf);
+  size_t done = 0;
+  uintptr_t ret;
+
+  if(len <= room){
+    return io_syscall_read_chunk(fd, buf, len);
+  }
+  if(room == 0){
+    return -1;
+  }
+  if(!io_syscall_is_regular(fd)){
+    return io_syscall_read_chunk(fd, buf, room);
+  }
+
+  while(done < len){
+    size_t chunk = len - done > room ? room : len - done;
+    ret = io_syscall_read_chunk(fd, (char*)buf + done, chunk);
+    if((intptr_t)ret <= 0){
+      return done ? done : ret;
+    }
+    done += ret;
+    if(ret < chunk){
+      break;
+    }
+  }
+  return done;
+}
+
+uintptr_t io_syscall_write(int fd, void* buf, size_t len){
+  struct edge_syscall* edge_syscall = (struct edge_syscall*)edge_call_data_ptr();
+  sargs_SYS_write* args = (sargs_SYS_write*)edge_syscall->data;
+  size_t room = edge_call_room((uintptr_t)args->buf);
+  size_t done = 0;
+  uintptr_t ret;
+
+  if(len <= room){
+    return io_syscall_write_chunk(fd, buf, len);
+  }
+  if(room == 0){
+    return -1;
+  }
+
+  while(done < len){
+    size_t chunk = len - done > room ? room : len - done;
+    ret = io_syscall_write_chunk(fd, (char*)buf + done, chunk);
+    if((intptr_t)ret < 0){
+      return done ? done : ret;
+    }
+    done += ret;
+    if(ret < chunk){
+      break;
+    }
+  }
+  return done;
+}
+
 uintptr_t io_syscall_openat(int dirfd, char* path,
                             int flags, mode_t mode){
   struct edge_syscall* edge_syscall = (struct edge_syscall*)edge_call_data_ptr();
@@ -229,10 +314,68 @@ uintptr_t io_syscall_unlinkat(int dirfd, char* path,
   return ret;
 }
 
+/* Lays out a readv/writev record with every segment in the shared
+ * buffer. Returns the record size, or 0 if it doesn't fit. */
+static size_t io_syscall_rwv_setup(struct edge_syscall* edge_syscall,
+                                   int fd, const struct iovec *iov, int iovcnt,
+                                   int is_write){
+  sargs_SYS_writev* args = (sargs_SYS_writev*)edge_syscall->data;
+  uintptr_t data = (uintptr_t)&args->iov[iovcnt];
+  size_t total = 0;
+  int i;
+
+  if(iovcnt < 0 || iovcnt > EDGE_SYSCALL_IOV_MAX){
+    return 0;
+  }
+
+  args->fd = fd;
+  args->iovcnt = iovcnt;
+
+  for(i=0; i<iovcnt; i++){
+    struct iovec iov_local;
+    copy_from_user(&iov_local, &(iov[i]), sizeof(struct iovec));
+    if(iov_local.iov_len > SIZE_MAX - total){
+      return 0;
+    }
+    total += iov_local.iov_len;
+  }
+
+  // Sanity check that all the segments will fit in the shared memory
+  if(edge_call_check_ptr_valid(data, total) != 0){
+    return 0;
+  }
+
+  for(i=0; i<iovcnt; i++){
+    struct iovec iov_local;
+    copy_from_user(&iov_local, &(iov[i]), sizeof(struct iovec));
+    if(edge_call_get_offset_from_ptr(data, iov_local.iov_len,
+                                     &args->iov[i].offset) != 0){
+      return 0;
+    }
+    args->iov[i].size = iov_local.iov_len;
+    if(is_write){
+      copy_from_user((void*)data, iov_local.iov_base, iov_local.iov_len);
+    }
+    data += iov_local.iov_len;
+  }
+
+  return data - (uintptr_t)edge_syscall;
+}
+
 uintptr_t io_syscall_writev(int fd, const struct iovec *iov, int iovcnt){
+  struct edge_syscall* edge_syscall = (struct edge_syscall*)edge_call_data_ptr();
   int i=0;
   uintptr_t ret = 0;
   size_t total = 0;
+
+  edge_syscall->syscall_num = SYS_writev;
+  size_t totalsize = io_syscall_rwv_setup(edge_syscall, fd, iov, iovcnt, 1);
+  if(totalsize != 0){
+    ret = dispatch_edgecall_syscall(edge_syscall, totalsize);
+    print_strace("[runtime] proxied writev (cnt %i) = %li\r\n", iovcnt, ret);
+    return ret;
+  }
+
   print_strace("[runtime] Simulating writev (cnt %i) with write calls\r\n",iovcnt);
   for(i=0; i<iovcnt && ret >= 0;i++){
     struct iovec iov_local;
@@ -246,9 +389,47 @@ uintptr_t io_syscall_writev(int fd, const struct iovec *iov, int iovcnt){
 }
 
 uintptr_t io_syscall_readv(int fd, const struct iovec *iov, int iovcnt){
+  struct edge_syscall* edge_syscall = (struct edge_syscall*)edge_call_data_ptr();
+  sargs_SYS_readv* args = (sargs_SYS_readv*)edge_syscall->data;
   int i=0;
   uintptr_t ret = 0;
   size_t total = 0;
+
+  edge_syscall->syscall_num = SYS_readv;
+  size_t totalsize = io_syscall_rwv_setup(edge_syscall, fd, iov, iovcnt, 0);
+  if(totalsize != 0){
+    ret = dispatch_edgecall_syscall(edge_syscall, totalsize);
+    print_strace("[runtime] proxied readv (cnt %i) = %li\r\n", iovcnt, ret);
+    if((intptr_t)ret <= 0){
+      return ret;
+    }
+
+    // The record is ours, but the host may have rewritten it: walk the
+    // segments the way the setup laid them out and trust only ret
+    uintptr_t seg = (uintptr_t)&args->iov[iovcnt];
+    uintptr_t end = (uintptr_t)edge_syscall + totalsize;
+    if(ret > end - seg){
+      return -1;
+    }
+
+    // Hand the data back segment by segment, up to what was read
+    for(i=0; i<iovcnt && total < ret; i++){
+      struct iovec iov_local;
+      copy_from_user(&iov_local, &(iov[i]), sizeof(struct iovec));
+      size_t len = iov_local.iov_len;
+      if(len > ret - total){
+        len = ret - total;
+      }
+      if(len > end - seg){
+        return -1;
+      }
+      copy_to_user(iov_local.iov_base, (void*)seg, len);
+      seg += len;
+      total += len;
+    }
+    return ret;
+  }
+
   print_strace("[runtime] Simulating readv (cnt %i) with read calls\r\n",iovcnt);
   for(i=0; i<iovcnt && ret >= 0;i++){
     struct iovec iov_local;
@@ -10,6 +10,7 @@
 
 #include "mm/freemem.h"
 #include "mm/mm.h"
+#include "mm/vma.h"
 #include "util/rt_util.h"
 #include "call/syscall.h"
 #include "uaccess.h"
@@ -101,13 +102,10 @@ uintptr_t linux_uname(void* buf){
 
 uintptr_t syscall_munmap(void *addr, size_t length){
   uintptr_t ret = (uintptr_t)((void*)-1);
-#if defined(MEGAPAGE_MAPPING)
-  free_pages(vpn((uintptr_t)addr), MEGAPAGE_UP(length)/RISCV_MEGAPAGE_SIZE, true);
-#elif defined(GIGAPAGE_MAPPING)
-  free_pages(vpn((uintptr_t)addr), GIGAPAGE_UP(length)/RISCV_GIGAPAGE_SIZE, true);
-#else
-  free_pages(vpn((uintptr_t)addr), length/RISCV_PAGE_SIZE, false);
-#endif
+  // Pages that were never touched only exist in the region
+  if (!vma_remove((uintptr_t)addr, (uintptr_t)addr + PAGE_UP(length)))
+    return ret;
+  free_pages(vpn((uintptr_t)addr), PAGE_UP(length)/RISCV_PAGE_SIZE);
   ret = 0;
   tlb_flush();
   message("[runtime] munmapped was called.\n");
@@ -121,7 +119,7 @@ uintptr_t syscall_mmap(void *addr, size_t length, int prot, int flags,
 
   int pte_flags = PTE_U | PTE_A;
 
-  if(flags != (MAP_ANONYMOUS | MAP_PRIVATE) || fd != -1){
+  if((flags & ~MAP_FIXED) != (MAP_ANONYMOUS | MAP_PRIVATE) || fd != -1){
     // we don't support mmaping any other way yet
     goto done;
   }
@@ -134,72 +132,51 @@ uintptr_t syscall_mmap(void *addr, size_t length, int prot, int flags,
   if(prot & PROT_EXEC)
     pte_flags |= PTE_X;
 
-  bool is_largepage = false;
-
-#if defined(MEGAPAGE_MAPPING)
-  // Find a continuous VA space that will fit the req. size
-  unsigned long req_pages = vpn(MEGAPAGE_UP(length));
-  is_largepage = true;
-
-  // Do we have enough available phys pages?
-  //divide by 2^9 = 512 to get the required 2MiB megapages
-  if ((req_pages >> RISCV_PT_INDEX_BITS) > spa_megapages_available()){
-    goto done;
-  }
-#elif defined(GIGAPAGE_MAPPING)
-  // Find a continuous VA space that will fit the req. size
-  unsigned long req_pages = vpn(GIGAPAGE_UP(length));
-  is_largepage = true;
-
-  // Do we have enough available phys pages?
-  //divide by 2^18 to get the required 1GiB pages
-  if ((req_pages >> 2 * RISCV_PT_INDEX_BITS) > spa_gigapages_available()){
-    goto done;
-  }
-#else
   unsigned long req_pages = vpn(PAGE_UP(length));
-
-  if (req_pages > spa_available()){
-    goto done;
-  }
-#endif
-
-  uintptr_t valid_pages;
-  // Start looking at  EYRIE_ANON_REGION_START for VA space
-  uintptr_t starting_vpn = vpn(EYRIE_ANON_REGION_START);
-
-  while((starting_vpn + req_pages) <= vpn(EYRIE_ANON_REGION_END)){
-    valid_pages = test_va_range(starting_vpn, req_pages);
-
-    if(req_pages == valid_pages){
-      if (is_largepage) {
-      #ifdef MEGAPAGE_MAPPING
-        req_pages = req_pages >> RISCV_PT_INDEX_BITS;  // #required 2MiB megapages
-      #else
-        req_pages = req_pages >> 2 * RISCV_PT_INDEX_BITS;
-      #endif
-      }
-      // Set a successful value if we allocate
-      // TODO free partial allocation on failure
-      if(alloc_pages(starting_vpn, req_pages, pte_flags, is_largepage) == req_pages)
-      {
-        ret = starting_vpn << RISCV_PAGE_BITS;
+  uintptr_t size = req_pages << RISCV_PAGE_BITS;
+  uintptr_t start = (uintptr_t)addr;
+
+  if(flags & MAP_FIXED){
+    // Replace whatever mmap() put there, as munmap() would, but leave
+    // the eapp image, the UTM window and the stack alone
+    if(!size || (start & (RISCV_PAGE_SIZE - 1)) ||
+       start + size < start || start + size > EYRIE_ANON_REGION_END ||
+       !vma_can_replace(start, start + size) ||
+       !vma_remove(start, start + size)){
+      goto done;
+    }
+    free_pages(vpn(start), req_pages);
+  } else {
+    // Place the mapping so that page faults can map the largest leaves
+    // that fit in it
+    unsigned int align_bits = RISCV_PAGE_BITS;
+    for (int level = 1; level < RISCV_PT_LEVELS; level++) {
+      if (RISCV_GET_LVL_PGSIZE(level) <= get_max_page_size() &&
+          size >= RISCV_GET_LVL_PGSIZE(level)) {
+        align_bits = RISCV_GET_LVL_PGSIZE_BITS(level);
+        break;
       }
-      break;
     }
-    else {
-        if(!is_largepage) {
-          starting_vpn = starting_vpn + valid_pages + 1;
-        } else {
-          #ifdef MEGAPAGE_MAPPING
-            starting_vpn = vpn(MEGAPAGE_UP((starting_vpn + valid_pages + 1) << RISCV_PAGE_BITS));
-          #else
-            starting_vpn = vpn(GIGAPAGE_UP((starting_vpn + valid_pages + 1) << RISCV_PAGE_BITS));
-          #endif
-        }
+
+    // The lowest gap between regions that fits, past any pages that are
+    // mapped without a region (such as the UTM window)
+    start = vma_place(EYRIE_ANON_REGION_START, size, align_bits);
+    while(start){
+      size_t valid_pages = test_va_range(vpn(start), req_pages);
+      if(valid_pages == req_pages)
+        break;
+      start = vma_place(start + ((valid_pages + 1) << RISCV_PAGE_BITS),
+                        size, align_bits);
     }
+    if(!start)
+      goto done;
   }
 
+  // Set a successful value if we can record the region, pages are
+  // allocated by vma_handle_page_fault() on first touch
+  if (vma_add(start, start + size, pte_flags, 0))
+    ret = start;
+
  done:
   tlb_flush();
   message("[runtime] [mmap]: addr: 0x%p, length %lu, prot 0x%x, flags 0x%x, fd %i, offset %lu (%lu pages %x) = 0x%p\r\n", addr, length, prot, flags, fd, offset, req_pages, pte_flags, ret);
@@ -211,8 +188,9 @@ uintptr_t syscall_mmap(void *addr, size_t length, int prot, int flags,
 
 uintptr_t syscall_mprotect(void *addr, size_t len, int prot) {
   print_strace("mprotect is called for %zu bytes starting at addr %p and for protection flags %d\n", len, addr, prot);
-  int i, ret;
-  size_t pages = len / RISCV_PAGE_SIZE;
+  uintptr_t start = (uintptr_t)addr;
+  uintptr_t end = start + PAGE_UP(len);
+  uintptr_t va;
 
   int pte_flags = PTE_U | PTE_A;
   if(prot & PROT_READ)
@@ -222,11 +200,38 @@ uintptr_t syscall_mprotect(void *addr, size_t len, int prot) {
   if(prot & PROT_EXEC)
     pte_flags |= PTE_X;
 
-  for(i = 0; i < pages; i++) {
-    ret = realloc_page(vpn((uintptr_t) addr) + i, pte_flags);
-    if(!ret)
+  if(start & (RISCV_PAGE_SIZE - 1) || end < start)
+    return -1;
+
+  // Every page must be in a region or mapped, so that nothing changes
+  // on failure
+  for(va = start; va < end; ){
+    struct vma* vma = vma_find(va);
+    if(vma){
+      va = vma->end;
+      continue;
+    }
+    if(!translate(va))
       return -1;
+    va += RISCV_PAGE_SIZE;
+  }
+
+  // Regions are split as needed and keep the protection for pages that
+  // are not touched yet
+  if(!vma_protect(start, end, pte_flags))
+    return -1;
+
+  for(va = start; va < end; va += RISCV_PAGE_SIZE){
+    if(!translate(va))
+      continue;
+    // A leaf cannot lack all permissions, so PROT_NONE drops the page;
+    // any access is then a fatal fault and the contents are gone
+    if(!(pte_flags & (PTE_R | PTE_W | PTE_X)))
+      free_page(vpn(va));
+    else
+      realloc_page(vpn(va), pte_flags);
   }
+  tlb_flush();
 
   return 0;
 }
@@ -241,7 +246,6 @@ uintptr_t syscall_brk(void* addr){
   uintptr_t current_break = get_program_break();
   uintptr_t ret = -1;
   unsigned long req_page_count = 0;
-  bool is_largepage = false;
 
   // Return current break if null or current break
   if (req_break == 0) {
@@ -254,68 +258,13 @@ uintptr_t syscall_brk(void* addr){
     goto done;
   }
 
-  // Otherwise try to allocate pages
-
-#ifdef MEGAPAGE_MAPPING
-  //Pack smaller allocations into existing megapages until a new one is needed
-  is_largepage = true;
-
-  req_page_count = (MEGAPAGE_UP(req_break) - current_break) / RISCV_MEGAPAGE_SIZE;
-  if (spa_megapages_available() < req_page_count){
-    goto done;
-  }
-
-  //Align current break to a 2MiB-aligned address for correct 2MiB-mapping creation
-  if( alloc_pages(vpn(MEGAPAGE_UP(current_break)),
-                  req_page_count,
-                  PTE_W | PTE_R | PTE_D | PTE_U | PTE_A, is_largepage)
-      != req_page_count){
-    goto done;
-  }
-
-  // Keep program break still page-aligned for minimum memory waste.
-  // Page permissions remain the same among brk calls
-  set_program_break(PAGE_UP(req_break));
-  ret = req_break;
-  goto done;
-#endif
-
-#ifdef GIGAPAGE_MAPPING
-  is_largepage = true;
-
-  req_page_count = (GIGAPAGE_UP(req_break) - current_break) / RISCV_GIGAPAGE_SIZE;
-  if (spa_gigapages_available() < req_page_count){
-    goto done;
-  }
-
-  //Align current break to a 1GiB-aligned address for correct 1GiB-mapping creation
-  if( alloc_pages(vpn(GIGAPAGE_UP(current_break)),
-                  req_page_count,
-                  PTE_W | PTE_R | PTE_D | PTE_U | PTE_A, is_largepage)
-      != req_page_count){
-    goto done;
-  }
-
-  // Keep program break still page-aligned for minimum memory waste.
-  // Page permissions remain the same among brk calls
-  set_program_break(PAGE_UP(req_break));
-  ret = req_break;
-  goto done;
-#endif
-  
-  // Fallback to 4KB mapping
-  // Can we allocate enough phys pages?
+  // Otherwise extend the heap region, its pages are allocated by
+  // vma_handle_page_fault() on first touch and promoted to larger
+  // leaves once a whole window is in use
   req_page_count = (PAGE_UP(req_break) - current_break) / RISCV_PAGE_SIZE;
-  if (spa_available() < req_page_count){
-    goto done;
-  }
-
-  // Allocate pages
-  // TODO free pages on failure
-  if( alloc_pages(vpn(current_break),
-                  req_page_count,
-                  PTE_W | PTE_R | PTE_D | PTE_U | PTE_A, is_largepage)
-      != req_page_count){
+  if (test_va_range(vpn(current_break), req_page_count) != req_page_count ||
+      !vma_add(current_break, PAGE_UP(req_break),
+               PTE_W | PTE_R | PTE_D | PTE_U | PTE_A, 0)){
     goto done;
   }
 
@@ -159,6 +159,12 @@ uintptr_t io_syscall_recvfrom(int sockfd, uintptr_t buf, size_t len, int flags,
 
 	sargs_SYS_recvfrom *args = (sargs_SYS_recvfrom *) edge_syscall->data;
 
+	/* Receive at most what fits in the shared buffer; the eapp gets a
+	 * short read like it would from a smaller buffer */
+	if(len > edge_call_room((uintptr_t)args->buf)){
+		len = edge_call_room((uintptr_t)args->buf);
+	}
+
 	args->sockfd = sockfd; 
 	args->len = len;
 	args->flags = flags; 
@@ -197,7 +203,7 @@ uintptr_t io_syscall_recvfrom(int sockfd, uintptr_t buf, size_t len, int flags,
 		return ret; 
 }
 
-uintptr_t io_syscall_sendto(int sockfd, uintptr_t buf, size_t len, int flags,
+static uintptr_t io_syscall_sendto_chunk(int sockfd, uintptr_t buf, size_t len, int flags,
                 				uintptr_t dest_addr, int addrlen) {
 	uintptr_t ret = -1;
 	struct edge_syscall* edge_syscall = (struct edge_syscall*)edge_call_data_ptr();
@@ -240,6 +246,36 @@ uintptr_t io_syscall_sendto(int sockfd, uintptr_t buf, size_t len, int flags,
 		return ret; 
 }
 
+/* Messages on connected sockets that don't fit in the shared buffer are
+ * sent in chunks. With a destination address the socket is most likely
+ * datagram-based, where splitting would change the message, so those
+ * still have to fit. */
+uintptr_t io_syscall_sendto(int sockfd, uintptr_t buf, size_t len, int flags,
+                				uintptr_t dest_addr, int addrlen) {
+	struct edge_syscall* edge_syscall = (struct edge_syscall*)edge_call_data_ptr();
+	sargs_SYS_sendto *args = (sargs_SYS_sendto *) edge_syscall->data;
+	size_t room = edge_call_room((uintptr_t)args->buf);
+	size_t done = 0;
+	uintptr_t ret;
+
+	if(len <= room || dest_addr != 0 || room == 0) {
+		return io_syscall_sendto_chunk(sockfd, buf, len, flags, dest_addr, addrlen);
+	}
+
+	while(done < len) {
+		size_t chunk = len - done > room ? room : len - done;
+		ret = io_syscall_sendto_chunk(sockfd, buf + done, chunk, flags, 0, 0);
+		if((intptr_t)ret < 0) {
+			return done ? done : ret;
+		}
+		done += ret;
+		if(ret < chunk) {
+			break;
+		}
+	}
+	return done;
+}
+
 uintptr_t io_syscall_sendfile(int out_fd, int in_fd, uintptr_t offset, int count) {
 	uintptr_t ret = -1;
 	struct edge_syscall* edge_syscall = (struct edge_syscall*)edge_call_data_ptr();
@@ -43,6 +43,22 @@ sbi_stop_enclave(uint64_t request) {
   return SBI_CALL_1(SBI_EXT_EXPERIMENTAL_KEYSTONE_ENCLAVE, SBI_SM_STOP_ENCLAVE, request);
 }
 
+/* Stops for an edge call. A restored enclave gets back
+ * SBI_ERR_SM_ENCLAVE_RESTORED and its new DRAM base in $a1. */
+uintptr_t
+sbi_stop_enclave_edge_call(uintptr_t* dram_base) {
+  register uintptr_t a0 __asm__("a0") = STOP_EDGE_CALL_HOST;
+  register uintptr_t a1 __asm__("a1") = 0;
+  register uintptr_t a6 __asm__("a6") = SBI_SM_STOP_ENCLAVE;
+  register uintptr_t a7 __asm__("a7") = SBI_EXT_EXPERIMENTAL_KEYSTONE_ENCLAVE;
+  __asm__ volatile("ecall"
+                   : "+r"(a0), "+r"(a1)
+                   : "r"(a6), "r"(a7)
+                   : "memory");
+  *dram_base = a1;
+  return a0;
+}
+
 void
 sbi_exit_enclave(uint64_t retval) {
   SBI_CALL_1(SBI_EXT_EXPERIMENTAL_KEYSTONE_ENCLAVE, SBI_SM_EXIT_ENCLAVE, retval);
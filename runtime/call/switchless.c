@@ -0,0 +1,60 @@
+#include "call/switchless.h"
+#include "mm/vm.h"
+#include "sys/timex.h"
+
+static struct edge_switchless_ring* ring;
+
+void switchless_init(uintptr_t ring_va)
+{
+  ring = (struct edge_switchless_ring*) ring_va;
+  __atomic_store_n(&ring->enclave_magic, EDGE_SWITCHLESS_MAGIC, __ATOMIC_RELEASE);
+}
+
+/* Post an edge call that has already been set up in the shared buffer.
+ * Returns 0 if a host worker served it, or -1 if the caller has to
+ * take a regular enclave exit. */
+int switchless_call(struct edge_call* edge_call)
+{
+  unsigned long head, tail, status, delay, i;
+  struct edge_switchless_slot* slot;
+  uint64_t start;
+
+  if (!ring || !__atomic_load_n(&ring->host_active, __ATOMIC_ACQUIRE))
+    return -1;
+
+  head = ring->head;
+  tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  if (head - tail >= EDGE_SWITCHLESS_RING_SIZE)
+    return -1;
+
+  slot = &ring->slots[head & (EDGE_SWITCHLESS_RING_SIZE - 1)];
+  slot->call_offset = (uintptr_t) edge_call - shared_buffer;
+  __atomic_store_n(&slot->status, SWITCHLESS_SLOT_POSTED, __ATOMIC_RELEASE);
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+  /* spin with exponential backoff */
+  start = get_cycles64();
+  delay = 1;
+  while (get_cycles64() - start < SWITCHLESS_SPIN_CYCLES) {
+    if (__atomic_load_n(&slot->status, __ATOMIC_ACQUIRE) == SWITCHLESS_SLOT_DONE) {
+      slot->status = SWITCHLESS_SLOT_FREE;
+      return 0;
+    }
+    for (i = 0; i < delay; i++)
+      __asm__ volatile("nop");
+    if (delay < 1024)
+      delay <<= 1;
+  }
+
+  /* nobody picked it up; withdraw the request and exit for real */
+  status = SWITCHLESS_SLOT_POSTED;
+  if (__atomic_compare_exchange_n(&slot->status, &status,
+        SWITCHLESS_SLOT_CANCELLED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    return -1;
+
+  /* the host is already running the call, wait for it */
+  while (__atomic_load_n(&slot->status, __ATOMIC_ACQUIRE) != SWITCHLESS_SLOT_DONE)
+    ;
+  slot->status = SWITCHLESS_SLOT_FREE;
+  return 0;
+}
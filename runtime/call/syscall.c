@@ -11,6 +11,7 @@
 #include "uaccess.h"
 #include "mm/mm.h"
 #include "util/rt_util.h"
+#include "sm_err.h"
 
 #include "call/syscall_nums.h"
 
@@ -26,11 +27,204 @@
 #include "call/net_wrap.h"
 #endif /* USE_NET_SYSCALL */
 
+#ifdef USE_SWITCHLESS
+#include "call/switchless.h"
+#endif /* USE_SWITCHLESS */
+
+#ifdef USE_ASYNC_IO
+#include "call/async_io.h"
+#endif /* USE_ASYNC_IO */
+
 extern void exit_enclave(uintptr_t arg0);
 
+/* hand a prepared edge call to the host */
+uintptr_t dispatch_edgecall_to_host(struct edge_call* edge_call){
+#ifdef USE_SWITCHLESS
+  if(switchless_call(edge_call) == 0){
+    return 0;
+  }
+#endif /* USE_SWITCHLESS */
+  struct edge_call* front = (struct edge_call*)shared_buffer;
+  struct edge_call saved;
+  uintptr_t dram_base;
+  uintptr_t ret;
+
+  /* The host looks for the call at the front of the buffer. Point it at
+   * a call in a slot from there, and leave the front call as it was. */
+  if(edge_call != front){
+    saved = *front;
+    front->call_id = EDGECALL_FORWARD;
+    if(edge_call_setup_call(front, edge_call, sizeof(struct edge_call)) != 0){
+      *front = saved;
+      return -1;
+    }
+  }
+
+  ret = sbi_stop_enclave_edge_call(&dram_base);
+
+  /* We were checkpointed during this call and restored into another EPM.
+   * The restoring host has answered the call, so just catch up on where
+   * our memory is now. */
+  if(ret == SBI_ERR_SM_ENCLAVE_RESTORED){
+    vm_relocate(dram_base);
+    ret = 0;
+  }
+
+  if(edge_call != front){
+    /* a host that didn't forward it never touched the slot */
+    if(front->return_data.call_status != CALL_STATUS_OK){
+      edge_call->return_data.call_status = front->return_data.call_status;
+    }
+    *front = saved;
+  }
+  return ret;
+}
+
+#ifdef USE_DEFER_SYSCALL
+/* Syscalls whose results the eapp doesn't wait on (close, fsync) are
+ * queued here and go to the host as a batch in front of the next
+ * proxied syscall instead of costing an exit of their own. */
+#define DEFERRED_SYSCALL_MAX 16
+#define DEFERRED_SYSCALL_SIZE 32
+
+/* Upper bound on the shared buffer space a batch needs besides the
+ * trailing record */
+#define DEFERRED_BATCH_SIZE \
+  (sizeof(struct edge_syscall_batch) + \
+   (DEFERRED_SYSCALL_MAX + 1) * sizeof(struct edge_syscall_batch_entry) + \
+   DEFERRED_SYSCALL_MAX * DEFERRED_SYSCALL_SIZE)
+
+#define RECORD_ALIGN(n) (((n) + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1))
+
+static struct {
+  size_t size;
+  unsigned char record[DEFERRED_SYSCALL_SIZE];
+} deferred_syscalls[DEFERRED_SYSCALL_MAX];
+static size_t deferred_count = 0;
+
+/* Lays the queued records out as a batch at batch_start, followed by
+ * the (optional) trailing record that is already in the shared buffer,
+ * and sends it. The queue is only emptied once the host ran the batch,
+ * so nothing is dropped when it can't be sent. */
+static int send_syscall_batch(uintptr_t batch_start,
+                              struct edge_syscall* trailing, size_t trailing_len,
+                              uintptr_t* trailing_ret){
+  struct edge_call* edge_call = (struct edge_call*)shared_buffer;
+  struct edge_syscall_batch* batch = (struct edge_syscall_batch*)batch_start;
+  size_t count = deferred_count + (trailing ? 1 : 0);
+  size_t batch_len = sizeof(struct edge_syscall_batch) +
+    count * sizeof(struct edge_syscall_batch_entry);
+  uintptr_t record = batch_start + batch_len;
+  size_t i;
+
+  if(edge_call_check_ptr_valid(batch_start, DEFERRED_BATCH_SIZE) != 0){
+    return -1;
+  }
+
+  batch->count = count;
+  for(i = 0; i < count; i++){
+    struct edge_syscall_batch_entry* entry = &batch->entries[i];
+    if(trailing && i == count - 1){
+      entry->size = trailing_len;
+      if(edge_call_get_offset_from_ptr((uintptr_t)trailing, trailing_len,
+                                       &entry->offset) != 0){
+        return -1;
+      }
+      break;
+    }
+    entry->size = deferred_syscalls[i].size;
+    memcpy((void*)record, deferred_syscalls[i].record, entry->size);
+    edge_call_get_offset_from_ptr(record, entry->size, &entry->offset);
+    record += RECORD_ALIGN(entry->size);
+  }
+
+  edge_call->call_id = EDGECALL_SYSCALL_BATCH;
+  if(edge_call_setup_call(edge_call, (void*)batch, batch_len) != 0){
+    return -1;
+  }
+
+  if(dispatch_edgecall_to_host(edge_call) != 0 ||
+     edge_call->return_data.call_status != CALL_STATUS_OK){
+    return -1;
+  }
+
+  deferred_count = 0;
+
+  for(i = 0; i < count; i++){
+    print_strace("[runtime] batched syscall %lu/%lu = %li\r\n",
+                 i + 1, count, batch->entries[i].ret);
+  }
+
+  if(trailing){
+    *trailing_ret = batch->entries[count - 1].ret;
+  }
+  return 0;
+}
+
+/* Sends a syscall record along with everything that is queued */
+static uintptr_t dispatch_edgecall_syscall_batched(struct edge_syscall* syscall_data_ptr,
+                                                   size_t data_len){
+  static unsigned char saved[DEFERRED_BATCH_SIZE];
+  uintptr_t batch_start = RECORD_ALIGN((uintptr_t)syscall_data_ptr + data_len);
+  uintptr_t ret;
+  size_t saved_len;
+
+  if(edge_call_check_ptr_valid(batch_start, DEFERRED_BATCH_SIZE) == 0){
+    if(send_syscall_batch(batch_start, syscall_data_ptr, data_len, &ret) != 0){
+      return -1;
+    }
+    return ret;
+  }
+
+  /* No room behind this record: flush the queue on its own in front
+   * of it, and put back what the batch overwrote */
+  saved_len = data_len < DEFERRED_BATCH_SIZE ? data_len : DEFERRED_BATCH_SIZE;
+  memcpy(saved, syscall_data_ptr, saved_len);
+  if(flush_deferred_syscalls() != 0){
+    return -1;
+  }
+  memcpy(syscall_data_ptr, saved, saved_len);
+
+  return dispatch_edgecall_syscall(syscall_data_ptr, data_len);
+}
+
+uintptr_t dispatch_edgecall_syscall_deferred(struct edge_syscall* syscall_data_ptr,
+                                             size_t data_len){
+  if(data_len > DEFERRED_SYSCALL_SIZE ||
+     deferred_count == DEFERRED_SYSCALL_MAX){
+    return dispatch_edgecall_syscall(syscall_data_ptr, data_len);
+  }
+
+  memcpy(deferred_syscalls[deferred_count].record, syscall_data_ptr, data_len);
+  deferred_syscalls[deferred_count].size = data_len;
+  deferred_count++;
+
+  /* The real result is reported by the host later */
+  return 0;
+}
+
+int flush_deferred_syscalls(){
+  if(deferred_count == 0){
+    return 0;
+  }
+  if(send_syscall_batch(edge_call_data_ptr(), NULL, 0, NULL) != 0){
+    print_strace("[runtime] flushing %lu deferred syscalls failed\r\n",
+                 deferred_count);
+    return -1;
+  }
+  return 0;
+}
+#endif /* USE_DEFER_SYSCALL */
+
 uintptr_t dispatch_edgecall_syscall(struct edge_syscall* syscall_data_ptr, size_t data_len){
   int ret;
 
+#ifdef USE_DEFER_SYSCALL
+  if(deferred_count > 0){
+    return dispatch_edgecall_syscall_batched(syscall_data_ptr, data_len);
+  }
+#endif /* USE_DEFER_SYSCALL */
+
   // Syscall data should already be at the edge_call_data section
   /* For now we assume by convention that the start of the buffer is
    * the right place to put calls */
@@ -43,7 +237,7 @@ uintptr_t dispatch_edgecall_syscall(struct edge_syscall* syscall_data_ptr, size_
     return -1;
   }
 
-  ret = sbi_stop_enclave(STOP_EDGE_CALL_HOST);
+  ret = dispatch_edgecall_to_host(edge_call);
 
   if (ret != 0) {
     return -1;
@@ -75,6 +269,13 @@ uintptr_t dispatch_edgecall_ocall( unsigned long call_id,
    * the right place to put calls */
   struct edge_call* edge_call = (struct edge_call*)shared_buffer;
 
+#ifdef USE_DEFER_SYSCALL
+  /* the host side of the ocall may depend on them */
+  if(flush_deferred_syscalls() != 0){
+    goto ocall_error;
+  }
+#endif /* USE_DEFER_SYSCALL */
+
   /* We encode the call id, copy the argument data into the shared
    * region, calculate the offsets to the argument data, and then
    * dispatch the ocall to host */
@@ -82,7 +283,7 @@ uintptr_t dispatch_edgecall_ocall( unsigned long call_id,
   edge_call->call_id = call_id;
   uintptr_t buffer_data_start = edge_call_data_ptr();
 
-  if(data_len > (shared_buffer_size - (buffer_data_start - shared_buffer))){
+  if(data_len > edge_call_room(buffer_data_start)){
     goto ocall_error;
   }
   //TODO safety check on source
@@ -92,7 +293,7 @@ uintptr_t dispatch_edgecall_ocall( unsigned long call_id,
     goto ocall_error;
   }
 
-  ret = sbi_stop_enclave(STOP_EDGE_CALL_HOST);
+  ret = dispatch_edgecall_to_host(edge_call);
 
   if (ret != 0) {
     goto ocall_error;
@@ -143,8 +344,82 @@ uintptr_t handle_copy_from_shared(void* dst, uintptr_t offset, size_t size){
   return copy_to_user(dst, (void*)src_ptr, size);
 }
 
+/* part of the shared buffer used for edge calls, and what the eapp has
+ * mapped directly behind it */
+static uintptr_t edge_buffer_len;
+static uintptr_t utm_window_size;
+
+/* Calls that may be made while the front call is in use get slots at
+ * the end of the edge call part of the buffer */
+static void init_edge_slots(){
+#ifdef USE_ASYNC_IO
+  edge_call_slots_init(ASYNC_IO_CALL_SIZE, 1);
+#endif /* USE_ASYNC_IO */
+}
+
+/* Gives the eapp direct access to the last size bytes (page granular)
+ * of the shared buffer, so it can build edge call payloads in place and
+ * pass their offsets instead of having them copied. The window is taken
+ * away from edge calls for good. Returns the user VA of the window and
+ * stores its offset in the shared buffer in *offset. */
+
+uintptr_t handle_map_shared(size_t size, uintptr_t* offset){
+  uintptr_t start, i;
+
+  size = PAGE_UP(size);
+  if(utm_window_size || size == 0 ||
+     size + RISCV_PAGE_SIZE > edge_buffer_len){
+    return -1;
+  }
+
+  start = PAGE_DOWN((edge_buffer_len - size));
+  if(start < RISCV_PAGE_SIZE){
+    return -1;
+  }
+
+  for(i = 0; i < size; i += RISCV_PAGE_SIZE){
+    uintptr_t pa = translate(shared_buffer + start + i);
+    if(!pa || map_page(vpn(EYRIE_UTM_WINDOW_START + i), ppn(pa),
+                       PTE_R | PTE_W | PTE_U) != 1){
+      while(i > 0){
+        i -= RISCV_PAGE_SIZE;
+        *pte_of_va(EYRIE_UTM_WINDOW_START + i, 3) = 0;
+      }
+      tlb_flush();
+      return -1;
+    }
+  }
+  tlb_flush();
+
+  edge_buffer_len = start;
+  utm_window_size = size;
+  edge_call_init_internals(shared_buffer, edge_buffer_len);
+  init_edge_slots();
+
+  copy_to_user(offset, &start, sizeof(uintptr_t));
+  return EYRIE_UTM_WINDOW_START;
+}
+
 void init_edge_internals(){
-  edge_call_init_internals(shared_buffer, shared_buffer_size);
+  size_t len = shared_buffer_size;
+#ifdef USE_SWITCHLESS
+  /* the tail of the shared buffer is the switchless ring */
+  if(len > EDGE_SWITCHLESS_RESERVED + sizeof(struct edge_call)){
+    len -= EDGE_SWITCHLESS_RESERVED;
+    switchless_init((uintptr_t) edge_switchless_ring_ptr(shared_buffer,
+                                                         shared_buffer_size));
+  }
+#endif /* USE_SWITCHLESS */
+#ifdef USE_ASYNC_IO
+  /* and below it the async I/O area, if the buffer is big enough */
+  if(len > EDGE_ASYNC_RESERVED + sizeof(struct edge_call)){
+    len -= EDGE_ASYNC_RESERVED;
+    async_io_init(shared_buffer + len);
+  }
+#endif /* USE_ASYNC_IO */
+  edge_buffer_len = len;
+  edge_call_init_internals(shared_buffer, len);
+  init_edge_slots();
 }
 
 void handle_syscall(struct encl_ctx* ctx)
@@ -166,6 +441,12 @@ void handle_syscall(struct encl_ctx* ctx)
 
   switch (n) {
   case(RUNTIME_SYSCALL_EXIT):
+#ifdef USE_ASYNC_IO
+    async_io_drain();
+#endif /* USE_ASYNC_IO */
+#ifdef USE_DEFER_SYSCALL
+    flush_deferred_syscalls();
+#endif /* USE_DEFER_SYSCALL */
     sbi_exit_enclave(arg0);
     break;
   case(RUNTIME_SYSCALL_OCALL):
@@ -174,6 +455,20 @@ void handle_syscall(struct encl_ctx* ctx)
   case(RUNTIME_SYSCALL_SHAREDCOPY):
     ret = handle_copy_from_shared((void*)arg0, arg1, arg2);
     break;
+  case(RUNTIME_SYSCALL_MAP_SHARED):
+    ret = handle_map_shared((size_t)arg0, (uintptr_t*)arg1);
+    break;
+  case(RUNTIME_SYSCALL_SET_MAX_PAGE_SIZE):
+    ret = set_max_page_size(arg0);
+    break;
+#ifdef USE_ASYNC_IO
+  case(RUNTIME_SYSCALL_ASYNC_SUBMIT):
+    ret = async_io_submit(arg0, (int)arg1, (void*)arg2, (size_t)arg3, (int64_t)arg4);
+    break;
+  case(RUNTIME_SYSCALL_ASYNC_COMPLETE):
+    ret = async_io_complete((int64_t*)arg0, (int)arg1);
+    break;
+#endif /* USE_ASYNC_IO */
   case(RUNTIME_SYSCALL_ATTEST_ENCLAVE):;
     copy_from_user((void*)rt_copy_buffer_2, (void*)arg1, arg2);
 
@@ -259,6 +554,12 @@ void handle_syscall(struct encl_ctx* ctx)
   case(SYS_exit):
   case(SYS_exit_group):
     print_strace("[runtime] exit or exit_group (%lu)\r\n",n);
+#ifdef USE_ASYNC_IO
+    async_io_drain();
+#endif /* USE_ASYNC_IO */
+#ifdef USE_DEFER_SYSCALL
+    flush_deferred_syscalls();
+#endif /* USE_DEFER_SYSCALL */
     sbi_exit_enclave(arg0);
     break;
 #endif /* USE_LINUX_SYSCALL */
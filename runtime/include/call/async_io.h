@@ -0,0 +1,23 @@
+#ifndef __ASYNC_IO_H__
+#define __ASYNC_IO_H__
+
+#ifdef USE_ASYNC_IO
+
+#include <stdint.h>
+#include "edge_async.h"
+
+/* how long the runtime polls for a completion before it blocks on the host */
+#define ASYNC_IO_SPIN_CYCLES 200000
+
+/* size of the shared buffer slot async I/O calls are made from */
+#define ASYNC_IO_CALL_SIZE 256
+
+void async_io_init(uintptr_t area_va);
+uintptr_t async_io_submit(unsigned long op, int fd, void* buf, size_t len,
+                          int64_t offset);
+uintptr_t async_io_complete(int64_t* res, int wait);
+void async_io_drain(void);
+
+#endif /* USE_ASYNC_IO */
+
+#endif /* __ASYNC_IO_H__ */
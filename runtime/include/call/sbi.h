@@ -16,6 +16,8 @@ void
 sbi_set_timer(uint64_t stime_value);
 uintptr_t
 sbi_stop_enclave(uint64_t request);
+uintptr_t
+sbi_stop_enclave_edge_call(uintptr_t* dram_base);
 void
 sbi_exit_enclave(uint64_t retval);
 uintptr_t
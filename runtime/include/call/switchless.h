@@ -0,0 +1,16 @@
+#ifndef __SWITCHLESS_H__
+#define __SWITCHLESS_H__
+
+#ifdef USE_SWITCHLESS
+
+#include "edge_switchless.h"
+
+/* how long the runtime waits for a host worker before a real exit */
+#define SWITCHLESS_SPIN_CYCLES 200000
+
+void switchless_init(uintptr_t ring_va);
+int switchless_call(struct edge_call* edge_call);
+
+#endif /* USE_SWITCHLESS */
+
+#endif /* __SWITCHLESS_H__ */
@@ -14,8 +14,14 @@
 
 void handle_syscall(struct encl_ctx* ctx);
 void init_edge_internals(void);
+uintptr_t dispatch_edgecall_to_host(struct edge_call* edge_call);
 uintptr_t dispatch_edgecall_syscall(struct edge_syscall* syscall_data_ptr,
                                     size_t data_len);
+#ifdef USE_DEFER_SYSCALL
+uintptr_t dispatch_edgecall_syscall_deferred(struct edge_syscall* syscall_data_ptr,
+                                             size_t data_len);
+int flush_deferred_syscalls(void);
+#endif /* USE_DEFER_SYSCALL */
 
 // Define this to enable printing of a large amount of syscall information
 //#define USE_INTERNAL_STRACE 1
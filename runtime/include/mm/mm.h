@@ -19,22 +19,21 @@ uintptr_t alloc_page_generic(uintptr_t vpn, int flags, int page_table_levels);
 void free_page_generic(uintptr_t vpn, int page_table_levels);
 #define alloc_page(vpn, flags)      alloc_page_generic(vpn, flags, 3)
 #define free_page(vpn)              free_page_generic(vpn, 3)
-#ifdef MEGAPAGE_MAPPING     //for 2MiB megapages we need a 2-page-table hierarchy
-#define alloc_megapage(vpn, flags)  alloc_page_generic(vpn, flags, 2) 
-#define free_megapage(vpn)          free_page_generic(vpn, 2)
-#endif
-#ifdef GIGAPAGE_MAPPING     //for 1GiB megapages we need a 1-page-table hierarchy
-#define alloc_gigapage(vpn, flags)  alloc_page_generic(vpn, flags, 1) 
-#define free_gigapage(vpn)          free_page_generic(vpn, 1)
-#endif
 uintptr_t realloc_page(uintptr_t vpn, int flags);
-size_t alloc_pages(uintptr_t vpn, size_t count, int flags, bool is_largepage);
-void free_pages(uintptr_t vpn, size_t count, bool is_largepage);
+size_t alloc_pages(uintptr_t vpn, size_t count, int flags);
+void free_pages(uintptr_t vpn, size_t count);
+void promote_pages(uintptr_t vpn, size_t count);
+bool populate_page(uintptr_t vpn, uintptr_t lo, uintptr_t hi, int flags, bool large);
 size_t test_va_range(uintptr_t vpn, size_t count);
 
 uintptr_t get_program_break();
 void set_program_break(uintptr_t new_break);
 
+/* largest leaf used for anonymous memory, the size of a leaf at some
+ * level (4KiB, 2MiB or 1GiB on RV64) */
+uintptr_t get_max_page_size();
+uintptr_t set_max_page_size(uintptr_t size);
+
 void map_with_reserved_page_table(uintptr_t base, uintptr_t size, uintptr_t ptr, pte* l2_pt, pte* l3_pt);
 
 #endif /* _MM_H_ */
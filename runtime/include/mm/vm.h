@@ -27,21 +27,12 @@ extern uintptr_t program_break;
 extern uintptr_t freemem_va_start;
 extern size_t freemem_size;
 
-#if defined(MEGAPAGE_MAPPING)
-extern uintptr_t free_2m;
-extern uintptr_t freemem_va_start_2m;
-extern uintptr_t freemem_size_2m;
-#endif
-#if defined(GIGAPAGE_MAPPING)
-extern uintptr_t free_1g;
-extern uintptr_t freemem_va_start_1g;
-extern uintptr_t freemem_size_1g;
-#endif
-
 /* shared buffer */
 extern uintptr_t shared_buffer;
 extern uintptr_t shared_buffer_size;
 
+void vm_relocate(uintptr_t dram_base);
+
 #endif
 
 static inline pte pte_create(uintptr_t ppn, int type)
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "eyrie_layout.h"
+
 #define BIT(n) (1ul << (n))
 #define MASK(n) (BIT(n) - 1ul)
 #define IS_ALIGNED(n, b) (!((n)&MASK(b)))
@@ -29,7 +31,6 @@
 #define PAGE_UP(n) ROUND_UP(n, RISCV_PAGE_BITS)
 
 //Macros for implementing 2MiB MEGAPAGEs 
-//#define MEGAPAGE_MAPPING 1
 #define RISCV_MEGAPAGE_BITS 21
 #define RISCV_MEGAPAGE_SIZE (1 << RISCV_MEGAPAGE_BITS)
 #define RISCV_MEGAPAGE_OFFSET(addr) (addr % RISCV_MEGAPAGE_SIZE)
@@ -37,7 +38,6 @@
 #define MEGAPAGE_UP(n) ROUND_UP(n, RISCV_GET_LVL_PGSIZE_BITS(2))
 
 //Macros for implementing GIGAPEGS 
-#define GIGAPAGE_MAPPING 1
 #define RISCV_GIGAPAGE_BITS 30
 #define RISCV_GIGAPAGE_SIZE (1 << RISCV_GIGAPAGE_BITS)
 #define RISCV_GIGAPAGE_OFFSET(addr) (addr % RISCV_GIGAPAGE_SIZE)
@@ -51,28 +51,21 @@
 //#define EYRIE_LOAD_START 0xffffffff00000000
 #define EYRIE_PAGING_START 0xffffffff40000000
 #define EYRIE_UNTRUSTED_START 0xffffffff80000000
-//Set Start of Stack 1GiB below the starting address of Anonymous Mappings Area
-#define EYRIE_USER_STACK_START 0x0000001fc0000000 
 #define EYRIE_ANON_REGION_START \
   0x0000002000000000  // Arbitrary VA to start looking for large mappings
+// User VA where the eapp sees the UTM window (RUNTIME_SYSCALL_MAP_SHARED)
+#define EYRIE_UTM_WINDOW_START 0x0000001000000000
 #elif __riscv_xlen == 32
 #define RUNTIME_VA_START 0xc0000000 
 #define EYRIE_LOAD_START 0xf0000000
 #define EYRIE_PAGING_START 0x40000000
 #define EYRIE_UNTRUSTED_START 0x80000000
-#define EYRIE_USER_STACK_START 0x40000000
 #define EYRIE_ANON_REGION_START \
   0x20000000  // Arbitrary VA to start looking for large mappings
+#define EYRIE_UTM_WINDOW_START 0x38000000
 #endif
 
 #define EYRIE_ANON_REGION_END EYRIE_LOAD_START
-#if defined(MEGAPAGE_MAPPING)
-#define EYRIE_USER_STACK_SIZE 0x200000  // make it 2MiB-aligned
-#elif defined(GIGAPAGE_MAPPING)
-#define EYRIE_USER_STACK_SIZE 0x40000000  // make it 1GiB-aligned
-#else
-#define EYRIE_USER_STACK_SIZE 0x20000
-#endif
 #define EYRIE_USER_STACK_END (EYRIE_USER_STACK_START - EYRIE_USER_STACK_SIZE)
 
 #define PTE_V 0x001  // Valid
@@ -0,0 +1,56 @@
+#ifndef _VMA_H_
+#define _VMA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "util/regs.h"
+
+/* Regions of the eapp's address space whose memory is only allocated
+ * when it is first touched: anonymous mmaps, the heap and the stack.
+ * vma_handle_page_fault() maps zeroed pages into them on demand.
+ *
+ * The regions are kept in an array sorted by address, so lookups are
+ * binary searches, along with a max-tree of the free gaps between them
+ * inside [EYRIE_ANON_REGION_START, EYRIE_ANON_REGION_END) that
+ * vma_place() descends to find room for a new mapping. */
+
+#define VMA_MAX 64 /* a power of two */
+
+/* vma flags */
+#define VMA_GROWSDOWN 0x1 /* stack, extended by faults right below it */
+
+struct vma {
+  uintptr_t start;
+  uintptr_t end;
+  int pte_flags; /* of the pages mapped on faults */
+  int flags;
+};
+
+void vma_init(void);
+
+/* the region that holds va, 0 if there is none */
+struct vma* vma_find(uintptr_t va);
+/* the lowest region overlapping [start, end), 0 if there is none */
+struct vma* vma_overlap(uintptr_t start, uintptr_t end);
+/* the lowest start at or above from, aligned to 2^align_bits, where
+ * size bytes fit between regions in the anonymous mapping area
+ * returns 0 if there is no such place */
+uintptr_t vma_place(uintptr_t from, size_t size, unsigned int align_bits);
+/* record [start, end), merged with adjacent regions alike
+ * returns false if it overlaps a region or the table is full */
+bool vma_add(uintptr_t start, uintptr_t end, int pte_flags, int flags);
+/* whether a MAP_FIXED mapping may take [start, end): it may cover
+ * regions and unmapped pages, but not the stack's room to grow */
+bool vma_can_replace(uintptr_t start, uintptr_t end);
+/* forget [start, end), splitting regions that stick out of it
+ * returns false if the splits do not fit in the table */
+bool vma_remove(uintptr_t start, uintptr_t end);
+/* set the pte flags of the parts of regions within [start, end)
+ * returns false if the splits do not fit in the table */
+bool vma_protect(uintptr_t start, uintptr_t end, int pte_flags);
+
+void vma_handle_page_fault(struct encl_ctx* ctx);
+
+#endif /* _VMA_H_ */
@@ -5,10 +5,12 @@
 #ifndef _INTERRUPT_H_
 #define _INTERRUPT_H_
 
+#include <stdint.h>
+
 #define INTERRUPT_CAUSE_SOFTWARE  1
 #define INTERRUPT_CAUSE_TIMER     5
 #define INTERRUPT_CAUSE_EXTERNAL  9
 
-void init_timer(void);
+void init_timer(uintptr_t cycles);
 
 #endif
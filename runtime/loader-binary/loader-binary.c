@@ -4,6 +4,7 @@
 #include "mm/common.h"
 #include "mm/freemem.h"
 #include "util/printf.h"
+#include "eyrie_prelink.h"
 #include <asm/csr.h>
 
 /* root page table */
@@ -43,7 +44,71 @@ int map_untrusted_memory(uintptr_t untrusted_ptr, uintptr_t untrusted_size) {
   return 0;
 }
 
-int load_runtime(uintptr_t dummy,
+/* Installs the page tables of a prelinked image (eyrie_prelink.h): adds
+ * runtime_base to every entry they hold and copies the root entries into
+ * root_page_table_storage. The image is part of the measurement, so the
+ * checks only guard against a broken build. */
+int load_prelinked(struct eyrie_prelink* hdr, uintptr_t runtime_base,
+                   uintptr_t user_base, uintptr_t free_base) {
+  pte base = (pte) ppn(runtime_base) << PTE_PPN_SHIFT;
+  unsigned int i, j;
+
+  if (hdr->version != EYRIE_PRELINK_VERSION ||
+      hdr->n_relocs > EYRIE_PRELINK_MAX_RELOCS ||
+      runtime_base + hdr->user_offset != user_base ||
+      runtime_base + hdr->image_size != free_base ||
+      RISCV_PAGE_OFFSET(hdr->root_offset) ||
+      hdr->root_offset >= hdr->image_size) {
+    return -1;
+  }
+
+  message("[loader] Prelinked image: %u relocations\n", hdr->n_relocs);
+  for (i = 0; i < hdr->n_relocs; i++) {
+    struct eyrie_prelink_reloc* reloc = &hdr->relocs[i];
+    pte* entry = (pte*) (runtime_base + reloc->offset);
+
+    if (reloc->offset % sizeof(pte) ||
+        reloc->offset + reloc->count * sizeof(pte) > hdr->image_size) {
+      return -1;
+    }
+    for (j = 0; j < reloc->count; j++) {
+      entry[j] += base;
+    }
+  }
+
+  pte* root = (pte*) (runtime_base + hdr->root_offset);
+  for (i = 0; i < BIT(RISCV_PT_INDEX_BITS); i++) {
+    root_page_table_storage[i] = root[i];
+  }
+  return 0;
+}
+
+int load_runtime_elf(uintptr_t runtime_base, size_t runtime_size,
+                     uintptr_t dram_base, uintptr_t dram_size) {
+  int ret = 0;
+
+  // create runtime elf struct
+  elf_t runtime_elf;
+  ret = elf_newFile((void*) runtime_base, runtime_size, &runtime_elf);
+  if (ret != 0) {
+    return ret;
+  }
+  
+  message("[loader] Runtime elf loading starts (%zu B)\n", runtime_size);
+  message("[loader] FreeMem: 0x%p\n", dram_base + dram_size - spa_available() * RISCV_PAGE_SIZE);
+  
+  // map runtime memory
+  ret = loadElf(&runtime_elf, 0);
+  if (ret != 0) {
+    return ret;
+  }
+
+  message("[loader] Runtime elf loading ends.\n");
+  message("[loader] FreeMem: 0x%p\n", dram_base + dram_size - spa_available() * RISCV_PAGE_SIZE);
+  return 0;
+}
+
+int load_runtime(uintptr_t timeslice,
                 uintptr_t dram_base, uintptr_t dram_size, 
                 uintptr_t runtime_base, uintptr_t user_base, 
                 uintptr_t free_base, uintptr_t untrusted_ptr, 
@@ -67,25 +132,16 @@ int load_runtime(uintptr_t dummy,
     return -1; 
   }
 
-  // create runtime elf struct
-  elf_t runtime_elf;
-  ret = elf_newFile((void*) runtime_base, runtime_size, &runtime_elf);
-  if (ret != 0) {
-    return ret;
+  struct eyrie_prelink* prelink = (struct eyrie_prelink*) runtime_base;
+  if (prelink->magic == EYRIE_PRELINK_MAGIC) {
+    ret = load_prelinked(prelink, runtime_base, user_base, free_base);
+  } else {
+    ret = load_runtime_elf(runtime_base, runtime_size, dram_base, dram_size);
   }
-  
-  message("[loader] Runtime elf loading starts (%zu B)\n", runtime_size);
-  message("[loader] FreeMem: 0x%p\n", dram_base + dram_size - spa_available() * RISCV_PAGE_SIZE);
-  
-  // map runtime memory
-  ret = loadElf(&runtime_elf, 0);
   if (ret != 0) {
     return ret;
   }
 
-  message("[loader] Runtime elf loading ends.\n");
-  message("[loader] FreeMem: 0x%p\n", dram_base + dram_size - spa_available() * RISCV_PAGE_SIZE);
-  
   // map enclave physical memory, so that runtime will be able to access all memory
   map_physical_memory(dram_base, dram_size);
 
@@ -4,53 +4,117 @@
 #include "mm/freemem.h"
 #include "mm/paging.h"
 
-/* This file implements a simple page allocator (SPA)
- * which stores the pages based on a linked list.
- * Each of the element of linked list is stored in the header of each free page.
-
- * SPA does not use any additional data structure (e.g., linked list).
- * Instead, it uses the pages themselves to store the linked list pointer.
- * Thus, each of the free pages contains the pointer to the next free page
- * which can be dereferenced by NEXT_PAGE() macro.
- * spa_free_pages will only hold the head and the tail pages so that
- * SPA can allocate/free a page in constant time. */
-
-static struct pg_list spa_free_pages;
-#ifdef MEGAPAGE_MAPPING
-static struct pg_list spa_free_megapages;
-#endif 
-#ifdef GIGAPAGE_MAPPING
-static struct pg_list spa_free_gigapages;
-#endif 
-
-/* get a free page from the simple page allocator */
-uintptr_t
-__spa_get(bool zero, bool is_megapage)
+/* This file implements a simple page allocator (SPA) for all of freemem.
+ *
+ * SPA is a binary buddy allocator, so that physically contiguous runs of
+ * up to SPA_MAX_ORDER 4KB pages can be handed out. A free block of
+ * 2^order pages is linked into spa_free_blocks[order] through its first
+ * page (struct spa_block). Blocks are aligned to their size in physical
+ * memory, so an order RISCV_PT_INDEX_BITS block can back a megapage leaf
+ * and an order SPA_MAX_ORDER block a gigapage leaf; spa_relocate() lines
+ * them up again when a restore moves the EPM. spa_block_order holds
+ * one byte per page, order + 1 for the first page of a free block and 0
+ * otherwise; it lives in the first pages of the pool, which are never
+ * handed out nor taken as a buddy, and is all spa_put_block() needs to
+ * find and merge a free buddy.
+ *
+ * Pages that were never handed out are not linked: they sit above a
+ * watermark (spa_untouched) that moves up through freemem, and their
+ * bytes in spa_block_order are not valid yet. Blocks are only carved off
+ * the watermark when the free lists cannot serve a request, so
+ * initialization only clears spa_block_order itself. */
+
+struct spa_block
 {
-  uintptr_t free_page;
-  struct pg_list* list;
+  uintptr_t next;
+  uintptr_t prev;
+};
 
-#ifdef MEGAPAGE_MAPPING
-  if (is_megapage) {
-    list = &spa_free_megapages;
-  } else
-#endif
-#ifdef GIGAPAGE_MAPPING
-  if (is_megapage) {
-    list = &spa_free_gigapages;
-  } else
-#endif
-  {
-    list = &spa_free_pages;
+static uintptr_t spa_free_blocks[SPA_MAX_ORDER + 1];
+static unsigned char* spa_block_order;
+static uintptr_t spa_base;
+/* first page past spa_block_order */
+static uintptr_t spa_start;
+static uintptr_t spa_untouched;
+static uintptr_t spa_end;
+/* free pages, both linked and untouched */
+static unsigned long spa_free_count;
+
+#define SPA_BLOCK(page) ((struct spa_block*)(page))
+#define SPA_INDEX(page) (((page) - spa_base) >> RISCV_PAGE_BITS)
+#define SPA_BLOCK_SIZE(order) BIT((order) + RISCV_PAGE_BITS)
+
+static void
+__spa_link(uintptr_t page, unsigned int order)
+{
+  SPA_BLOCK(page)->prev = 0;
+  SPA_BLOCK(page)->next = spa_free_blocks[order];
+  if (spa_free_blocks[order])
+    SPA_BLOCK(spa_free_blocks[order])->prev = page;
+  spa_free_blocks[order] = page;
+  spa_block_order[SPA_INDEX(page)] = order + 1;
+}
+
+static void
+__spa_unlink(uintptr_t page, unsigned int order)
+{
+  struct spa_block* block = SPA_BLOCK(page);
+
+  if (block->prev)
+    SPA_BLOCK(block->prev)->next = block->next;
+  else
+    spa_free_blocks[order] = block->next;
+  if (block->next)
+    SPA_BLOCK(block->next)->prev = block->prev;
+  spa_block_order[SPA_INDEX(page)] = 0;
+}
+
+/* order of the largest aligned block at page that ends by end */
+static unsigned int
+__spa_fit(uintptr_t page, uintptr_t end)
+{
+  uintptr_t pa = __pa(page);
+  unsigned int order = 0;
+
+  while (order < SPA_MAX_ORDER &&
+         IS_ALIGNED(pa, order + 1 + RISCV_PAGE_BITS) &&
+         page + SPA_BLOCK_SIZE(order + 1) <= end)
+    order++;
+  return order;
+}
+
+/* move the largest aligned blocks off the watermark onto the free lists
+ * until one of at least the given order is there */
+static bool
+__spa_carve(unsigned int order)
+{
+  while (spa_untouched < spa_end) {
+    uintptr_t page = spa_untouched;
+    unsigned int max = __spa_fit(page, spa_end);
+
+    spa_untouched += SPA_BLOCK_SIZE(max);
+    __spa_link(page, max);
+    if (max >= order)
+      return true;
   }
+  return false;
+}
+
+static uintptr_t
+__spa_get_block(unsigned int order, bool zero)
+{
+  uintptr_t page;
+  unsigned int cur;
 
-  if (LIST_EMPTY(*list)) {
+  assert(order <= SPA_MAX_ORDER);
+
+  if (spa_free_count == 0) {
     /* try evict a page */
 #ifdef USE_PAGING
-    uintptr_t new_pa = paging_evict_and_free_one(0);
+    uintptr_t new_pa = order ? 0 : paging_evict_and_free_one(0);
     if(new_pa)
     {
-      spa_put(__va(new_pa), 1);
+      spa_put(__va(new_pa));
     }
     else
 #endif
@@ -60,158 +124,165 @@ __spa_get(bool zero, bool is_megapage)
     }
   }
 
-  free_page = list->head;
-  assert(free_page);
+  for (cur = order; cur <= SPA_MAX_ORDER && !spa_free_blocks[cur]; cur++)
+    ;
+  if (cur > SPA_MAX_ORDER) {
+    if (!__spa_carve(order))
+      return 0;
+    for (cur = order; !spa_free_blocks[cur]; cur++)
+      ;
+  }
 
-  /* update list head */
-  uintptr_t next = NEXT_PAGE(list->head);
-  list->head = next;
-  list->count--;
+  page = spa_free_blocks[cur];
+  __spa_unlink(page, cur);
 
-#ifdef MEGAPAGE_MAPPING
-  if (is_megapage) {
-    assert(free_page > EYRIE_LOAD_START && free_page < (freemem_va_start_2m  + freemem_size_2m));
-    if (zero)
-      memset((void*)free_page, 0, RISCV_MEGAPAGE_SIZE);
-  } else
-#endif
-#ifdef GIGAPAGE_MAPPING
-  if (is_megapage) {
-    assert(free_page > EYRIE_LOAD_START && free_page < (freemem_va_start_1g  + freemem_size_1g));
-    if (zero)
-      memset((void*)free_page, 0, RISCV_GIGAPAGE_SIZE);
-  } else
-#endif
-  {
-    assert(free_page > EYRIE_LOAD_START && free_page < (freemem_va_start + freemem_size));
-    if (zero)
-      memset((void*)free_page, 0, RISCV_PAGE_SIZE);
+  /* give back the upper halves until the block has the right size */
+  while (cur > order) {
+    cur--;
+    __spa_link(page + SPA_BLOCK_SIZE(cur), cur);
   }
 
-  return free_page;
-}
+  /* pages of an allocated block may be freed one by one */
+  memset(&spa_block_order[SPA_INDEX(page)], 0, BIT(order));
+  spa_free_count -= BIT(order);
 
-uintptr_t spa_get() { return __spa_get(false, 0); }
+  assert(page > EYRIE_LOAD_START && page < (freemem_va_start + freemem_size));
+  if (zero)
+    memset((void*)page, 0, SPA_BLOCK_SIZE(order));
 
-uintptr_t spa_get_zero() { 
-  return __spa_get(true, 0); 
+  return page;
 }
 
-#ifdef MEGAPAGE_MAPPING
-uintptr_t spa_get_megapage() { return __spa_get(false, 1); }
-
-uintptr_t spa_get_zero_megapage() {
- return  __spa_get(true, 1);
+uintptr_t spa_get_block(unsigned int order) {
+  return __spa_get_block(order, false);
 }
 
-unsigned long
-spa_megapages_available(){
-#ifndef USE_PAGING
-  return spa_free_megapages.count;
-#else
-  return spa_free_megapages.count + paging_remaining_pages();
-#endif
+uintptr_t spa_get_zero_block(unsigned int order) {
+  return __spa_get_block(order, true);
 }
-#endif
 
-#ifdef GIGAPAGE_MAPPING
-uintptr_t spa_get_gigapage() { return __spa_get(false, 1); }
+/* put a block of 2^order pages, or any aligned part of a block that
+ * spa_get_block() returned, back to the 4KB pool */
+void
+spa_put_block(uintptr_t page, unsigned int order)
+{
+  assert(order <= SPA_MAX_ORDER);
+  assert(page >= spa_start && page + SPA_BLOCK_SIZE(order) <= spa_untouched);
+
+  /* a block handed out before spa_relocate() may be out of line now */
+  if (!IS_ALIGNED(__pa(page), order + RISCV_PAGE_BITS)) {
+    spa_put_block(page, order - 1);
+    spa_put_block(page + SPA_BLOCK_SIZE(order - 1), order - 1);
+    return;
+  }
+
+  spa_free_count += BIT(order);
+
+  while (order < SPA_MAX_ORDER) {
+    uintptr_t pa = __pa(page);
+    uintptr_t buddy = page - pa + (pa ^ SPA_BLOCK_SIZE(order));
+
+    if (buddy < spa_start || buddy + SPA_BLOCK_SIZE(order) > spa_untouched ||
+        spa_block_order[SPA_INDEX(buddy)] != order + 1)
+      break;
+
+    __spa_unlink(buddy, order);
+    if (buddy < page)
+      page = buddy;
+    order++;
+  }
 
-uintptr_t spa_get_zero_gigapage() {
- return  __spa_get(true, 1);
+  __spa_link(page, order);
 }
 
-unsigned long
-spa_gigapages_available(){
-#ifndef USE_PAGING
-  return spa_free_gigapages.count;
-#else
-  return spa_free_gigapages.count + paging_remaining_pages();
-#endif
+uintptr_t spa_get() { return __spa_get_block(0, false); }
+
+uintptr_t spa_get_zero() { 
+  return __spa_get_block(0, true); 
 }
-#endif
 
 /* put a page to the simple page allocator */
 void
-spa_put(uintptr_t page_addr, bool is_4K_allocator)
+spa_put(uintptr_t page_addr)
 {
-  uintptr_t prev;
-  struct pg_list* list;
-
-#ifdef MEGAPAGE_MAPPING
-  if (!is_4K_allocator) {
-    assert(IS_ALIGNED(page_addr, RISCV_MEGAPAGE_BITS));
-    assert(page_addr >= EYRIE_LOAD_START && page_addr < (freemem_va_start_2m  + freemem_size_2m));
-    list = &spa_free_megapages;
-  } else
-#endif
-#ifdef GIGAPAGE_MAPPING
-  if (!is_4K_allocator) {
-    assert(IS_ALIGNED(page_addr, RISCV_GIGAPAGE_BITS));
-    assert(page_addr >= EYRIE_LOAD_START && page_addr < (freemem_va_start_1g  + freemem_size_1g));
-    list = &spa_free_gigapages;
-  } else
-#endif
-  {
-    assert(IS_ALIGNED(page_addr, RISCV_PAGE_BITS));
-    assert(page_addr >= EYRIE_LOAD_START && page_addr < (freemem_va_start  + freemem_size));
-    list = &spa_free_pages;
-  }
-
-  if (!LIST_EMPTY(*list)) {
-    prev = list->tail;
-    assert(prev);
-    NEXT_PAGE(prev) = page_addr;
-  } else {
-    list->head = page_addr;
-  }
-
-  NEXT_PAGE(page_addr) = 0;
-  list->tail = page_addr;
+  assert(page_addr >= EYRIE_LOAD_START && page_addr < (freemem_va_start  + freemem_size));
+  spa_put_block(page_addr, 0);
+}
 
-  list->count++;
-  return;
+/* whether page was (or can be) handed out by the simple page allocator */
+bool
+spa_contains(uintptr_t page)
+{
+  return page >= spa_start && page < spa_end;
 }
 
 unsigned long
 spa_available(){
 #ifndef USE_PAGING
-  return spa_free_pages.count;
+  return spa_free_count;
 #else
-  return spa_free_pages.count + paging_remaining_pages();
+  return spa_free_count + paging_remaining_pages();
 #endif
 }
 
 void
-spa_init_generic(uintptr_t base, size_t size, unsigned int page_bits)
+spa_init(uintptr_t base, size_t size)
 {
-  uintptr_t cur;
-  bool is_4K_allocator = true;
-
-#ifdef MEGAPAGE_MAPPING
-  if (page_bits == RISCV_MEGAPAGE_BITS) {
-    LIST_INIT(spa_free_megapages);
-    is_4K_allocator = false;
-  } else
-#endif
-#ifdef GIGAPAGE_MAPPING
-  if (page_bits == RISCV_GIGAPAGE_BITS) {
-    LIST_INIT(spa_free_gigapages);
-    is_4K_allocator = false;
-  } else
-#endif
-  {
-    LIST_INIT(spa_free_pages);
+  // both base and size must be page-aligned
+  assert(IS_ALIGNED(base, RISCV_PAGE_BITS));
+  assert(IS_ALIGNED(size, RISCV_PAGE_BITS));
+
+  /* spa_block_order takes the first pages of the pool, one byte per page */
+  size_t pages = size >> RISCV_PAGE_BITS;
+  size_t reserved =
+    PAGE_UP(pages * EYRIE_FREEMEM_META_PER_PAGE) >> RISCV_PAGE_BITS;
+
+  memset(spa_free_blocks, 0, sizeof(spa_free_blocks));
+  spa_block_order = (unsigned char*)base;
+  /* freemem comes from the host, so no byte can be trusted */
+  memset(spa_block_order, 0, pages);
+  spa_base = base;
+  spa_start = base + (reserved << RISCV_PAGE_BITS);
+  spa_untouched = spa_start;
+  spa_end = base + size;
+  spa_free_count = pages - reserved;
+}
+
+/* spa_block_order mark for a free page while spa_relocate() runs */
+#define SPA_RELOCATE_FREE 0xff
+
+/* The EPM moved, by a delta the free blocks need not be aligned to. Their
+ * pages are rebuilt into blocks that are aligned at the new PAs, the
+ * largest ones that fit in each run of free pages. Pages in use and the
+ * watermark stay as they are. */
+void
+spa_relocate(void)
+{
+  uintptr_t page, run, block;
+  unsigned int order;
+
+  for (order = 0; order <= SPA_MAX_ORDER; order++) {
+    for (block = spa_free_blocks[order]; block; block = SPA_BLOCK(block)->next)
+      memset(&spa_block_order[SPA_INDEX(block)], SPA_RELOCATE_FREE, BIT(order));
+    spa_free_blocks[order] = 0;
   }
 
-  // both base and size must be page-aligned
-  assert(IS_ALIGNED(base, page_bits));
-  assert(IS_ALIGNED(size, page_bits));
-
-  /* put all free pages in freemem (base) into spa_free_pages */
-  for(cur = base;
-      cur < base + size;
-      cur += BIT(page_bits)) {
-      spa_put(cur, is_4K_allocator);
+  page = spa_start;
+  while (page < spa_untouched) {
+    if (spa_block_order[SPA_INDEX(page)] != SPA_RELOCATE_FREE) {
+      page += RISCV_PAGE_SIZE;
+      continue;
+    }
+
+    for (run = page; run < spa_untouched &&
+         spa_block_order[SPA_INDEX(run)] == SPA_RELOCATE_FREE;
+         run += RISCV_PAGE_SIZE)
+      spa_block_order[SPA_INDEX(run)] = 0;
+
+    while (page < run) {
+      order = __spa_fit(page, run);
+      __spa_link(page, order);
+      page += SPA_BLOCK_SIZE(order);
+    }
   }
 }
@@ -6,7 +6,7 @@
 static uintptr_t freeBase;
 static uintptr_t freeEnd;
 
-void spa_init_generic(uintptr_t base, size_t size, unsigned int page_bits)
+void spa_init(uintptr_t base, size_t size)
 {
   freeBase = base;
   freeEnd = freeBase + size;
@@ -29,52 +29,33 @@ uintptr_t spa_get_zero()
   return new_page;
 }
 
-void spa_put(uintptr_t page, bool is_4K_allocator)
+void spa_put(uintptr_t page)
 {
   assert(false); // not implemented
 }
 
-unsigned long spa_available()
-{
-  return (freeEnd - freeBase) / RISCV_PAGE_SIZE;
-}
-
-#ifdef MEGAPAGE_MAPPING
-uintptr_t spa_get_megapage(void)
+uintptr_t spa_get_block(unsigned int order)
 {
-  assert(false); // not implemented for the loader
-  return 0;
+  return spa_get_zero_block(order);
 }
 
-uintptr_t spa_get_zero_megapage(void)
+uintptr_t spa_get_zero_block(unsigned int order)
 {
-  assert(false); // not implemented for the loader
-  return 0;
+  // the loader only hands out single pages
+  return order ? 0 : spa_get_zero();
 }
 
-unsigned long spa_megapages_available()
+void spa_put_block(uintptr_t page, unsigned int order)
 {
-  assert(false); // not implemented for the loader
-  return 0;
-}
-#endif
-
-#ifdef GIGAPAGE_MAPPING
-uintptr_t spa_get_gigapage(void)
-{
-  assert(false); // not implemented for the loader
-  return 0;
+  assert(false); // not implemented
 }
 
-uintptr_t spa_get_zero_gigapage(void)
+bool spa_contains(uintptr_t page)
 {
-  assert(false); // not implemented for the loader
-  return 0;
+  return false; // the loader never frees
 }
 
-unsigned long spa_gigapages_available()
+unsigned long spa_available()
 {
-  assert(false); // not implemented for the loader
-  return 0;
+  return (freeEnd - freeBase) / RISCV_PAGE_SIZE;
 }
-#endif
\ No newline at end of file
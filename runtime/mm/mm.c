@@ -8,9 +8,19 @@
 static pte*
 __walk_create(pte* root, uintptr_t addr, int page_table_levels);
 
+/* __walk_internal() flags */
+#define WALK_CREATE 1 /* allocate missing page tables */
+#define WALK_SPLIT  2 /* split larger leaves on the way */
+
+/* order of the SPA block behind a leaf at the given level */
+#define LEAF_ORDER(level) (RISCV_GET_LVL_PGSIZE_BITS(level) - RISCV_PAGE_BITS)
+
 /* Hacky storage of current u-mode break */
 static uintptr_t current_program_break;
 
+/* largest leaf alloc_pages() and promote_pages() may use */
+static uintptr_t max_page_size = RISCV_GET_LVL_PGSIZE(1);
+
 /* This is a function that walks the page table hierarchy, 
    prints PTEs if print_pt == true and also stores the 
    highest virtual memory address used in max_va pointer */
@@ -79,6 +89,27 @@ void set_program_break(uintptr_t new_break)
   current_program_break = new_break;
 }
 
+uintptr_t get_max_page_size()
+{
+  return max_page_size;
+}
+
+/* size must be the size of a leaf at some level
+ * returns the previous size, or -1 if size is not supported */
+uintptr_t set_max_page_size(uintptr_t size)
+{
+  uintptr_t prev = max_page_size;
+  int level;
+
+  for (level = 1; level <= RISCV_PT_LEVELS; level++) {
+    if (size == RISCV_GET_LVL_PGSIZE(level)) {
+      max_page_size = size;
+      return prev;
+    }
+  }
+  return -1;
+}
+
 static pte*
 __continue_walk_create(pte* root, uintptr_t addr, pte* pte, int page_table_levels)
 {
@@ -93,8 +124,26 @@ __continue_walk_create(pte* root, uintptr_t addr, pte* pte, int page_table_level
   return __walk_create(root, addr, page_table_levels);
 }
 
+/* replace a leaf at the given level by a page table that maps the same
+ * memory with leaves one level down */
+static void
+__split_leaf(pte* leaf, int level)
+{
+  uintptr_t table = spa_get_zero();
+  assert(table);
+
+  pte* entries = (pte*)table;
+  uintptr_t step = RISCV_GET_LVL_PGSIZE(level + 1) >> RISCV_PAGE_BITS;
+  for (uintptr_t i = 0; i < BIT(RISCV_PT_INDEX_BITS); i++) {
+    entries[i] = pte_create(pte_ppn(*leaf) + i * step, *leaf);
+  }
+
+  *leaf = ptd_create(ppn(__pa(table)));
+  message("[runtime] Split L%d leaf, new table at 0x%p\n", level, table);
+}
+
 static pte*
-__walk_internal(pte* root, uintptr_t addr, int create, int page_table_levels)
+__walk_internal(pte* root, uintptr_t addr, int flags, int page_table_levels)
 {
   pte* t = root;
   int i;
@@ -105,7 +154,14 @@ __walk_internal(pte* root, uintptr_t addr, int create, int page_table_levels)
     if (page_table_levels == 2)
       message("[runtime] Page Level: %d page table t = %p at index %zu\n", i, t, idx);
     if (!(t[idx] & PTE_V))
-      return create ? __continue_walk_create(root, addr, &t[idx], page_table_levels) : 0;
+      return (flags & WALK_CREATE) ? __continue_walk_create(root, addr, &t[idx], page_table_levels) : 0;
+
+    /* a larger leaf already maps addr */
+    if (t[idx] & (PTE_R | PTE_W | PTE_X)) {
+      if (!(flags & WALK_SPLIT))
+        return &t[idx];
+      __split_leaf(&t[idx], i);
+    }
 
     t = (pte*) __va(pte_ppn(t[idx]) << RISCV_PAGE_BITS);
     if (page_table_levels == 2)
@@ -116,19 +172,27 @@ __walk_internal(pte* root, uintptr_t addr, int create, int page_table_levels)
 }
 
 /* walk the page table and return PTE
- * return 0 if no mapping exists */
+ * return 0 if no mapping exists, or the larger leaf that maps addr */
 static pte*
 __walk(pte* root, uintptr_t addr, int page_table_levels)
 {
   return __walk_internal(root, addr, 0, page_table_levels);
 }
 
+/* walk the page table and return PTE
+ * split larger leaves down to the given level */
+static pte*
+__walk_split(pte* root, uintptr_t addr, int page_table_levels)
+{
+  return __walk_internal(root, addr, WALK_SPLIT, page_table_levels);
+}
+
 /* walk the page table and return PTE
  * create the mapping if non exists */
 static pte*
 __walk_create(pte* root, uintptr_t addr, int page_table_levels)
 {
-  return __walk_internal(root, addr, 1, page_table_levels);
+  return __walk_internal(root, addr, WALK_CREATE | WALK_SPLIT, page_table_levels);
 }
 
 /* Create a virtual memory mapping between a physical and virtual page */
@@ -164,32 +228,13 @@ alloc_page_generic(uintptr_t vpn, int flags, int page_table_levels)
   }
 
 	/* otherwise, allocate one from the freemem */
-#ifdef MEGAPAGE_MAPPING 
-  if (page_table_levels == 2) {
-    page = spa_get_zero_megapage();
-  } else
-#endif
-#ifdef GIGAPAGE_MAPPING 
-  if (page_table_levels == 1) {
-    page = spa_get_zero_gigapage();
-  } else
-#endif
-  {
-    page = spa_get_zero();
-  }
+  page = spa_get_zero_block(LEAF_ORDER(page_table_levels));
   assert(page);
 
   *pte = pte_create(ppn(__pa(page)), PTE_D | PTE_A | PTE_V | flags);
 
-#ifdef MEGAPAGE_MAPPING 
-  if (page_table_levels == 2)
+  if (page_table_levels != RISCV_PT_LEVELS)
     message("[runtime] New PTE: 0x%lx at 0x%p\n", *pte, pte);
-#endif
-
-#ifdef GIGAPAGE_MAPPING
-  if (page_table_levels == 1)
-    message("[runtime] New PTE: 0x%lx at 0x%p\n", *pte, pte);
-#endif
 
 #ifdef USE_PAGING
   paging_inc_user_page();
@@ -203,7 +248,7 @@ realloc_page(uintptr_t vpn, int flags)
 {
   assert(flags & PTE_U);
 
-  pte *pte = __walk(root_page_table, vpn << RISCV_PAGE_BITS, 3);
+  pte *pte = __walk_split(root_page_table, vpn << RISCV_PAGE_BITS, 3);
   if(!pte)
     return 0;
 
@@ -219,7 +264,7 @@ void
 free_page_generic(uintptr_t vpn, int page_table_levels)
 {
 
-  pte* pte = __walk(root_page_table, vpn << RISCV_PAGE_BITS, page_table_levels);
+  pte* pte = __walk_split(root_page_table, vpn << RISCV_PAGE_BITS, page_table_levels);
 
   // No such PTE, or invalid
   if(!pte || !(*pte & PTE_V))
@@ -237,91 +282,277 @@ free_page_generic(uintptr_t vpn, int page_table_levels)
 #ifdef USE_PAGING
   paging_dec_user_page();
 #endif
-  // Return phys page
-  if(page_table_levels == 3) {
-    memset((void* )free_va, 0, RISCV_PAGE_SIZE);
-    spa_put(free_va, true);   //put page back to the 4KB-SPA
-  } else if (page_table_levels == 2) {
-  #ifdef MEGAPAGE_MAPPING
-    memset((void* )free_va, 0, RISCV_MEGAPAGE_SIZE);
-    spa_put(free_va, false);  //put page back to the 2MB-SPA
-  #endif
-  } else {
-  #ifdef GIGAPAGE_MAPPING
-    memset((void* )free_va, 0, RISCV_GIGAPAGE_SIZE);
-    spa_put(free_va, false);  //put page back to the 1GB-SPA
-  #endif
+  // Return phys page, unless it is part of the eapp file
+  if (spa_contains(free_va)) {
+    memset((void* )free_va, 0, RISCV_GET_LVL_PGSIZE(page_table_levels));
+    spa_put_block(free_va, LEAF_ORDER(page_table_levels));
   }
   return;
 
 }
 
-/* allocate n new pages from a given vpn
+/* map a zeroed block with a single leaf at the given level, if nothing
+ * is mapped there yet
+ * returns the number of 4KB pages mapped */
+static size_t
+__alloc_leaf(uintptr_t vpn, int level, int flags)
+{
+#ifdef USE_PAGING
+  // paging evicts 4KB pages only
+  return 0;
+#else
+  pte* pte = __walk_create(root_page_table, vpn << RISCV_PAGE_BITS, level);
+  if (!pte || *pte)
+    return 0;
+
+  uintptr_t block = spa_get_zero_block(LEAF_ORDER(level));
+  if (!block)
+    return 0;
+
+  *pte = pte_create(ppn(__pa(block)), PTE_D | PTE_A | PTE_V | flags);
+  return BIT(LEAF_ORDER(level));
+#endif
+}
+
+/* map count 4KB pages at vpn from one physically contiguous block, or
+ * fewer if there is no block that large
+ * pages that are already mapped are kept, as in alloc_page()
+ * returns the number of pages done */
+static size_t
+__alloc_contiguous(uintptr_t vpn, size_t count, int flags)
+{
+  unsigned int order = 0;
+  uintptr_t block;
+  size_t i;
+
+  while (BIT(order + 1) <= count)
+    order++;
+  while (!(block = spa_get_block(order)) && order > 0)
+    order--;
+  if (!block)
+    return 0;
+
+  for (i = 0; i < BIT(order); i++) {
+    uintptr_t page = block + (i << RISCV_PAGE_BITS);
+    pte* pte = __walk_create(root_page_table, (vpn + i) << RISCV_PAGE_BITS, RISCV_PT_LEVELS);
+
+    if (!pte || (*pte & PTE_V)) {
+      spa_put_block(page, 0);
+      if (!pte)
+        break;
+      continue;
+    }
+
+    memset((void*)page, 0, RISCV_PAGE_SIZE);
+    *pte = pte_create(ppn(__pa(page)), PTE_D | PTE_A | PTE_V | flags);
+#ifdef USE_PAGING
+    paging_inc_user_page();
+#endif
+  }
+
+  /* hand back what a failed walk left unmapped */
+  for (size_t j = i + 1; j < BIT(order); j++)
+    spa_put_block(block + (j << RISCV_PAGE_BITS), 0);
+
+  return i;
+}
+
+/* allocate n new 4KB pages from a given vpn, with the largest leaves that
+ * max_page_size, the alignment of vpn and count allow
  * returns the number of pages allocated */
 size_t
-alloc_pages(uintptr_t vpn, size_t count, int flags, bool is_largepage)
+alloc_pages(uintptr_t vpn, size_t count, int flags)
 {
-  unsigned int i;
-  for (i = 0; i < count; i++) {
-    #ifdef MEGAPAGE_MAPPING
-      if(is_largepage){
-        if(!alloc_megapage(vpn + (i << RISCV_PT_INDEX_BITS), flags))
-        break;
-      } else
-    #endif
-    #ifdef GIGAPAGE_MAPPING
-      if(is_largepage){
-        if(!alloc_gigapage(vpn + (i << 2 * RISCV_PT_INDEX_BITS), flags))
-        break;
-      } else
-    #endif
-      {
-        if(!alloc_page(vpn + i, flags))
-        break;
-      }
+  size_t i = 0;
+
+  while (i < count) {
+    uintptr_t cur = vpn + i;
+    size_t left = count - i;
+    size_t done = 0;
+    int level;
+
+    for (level = 1; level < RISCV_PT_LEVELS && !done; level++) {
+      if (RISCV_GET_LVL_PGSIZE(level) > max_page_size ||
+          !IS_ALIGNED(cur, LEAF_ORDER(level)) || left < BIT(LEAF_ORDER(level)))
+        continue;
+      done = __alloc_leaf(cur, level, flags);
+    }
+
+    if (!done) {
+      /* stop where a megapage leaf could start */
+      size_t to_boundary = BIT(RISCV_PT_INDEX_BITS) - (cur & MASK(RISCV_PT_INDEX_BITS));
+      done = __alloc_contiguous(cur, left < to_boundary ? left : to_boundary, flags);
+    }
+
+    if (!done)
+      break;
+    i += done;
   }
 
   return i;
 }
 
+/* map zeroed memory at an unmapped vpn on a page fault. If large is set,
+ * use the largest leaf that max_page_size allows and that lies within
+ * [lo, hi), otherwise a 4KB page.
+ * returns false if vpn is mapped or memory has run out */
+bool
+populate_page(uintptr_t vpn, uintptr_t lo, uintptr_t hi, int flags, bool large)
+{
+  int level;
+
+  if (translate(vpn << RISCV_PAGE_BITS))
+    return false;
+
+  for (level = 1; level < RISCV_PT_LEVELS && large; level++) {
+    uintptr_t base = vpn & ~MASK(LEAF_ORDER(level));
+    if (RISCV_GET_LVL_PGSIZE(level) > max_page_size ||
+        base < lo || base + BIT(LEAF_ORDER(level)) > hi)
+      continue;
+    if (__alloc_leaf(base, level, flags))
+      return true;
+  }
+
+  /* the page and the tables on the way to it */
+  if (spa_available() < RISCV_PT_LEVELS)
+    return false;
+
+  return alloc_page(vpn, flags) != 0;
+}
+
+/* the leaf that maps va and its level, 0 if there is none */
+static pte*
+__walk_leaf(uintptr_t va, int* level)
+{
+  pte* t = root_page_table;
+
+  for (*level = 1; *level <= RISCV_PT_LEVELS; (*level)++) {
+    pte* entry = &t[RISCV_GET_PT_INDEX(va, *level)];
+    if (!(*entry & PTE_V))
+      return 0;
+    if (*entry & (PTE_R | PTE_W | PTE_X))
+      return entry;
+    t = (pte*)__va(pte_ppn(*entry) << RISCV_PAGE_BITS);
+  }
+  return 0;
+}
+
 //free_pages is called by syscall munmap()
 void
-free_pages(uintptr_t vpn, size_t count, bool is_largepage){
-  unsigned int i;
-  for (i = 0; i < count; i++) {
-#ifdef MEGAPAGE_MAPPING
-    if (is_largepage) {
-      free_megapage(vpn + (i << RISCV_PT_INDEX_BITS));
-    } else
-#endif
-#ifdef GIGAPAGE_MAPPING
-    if (is_largepage) {
-      free_gigapage(vpn + (i << 2 * RISCV_PT_INDEX_BITS));
-    } else
-#endif
-    {
+free_pages(uintptr_t vpn, size_t count){
+  size_t i = 0;
+
+  while (i < count) {
+    int level;
+    pte* leaf = __walk_leaf((vpn + i) << RISCV_PAGE_BITS, &level);
+
+    /* leaves that lie within the range go in one piece, others are
+     * split by free_page() */
+    if (leaf && level < RISCV_PT_LEVELS &&
+        IS_ALIGNED(vpn + i, LEAF_ORDER(level)) &&
+        count - i >= BIT(LEAF_ORDER(level))) {
+      free_page_generic(vpn + i, level);
+      i += BIT(LEAF_ORDER(level));
+    } else {
       free_page(vpn + i);
+      i++;
     }
   }
 
-  // Check if the page table can be freed. Of course, don't check for it in
-  // case of 1 GiB mappings where only root page table is being populated.
-#ifndef GIGAPAGE_MAPPING
+  // Check if the page table can be freed. Of course, don't check for it
+  // if the root page table entry is itself a 1 GiB mapping.
   uintptr_t start_vaddr = vpn << RISCV_PAGE_BITS;
   pte* root_page_table_pte = pte_of_va(start_vaddr, 1);   //level of root page table = 1
+  if (!(*root_page_table_pte & PTE_V) ||
+      (*root_page_table_pte & (PTE_R | PTE_W | PTE_X)))
+    return;
   uintptr_t page_table_pa = pte_ppn(*root_page_table_pte) << RISCV_PAGE_BITS;
   pte* page_table_va = (pte*)__va(page_table_pa);
   // search for any valid PTEs in the page table
   bool is_empty = is_page_table_empty(page_table_va, 2);  //level of page table = 2  
-  if (is_empty) {
+  if (is_empty && spa_contains((uintptr_t) page_table_va)) {
     // If the page tabel is empty -> Mark page invalid and zero it out
     *root_page_table_pte = 0;
     memset((void* )page_table_va, 0, RISCV_PAGE_SIZE);
-    spa_put((uintptr_t) page_table_va, true);   //put page back to the 4KB-SPA
+    spa_put((uintptr_t) page_table_va);   //put page back to the SPA
+  }
+}
+
+/* Replace the table under entry, at the given level, by a single leaf
+ * when every entry of the table is a user leaf backed by the SPA with the
+ * same permissions. The memory is copied into one new block. */
+static bool
+__promote(pte* entry, int level)
+{
+#ifdef USE_PAGING
+  // paging evicts 4KB pages only
+  return false;
+#else
+  int perm = -1;
+  uintptr_t i;
+
+  if (!(*entry & PTE_V) || (*entry & (PTE_R | PTE_W | PTE_X)))
+    return false;
+
+  pte* table = (pte*)__va(pte_ppn(*entry) << RISCV_PAGE_BITS);
+  uintptr_t child_size = RISCV_GET_LVL_PGSIZE(level + 1);
+
+  for (i = 0; i < BIT(RISCV_PT_INDEX_BITS); i++) {
+    pte child = table[i];
+    int child_perm = child & (PTE_R | PTE_W | PTE_X | PTE_U);
+
+    if (!(child & PTE_V) || !(child & (PTE_R | PTE_W | PTE_X)) ||
+        !(child & PTE_U) || (perm >= 0 && child_perm != perm) ||
+        !spa_contains(__va(pte_ppn(child) << RISCV_PAGE_BITS)))
+      return false;
+    perm = child_perm;
   }
+
+  uintptr_t block = spa_get_block(LEAF_ORDER(level));
+  if (!block)
+    return false;
+
+  for (i = 0; i < BIT(RISCV_PT_INDEX_BITS); i++) {
+    uintptr_t child = __va(pte_ppn(table[i]) << RISCV_PAGE_BITS);
+    memcpy((void*)(block + i * child_size), (void*)child, child_size);
+    memset((void*)child, 0, child_size);
+    spa_put_block(child, LEAF_ORDER(level + 1));
+  }
+
+  *entry = pte_create(ppn(__pa(block)), PTE_D | PTE_A | PTE_V | perm);
+
+  if (spa_contains((uintptr_t)table)) {
+    memset((void*)table, 0, RISCV_PAGE_SIZE);
+    spa_put((uintptr_t)table);
+  }
+  message("[runtime] Promoted L%d table to a leaf at 0x%p\n", level, block);
+  return true;
 #endif
 }
 
+/* Collapse fully mapped, aligned parts of [vpn, vpn + count) into
+ * larger leaves, up to max_page_size. Megapages go first so that a
+ * gigapage can then be made of them. The caller flushes the TLB. */
+void
+promote_pages(uintptr_t vpn, size_t count)
+{
+  int level;
+
+  for (level = RISCV_PT_LEVELS - 1; level >= 1; level--) {
+    unsigned int order = LEAF_ORDER(level);
+    uintptr_t cur;
+
+    if (RISCV_GET_LVL_PGSIZE(level) > max_page_size)
+      continue;
+
+    for (cur = vpn & ~MASK(order); cur < vpn + count; cur += BIT(order)) {
+      pte* entry = __walk(root_page_table, cur << RISCV_PAGE_BITS, level);
+      if (entry)
+        __promote(entry, level);
+    }
+  }
+}
+
 /*
  * Check if a range of VAs contains any allocated pages, starting with
  * the given VA. Returns the number of sequential pages that meet the
@@ -346,12 +577,22 @@ test_va_range(uintptr_t vpn, size_t count){
 uintptr_t
 translate(uintptr_t va)
 {
-  pte* pte = __walk(root_page_table, va, 3);
+  pte* t = root_page_table;
+  int level;
 
-  if(pte && (*pte & PTE_V))
-    return (pte_ppn(*pte) << RISCV_PAGE_BITS) | (RISCV_PAGE_OFFSET(va));
-  else
-    return 0;
+  for (level = 1; level <= RISCV_PT_LEVELS; level++) {
+    pte entry = t[RISCV_GET_PT_INDEX(va, level)];
+    if (!(entry & PTE_V))
+      return 0;
+
+    /* leaves may sit at any level */
+    if (entry & (PTE_R | PTE_W | PTE_X))
+      return (pte_ppn(entry) << RISCV_PAGE_BITS) |
+             (va & (RISCV_GET_LVL_PGSIZE(level) - 1));
+
+    t = (pte*)__va(pte_ppn(entry) << RISCV_PAGE_BITS);
+  }
+  return 0;
 }
 
 /* try to retrieve PTE for a VA, return 0 if fail */
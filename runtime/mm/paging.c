@@ -4,6 +4,7 @@
 
 #include "mm/page_swap.h"
 #include "mm/vm.h"
+#include "mm/vma.h"
 
 uintptr_t paging_pa_start;
 
@@ -231,9 +232,11 @@ void paging_handle_page_fault(struct encl_ctx* ctx)
 
   entry = pte_of_va(addr);
 
-  /* VA is never mapped, exit */
-  if (!entry)
-    goto exit;
+  /* VA is never mapped, it may be due for demand allocation */
+  if (!entry || !*entry) {
+    vma_handle_page_fault(ctx);
+    return;
+  }
 
   /* if PTE is already valid, it means something went wrong */
   if (*entry & PTE_V)
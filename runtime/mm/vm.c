@@ -1,6 +1,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include "mm/vm.h"
+#include "mm/freemem.h"
 
 uintptr_t runtime_va_start;
 
@@ -50,19 +51,6 @@ uintptr_t program_break;
 uintptr_t freemem_va_start;
 size_t freemem_size;
 
-#ifdef MEGAPAGE_MAPPING
-uintptr_t free_2m;
-uintptr_t freemem_va_start_2m;
-uintptr_t freemem_size_2m;
-#endif
-
-#ifdef GIGAPAGE_MAPPING
-uintptr_t free_1g;
-uintptr_t freemem_va_start_1g;
-uintptr_t freemem_size_1g;
-#endif
-
-
 /* shared buffer */
 uintptr_t shared_buffer;
 uintptr_t shared_buffer_size;
@@ -70,6 +58,19 @@ uintptr_t shared_buffer_size;
 uintptr_t kernel_offset;
 uintptr_t load_pa_start;
 
+/* Restored from a checkpoint into an EPM at dram_base. The SM has moved
+ * the page tables; VAs stay the same and the PAs behind them shift, so
+ * freemem's blocks have to be lined up with the new PAs. */
+void vm_relocate(uintptr_t dram_base)
+{
+  uintptr_t delta = dram_base - load_pa_start;
+
+  load_pa_start += delta;
+  kernel_offset -= delta;
+  if (delta)
+    spa_relocate();
+}
+
 #endif // LOADER_BIN
 
 
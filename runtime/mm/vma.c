@@ -0,0 +1,366 @@
+#include "mm/vma.h"
+
+#include "mm/common.h"
+#include "mm/mm.h"
+#include "mm/vm.h"
+#include "util/rt_util.h"
+
+/* sorted by start, never overlapping */
+static struct vma vmas[VMA_MAX];
+static size_t vma_count;
+
+/* Gap i lies below vmas[i], or above the last region for i ==
+ * vma_count, clipped to the anonymous mapping area. The leaves of the
+ * tree start at GAP_LEAVES; every inner node holds the largest gap
+ * among its leaves. */
+#define GAP_LEAVES (2 * VMA_MAX)
+#define NO_GAP     ((size_t)-1)
+static uintptr_t gap_tree[2 * GAP_LEAVES];
+
+static uintptr_t
+__gap_start(size_t i)
+{
+  uintptr_t start = i ? vmas[i - 1].end : 0;
+  return start > EYRIE_ANON_REGION_START ? start : EYRIE_ANON_REGION_START;
+}
+
+static uintptr_t
+__gap_end(size_t i)
+{
+  uintptr_t end = i < vma_count ? vmas[i].start : EYRIE_ANON_REGION_END;
+  return end < EYRIE_ANON_REGION_END ? end : EYRIE_ANON_REGION_END;
+}
+
+static uintptr_t
+__gap_size(size_t i)
+{
+  if (i > vma_count || __gap_end(i) <= __gap_start(i))
+    return 0;
+  return __gap_end(i) - __gap_start(i);
+}
+
+/* refresh the gaps [lo, hi] and the nodes above them, after the regions
+ * around them changed or moved in the array */
+static void
+__gaps_update(size_t lo, size_t hi)
+{
+  size_t i;
+
+  for (i = lo; i <= hi; i++)
+    gap_tree[GAP_LEAVES + i] = __gap_size(i);
+
+  for (lo = (GAP_LEAVES + lo) / 2, hi = (GAP_LEAVES + hi) / 2; lo > 0;
+       lo /= 2, hi /= 2) {
+    for (i = lo; i <= hi; i++) {
+      uintptr_t left = gap_tree[2 * i], right = gap_tree[2 * i + 1];
+      gap_tree[i] = left > right ? left : right;
+    }
+  }
+}
+
+/* after the regions from index i on changed, while the array went from
+ * count regions to vma_count: the gaps above the last region move too */
+static void
+__gaps_shifted(size_t i, size_t count)
+{
+  __gaps_update(i, count > vma_count ? count : vma_count);
+}
+
+/* the lowest gap at or above from that is at least size long, looking
+ * at the leaves [lo, hi) under node */
+static size_t
+__gap_search(size_t node, size_t lo, size_t hi, size_t from, uintptr_t size)
+{
+  if (hi <= from || gap_tree[node] < size)
+    return NO_GAP;
+  if (hi - lo == 1)
+    return lo;
+
+  size_t mid = (lo + hi) / 2;
+  size_t i = __gap_search(2 * node, lo, mid, from, size);
+  if (i != NO_GAP)
+    return i;
+  return __gap_search(2 * node + 1, mid, hi, from, size);
+}
+
+/* index of the first region that ends above va */
+static size_t
+__vma_index(uintptr_t va)
+{
+  size_t lo = 0, hi = vma_count;
+
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (vmas[mid].end > va)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo;
+}
+
+/* open a slot at index i */
+static void
+__vma_insert_at(size_t i)
+{
+  size_t j;
+  for (j = vma_count; j > i; j--)
+    vmas[j] = vmas[j - 1];
+  vma_count++;
+}
+
+/* close the slots [i, i + n) */
+static void
+__vma_delete_at(size_t i, size_t n)
+{
+  size_t j;
+  for (j = i; j + n < vma_count; j++)
+    vmas[j] = vmas[j + n];
+  vma_count -= n;
+}
+
+static bool
+__vma_alike(struct vma* a, struct vma* b)
+{
+  return a->pte_flags == b->pte_flags && a->flags == b->flags;
+}
+
+/* merge regions i and i + 1 if they touch and are alike */
+static void
+__vma_merge(size_t i)
+{
+  if (i + 1 >= vma_count || vmas[i].end != vmas[i + 1].start ||
+      !__vma_alike(&vmas[i], &vmas[i + 1]))
+    return;
+  vmas[i].end = vmas[i + 1].end;
+  __vma_delete_at(i + 1, 1);
+}
+
+/* whether va lies inside a region, past its start */
+static bool
+__vma_inside(uintptr_t va)
+{
+  struct vma* vma = vma_find(va);
+  return vma && vma->start < va;
+}
+
+/* cut the region that holds va in two at va */
+static void
+__vma_split(uintptr_t va)
+{
+  size_t i;
+
+  if (!__vma_inside(va))
+    return;
+  i = __vma_index(va);
+  __vma_insert_at(i);
+  vmas[i].end       = va;
+  vmas[i + 1].start = va;
+}
+
+/* split regions at start and end, if there is room for that
+ * returns the range of indices of the regions within [start, end) */
+static bool
+__vma_isolate(uintptr_t start, uintptr_t end, size_t* first, size_t* last)
+{
+  if (vma_count + __vma_inside(start) + __vma_inside(end) > VMA_MAX)
+    return false;
+
+  __vma_split(start);
+  __vma_split(end);
+  *first = __vma_index(start);
+  *last  = __vma_index(end);
+  return true;
+}
+
+struct vma*
+vma_find(uintptr_t va)
+{
+  return vma_overlap(va, va + 1);
+}
+
+struct vma*
+vma_overlap(uintptr_t start, uintptr_t end)
+{
+  size_t i = __vma_index(start);
+  if (i < vma_count && vmas[i].start < end)
+    return &vmas[i];
+  return 0;
+}
+
+uintptr_t
+vma_place(uintptr_t from, size_t size, unsigned int align_bits)
+{
+  size_t i = __vma_index(from);
+
+  if (!size)
+    return 0;
+
+  /* a gap may still be too short once clipped to from and aligned */
+  while ((i = __gap_search(1, 0, GAP_LEAVES, i, size)) != NO_GAP) {
+    uintptr_t start = __gap_start(i) > from ? __gap_start(i) : from;
+    start = ROUND_UP(start, align_bits);
+    if (start <= __gap_end(i) && __gap_end(i) - start >= size)
+      return start;
+    i++;
+  }
+  return 0;
+}
+
+bool
+vma_add(uintptr_t start, uintptr_t end, int pte_flags, int flags)
+{
+  size_t i, count = vma_count;
+
+  if (start >= end || vma_count == VMA_MAX || vma_overlap(start, end))
+    return false;
+
+  i = __vma_index(start);
+  __vma_insert_at(i);
+  vmas[i].start     = start;
+  vmas[i].end       = end;
+  vmas[i].pte_flags = pte_flags;
+  vmas[i].flags     = flags;
+
+  __vma_merge(i);
+  if (i > 0)
+    __vma_merge(i - 1);
+  __gaps_shifted(i, count);
+  return true;
+}
+
+bool
+vma_can_replace(uintptr_t start, uintptr_t end)
+{
+  struct vma* vma;
+  uintptr_t va = start, gap_end;
+
+  /* the stack's room to grow stays its own */
+  if (start < EYRIE_USER_STACK_START &&
+      end > EYRIE_USER_STACK_START - EYRIE_USER_STACK_MAX)
+    return false;
+
+  /* pages mapped outside of any region, like the eapp's image or the
+   * UTM window, were not mapped by mmap() and can't be replaced */
+  while (va < end) {
+    vma = vma_overlap(va, end);
+    gap_end = vma ? vma->start : end;
+    if (gap_end > va &&
+        test_va_range(vpn(va), vpn(gap_end - va)) != vpn(gap_end - va))
+      return false;
+    if (!vma)
+      break;
+    va = vma->end;
+  }
+  return true;
+}
+
+bool
+vma_remove(uintptr_t start, uintptr_t end)
+{
+  size_t first, last, i = __vma_index(start), count = vma_count;
+
+  if (start >= end)
+    return true;
+  if (!__vma_isolate(start, end, &first, &last))
+    return false;
+
+  __vma_delete_at(first, last - first);
+  __gaps_shifted(i, count);
+  return true;
+}
+
+bool
+vma_protect(uintptr_t start, uintptr_t end, int pte_flags)
+{
+  size_t first, last, i, lo = __vma_index(start), count = vma_count;
+
+  if (start >= end)
+    return true;
+  if (!__vma_isolate(start, end, &first, &last))
+    return false;
+
+  for (i = first; i < last; i++)
+    vmas[i].pte_flags = pte_flags;
+
+  /* from the top down, a merge only moves the regions above it */
+  for (i = last; i >= first && i > 0; i--)
+    __vma_merge(i - 1);
+  __gaps_shifted(lo, count);
+  return true;
+}
+
+/* a stack that va is right below, extended down to va's page as long as
+ * it stays within EYRIE_USER_STACK_MAX and an unmapped guard page stays
+ * between it and the mapping below, so that an overflow faults */
+static struct vma*
+__vma_grow(uintptr_t va)
+{
+  size_t i = __vma_index(va);
+
+  va = PAGE_DOWN(va);
+  if (i == vma_count || !(vmas[i].flags & VMA_GROWSDOWN) ||
+      va < EYRIE_USER_STACK_START - EYRIE_USER_STACK_MAX ||
+      (i > 0 && vmas[i - 1].end + RISCV_PAGE_SIZE > va))
+    return 0;
+
+  size_t count = vpn(vmas[i].start - va);
+  if (test_va_range(vpn(va), count) != count)
+    return 0;
+
+  vmas[i].start = va;
+  __gaps_update(i, i);
+  return &vmas[i];
+}
+
+static bool
+__vma_allows(struct vma* vma, uintptr_t cause)
+{
+  switch (cause) {
+    case RISCV_EXCP_INST_PAGE_FAULT:
+      return vma->pte_flags & PTE_X;
+    case RISCV_EXCP_LOAD_PAGE_FAULT:
+      return vma->pte_flags & PTE_R;
+    case RISCV_EXCP_STORE_PAGE_FAULT:
+      return vma->pte_flags & PTE_W;
+    default:
+      return false;
+  }
+}
+
+/* First touch of a page in a region. Stacks get 4KB pages; the heap and
+ * mmaps get the largest leaf that fits in the region, and windows that
+ * become fully populated are promoted to larger leaves. Any other fault
+ * is fatal. */
+void
+vma_handle_page_fault(struct encl_ctx* ctx)
+{
+  uintptr_t va = ctx->sbadaddr;
+  struct vma* vma = vma_find(va);
+
+  if (!vma)
+    vma = __vma_grow(va);
+  if (!vma || !__vma_allows(vma, ctx->scause))
+    goto fatal;
+
+  bool large = !(vma->flags & VMA_GROWSDOWN);
+  if (!populate_page(vpn(va), vpn(vma->start), vpn(vma->end),
+                     vma->pte_flags, large))
+    goto fatal;
+
+  if (large)
+    promote_pages(vpn(va), 1);
+
+  tlb_flush();
+  return;
+
+fatal:
+  rt_page_fault(ctx);
+}
+
+void
+vma_init(void)
+{
+  vma_count = 0;
+  __gaps_update(0, GAP_LEAVES - 1);
+}
@@ -1,5 +1,6 @@
 #include "sys/env.h"
 #include "sys/auxvec.h"
+#include "mm/vm_defs.h"
 #include "uaccess.h"
 #include "util/rt_util.h"
 #include "util/string.h"
@@ -29,6 +30,10 @@
 // Size in number-of-words (argc, argv, null_env, auxv, randombytes
 #define SIZE_OF_SETUP (1+1+1+(2*AUXV_COUNT) + 2)
 
+_Static_assert(SIZE_OF_SETUP * sizeof(void*) <=
+               EYRIE_USER_STACK_BOOT_PAGES * RISCV_PAGE_SIZE,
+               "the host sizes the EPM for the stack pages set up here");
+
 // We return the new sp
 void* setup_start(void* _sp, ELF(Ehdr) *hdr) {
   // Staging for eventual stack data
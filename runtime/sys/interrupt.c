@@ -9,11 +9,16 @@
 #include "util/printf.h"
 #include <asm/csr.h>
 
-#define DEFAULT_CLOCK_DELAY 10000
+/* timer period in cycles, as requested by the host at creation.
+ * 0 means tickless: the runtime never arms its own timer and only
+ * leaves the enclave on edge calls (or when the host's timer fires) */
+static uintptr_t timer_cycles;
 
-void init_timer(void)
+void init_timer(uintptr_t cycles)
 {
-  sbi_set_timer(get_cycles64() + DEFAULT_CLOCK_DELAY);
+  timer_cycles = cycles;
+  if (timer_cycles)
+    sbi_set_timer(get_cycles64() + timer_cycles);
   csr_set(sstatus, SR_SPIE);
   csr_set(sie, SIE_STIE | SIE_SSIE);
 }
@@ -21,8 +26,10 @@ void init_timer(void)
 void handle_timer_interrupt()
 {
   sbi_stop_enclave(0);
-  unsigned long next_cycle = get_cycles64() + DEFAULT_CLOCK_DELAY;
-  sbi_set_timer(next_cycle);
+  if (timer_cycles) {
+    unsigned long next_cycle = get_cycles64() + timer_cycles;
+    sbi_set_timer(next_cycle);
+  }
   csr_set(sstatus, SR_SPIE);
   return;
 }
@@ -0,0 +1,230 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+
+#include "mm/vm_defs.h"
+
+/* the pool is plain host memory, far below the enclave's load address */
+#undef EYRIE_LOAD_START
+#define EYRIE_LOAD_START 0ul
+
+#include "../mm/freemem.c"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "mock.h"
+
+void
+sbi_exit_enclave(uint64_t code) {
+  exit(code);
+}
+
+uintptr_t freemem_va_start;
+size_t freemem_size;
+
+/* the pool sits at POOL_PA, so blocks are aligned like in an enclave,
+ * until a test moves it */
+#define POOL_PA    0x80000000ul
+#define POOL_PAGES 1024
+#define POOL_SIZE  (POOL_PAGES * RISCV_PAGE_SIZE)
+
+static uintptr_t pool_pa;
+
+uintptr_t
+__pa(uintptr_t va) {
+  return va - freemem_va_start + pool_pa;
+}
+
+uintptr_t
+__va(uintptr_t pa) {
+  return pa - pool_pa + freemem_va_start;
+}
+
+static void
+pool_init(int garbage) {
+  if (!freemem_va_start) {
+    void* pool = mmap(
+        NULL, POOL_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+        -1, 0);
+    assert_int_not_equal(pool, MAP_FAILED);
+    freemem_va_start = (uintptr_t)pool;
+    freemem_size     = POOL_SIZE;
+  }
+  pool_pa = POOL_PA;
+  /* whatever the host left in freemem */
+  memset((void*)freemem_va_start, garbage, POOL_SIZE);
+  spa_init(freemem_va_start, freemem_size);
+}
+
+static uintptr_t
+pool_page(size_t index) {
+  return freemem_va_start + index * RISCV_PAGE_SIZE;
+}
+
+void
+test_init_clears_order() {
+  size_t i;
+
+  pool_init(0xff);
+
+  /* one metadata page for 1024 pages */
+  assert_int_equal(spa_available(), POOL_PAGES - 1);
+  assert_false(spa_contains(pool_page(0)));
+  assert_true(spa_contains(pool_page(1)));
+  assert_false(spa_contains(pool_page(POOL_PAGES)));
+  for (i = 0; i < POOL_PAGES; i++) assert_int_equal(spa_block_order[i], 0);
+}
+
+void
+test_split_and_merge() {
+  uintptr_t block, page;
+  size_t i;
+
+  pool_init(0);
+
+  /* carves orders 0, 1, 2, ..., 9 from page 1 up */
+  block = spa_get_block(9);
+  assert_int_equal(block, pool_page(512));
+  assert_int_equal(spa_available(), POOL_PAGES - 1 - 512);
+  spa_put_block(block, 9);
+  assert_int_equal(spa_available(), POOL_PAGES - 1);
+
+  block = spa_get_block(3);
+  assert_int_equal(block, pool_page(8));
+
+  /* the next one splits the order 4 block */
+  page = spa_get_block(3);
+  assert_int_equal(page, pool_page(16));
+  assert_int_equal(spa_free_blocks[3], pool_page(24));
+  assert_int_equal(spa_free_blocks[4], 0);
+  assert_int_equal(spa_available(), POOL_PAGES - 1 - 16);
+
+  /* its pages come back one by one and merge into it again */
+  for (i = 0; i < 8; i++) spa_put(page + i * RISCV_PAGE_SIZE);
+  assert_int_equal(spa_free_blocks[3], 0);
+  assert_int_equal(spa_free_blocks[4], pool_page(16));
+  assert_int_equal(spa_available(), POOL_PAGES - 1 - 8);
+
+  spa_put_block(block, 3);
+  assert_int_equal(spa_free_blocks[3], pool_page(8));
+  assert_int_equal(spa_available(), POOL_PAGES - 1);
+}
+
+void
+test_metadata_is_no_buddy() {
+  uintptr_t page;
+
+  pool_init(0);
+
+  page = spa_get();
+  assert_int_equal(page, pool_page(1));
+
+  /* page 0 holds spa_block_order and must never merge with page 1,
+   * whatever its byte says */
+  spa_block_order[0] = 1;
+  spa_put(page);
+  assert_int_equal(spa_free_blocks[0], pool_page(1));
+  assert_int_equal(spa_free_blocks[1], 0);
+  assert_int_equal(spa_available(), POOL_PAGES - 1);
+
+  /* so the metadata page is never handed out */
+  assert_int_equal(spa_get(), pool_page(1));
+  assert_int_equal(spa_get_block(1), pool_page(2));
+}
+
+void
+test_available() {
+  uintptr_t pages[POOL_PAGES];
+  size_t i, count = 0;
+
+  pool_init(0);
+
+  while ((pages[count] = spa_get_zero())) {
+    assert_true(spa_contains(pages[count]));
+    count++;
+  }
+  assert_int_equal(count, POOL_PAGES - 1);
+  assert_int_equal(spa_available(), 0);
+  assert_int_equal(spa_get_block(0), 0);
+
+  for (i = 0; i < count; i++) spa_put(pages[i]);
+  assert_int_equal(spa_available(), POOL_PAGES - 1);
+
+  /* everything merged back, up to the order 9 block */
+  assert_int_equal(spa_get_block(9), pool_page(512));
+  assert_int_equal(spa_get_block(9), 0);
+  assert_int_equal(spa_available(), POOL_PAGES - 1 - 512);
+}
+
+/* every free block is aligned to its size at the current PAs */
+static void
+assert_free_blocks_aligned() {
+  uintptr_t block;
+  unsigned int order;
+
+  for (order = 0; order <= SPA_MAX_ORDER; order++) {
+    for (block = spa_free_blocks[order]; block; block = SPA_BLOCK(block)->next) {
+      assert_true(IS_ALIGNED(__pa(block), order + RISCV_PAGE_BITS));
+      assert_int_equal(spa_block_order[SPA_INDEX(block)], order + 1);
+    }
+  }
+}
+
+void
+test_relocate() {
+  uintptr_t held, page, block;
+  size_t avail, count = 0;
+
+  pool_init(0);
+
+  /* carves pages 1, 2-3, 4-7, 8-15 and hands out 16-31, then page 1 */
+  held = spa_get_block(4);
+  assert_int_equal(held, pool_page(16));
+  page = spa_get();
+  assert_int_equal(page, pool_page(1));
+  avail = spa_available();
+
+  /* restored three pages further up */
+  pool_pa += 3 * RISCV_PAGE_SIZE;
+  spa_relocate();
+  assert_int_equal(spa_available(), avail);
+  assert_free_blocks_aligned();
+
+  /* pages 2-15 sit at PA pages 5-18 now */
+  assert_int_equal(spa_free_blocks[0], pool_page(15));
+  assert_int_equal(SPA_BLOCK(pool_page(15))->next, pool_page(2));
+  assert_int_equal(spa_free_blocks[1], pool_page(13));
+  assert_int_equal(SPA_BLOCK(pool_page(13))->next, pool_page(3));
+  assert_int_equal(spa_free_blocks[2], 0);
+  assert_int_equal(spa_free_blocks[3], pool_page(5));
+
+  /* a block handed out before goes back in aligned parts, and merges */
+  spa_put_block(held, 4);
+  assert_int_equal(spa_available(), avail + 16);
+  assert_free_blocks_aligned();
+  assert_int_equal(spa_free_blocks[4], pool_page(13));
+
+  /* the watermark carves at the new alignment too */
+  block = spa_get_block(5);
+  assert_true(IS_ALIGNED(__pa(block), 5 + RISCV_PAGE_BITS));
+  spa_put_block(block, 5);
+
+  /* and every page is still there, once */
+  while (spa_get()) count++;
+  assert_int_equal(count, POOL_PAGES - 2);
+  spa_put(page);
+}
+
+int
+main() {
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_init_clears_order),
+      cmocka_unit_test(test_split_and_merge),
+      cmocka_unit_test(test_metadata_is_no_buddy),
+      cmocka_unit_test(test_available),
+      cmocka_unit_test(test_relocate),
+  };
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,271 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+
+#include "mm/vm_defs.h"
+
+/* the pool is plain host memory, far below the enclave's load address */
+#undef EYRIE_LOAD_START
+#define EYRIE_LOAD_START 0ul
+
+#include "../mm/freemem.c"
+#include "../mm/mm.c"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "mock.h"
+
+void
+sbi_exit_enclave(uint64_t code) {
+  exit(code);
+}
+
+pte* root_page_table;
+uintptr_t freemem_va_start;
+size_t freemem_size;
+
+/* enough for a few megapages, at a megapage aligned POOL_PA */
+#define POOL_PA    0x80000000ul
+#define POOL_PAGES 2048
+#define POOL_SIZE  (POOL_PAGES * RISCV_PAGE_SIZE)
+
+uintptr_t
+__pa(uintptr_t va) {
+  return va - freemem_va_start + POOL_PA;
+}
+
+uintptr_t
+__va(uintptr_t pa) {
+  return pa - POOL_PA + freemem_va_start;
+}
+
+uintptr_t
+kernel_va_to_pa(void* ptr) {
+  return __pa((uintptr_t)ptr);
+}
+
+#define RW    (PTE_R | PTE_W | PTE_U)
+#define RO    (PTE_R | PTE_U)
+#define MEGA  RISCV_GET_LVL_PGSIZE(2)
+#define GIGA  RISCV_GET_LVL_PGSIZE(1)
+/* a megapage aligned user address */
+#define BASE  vpn(0x40000000ul)
+#define LARGE BIT(LEAF_ORDER(2))
+
+static void
+pool_init(void) {
+  if (!freemem_va_start) {
+    void* pool = mmap(
+        NULL, POOL_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+        -1, 0);
+    assert_int_not_equal(pool, MAP_FAILED);
+    freemem_va_start = (uintptr_t)pool;
+    freemem_size     = POOL_SIZE;
+  }
+  memset((void*)freemem_va_start, 0, POOL_SIZE);
+  spa_init(freemem_va_start, freemem_size);
+
+  root_page_table = (pte*)spa_get_zero();
+  assert_non_null(root_page_table);
+  set_max_page_size(MEGA);
+}
+
+/* the level of the leaf that maps the page, 0 if none does */
+static int
+leaf_level(uintptr_t page) {
+  int level;
+
+  if (!__walk_leaf(page << RISCV_PAGE_BITS, &level)) return 0;
+  return level;
+}
+
+static unsigned char*
+page_ptr(uintptr_t page) {
+  uintptr_t pa = translate(page << RISCV_PAGE_BITS);
+
+  assert_int_not_equal(pa, 0);
+  return (unsigned char*)__va(pa);
+}
+
+void
+test_set_max_page_size() {
+  pool_init();
+
+  assert_int_equal(get_max_page_size(), MEGA);
+  assert_int_equal(set_max_page_size(RISCV_PAGE_SIZE), MEGA);
+  assert_int_equal(get_max_page_size(), RISCV_PAGE_SIZE);
+  assert_int_equal(set_max_page_size(GIGA), RISCV_PAGE_SIZE);
+  assert_int_equal(get_max_page_size(), GIGA);
+
+  /* only leaf sizes */
+  assert_int_equal(set_max_page_size(0), (uintptr_t)-1);
+  assert_int_equal(set_max_page_size(2 * RISCV_PAGE_SIZE), (uintptr_t)-1);
+  assert_int_equal(set_max_page_size(2 * GIGA), (uintptr_t)-1);
+  assert_int_equal(get_max_page_size(), GIGA);
+}
+
+void
+test_alloc_pages_large() {
+  size_t avail, i;
+
+  pool_init();
+  avail = spa_available();
+
+  /* one megapage, then 4 KiB pages for the rest */
+  assert_int_equal(alloc_pages(BASE, LARGE + 3, RW), LARGE + 3);
+  assert_int_equal(leaf_level(BASE), 2);
+  assert_int_equal(leaf_level(BASE + LARGE - 1), 2);
+  for (i = 0; i < 3; i++) assert_int_equal(leaf_level(BASE + LARGE + i), 3);
+  assert_int_equal(leaf_level(BASE + LARGE + 3), 0);
+
+  /* the pages, an L2 table and the L3 table behind the megapage */
+  assert_int_equal(spa_available(), avail - LARGE - 3 - 2);
+
+  /* zeroed and backed by one naturally aligned block */
+  for (i = 0; i < LARGE; i++) {
+    assert_int_equal(page_ptr(BASE + i)[0], 0);
+    assert_ptr_equal(page_ptr(BASE + i), page_ptr(BASE) + i * RISCV_PAGE_SIZE);
+  }
+  assert_true(IS_ALIGNED(translate(BASE << RISCV_PAGE_BITS), LEAF_ORDER(2) + RISCV_PAGE_BITS));
+  assert_int_equal(
+      *__walk(root_page_table, BASE << RISCV_PAGE_BITS, 2) & (PTE_R | PTE_W | PTE_U),
+      RW);
+}
+
+void
+test_alloc_pages_small() {
+  size_t i;
+
+  /* not aligned to a megapage */
+  pool_init();
+  assert_int_equal(alloc_pages(BASE + 1, LARGE, RW), LARGE);
+  for (i = 0; i < LARGE; i++) assert_int_equal(leaf_level(BASE + 1 + i), 3);
+
+  /* too short for one */
+  pool_init();
+  assert_int_equal(alloc_pages(BASE, LARGE - 1, RW), LARGE - 1);
+  for (i = 0; i < LARGE - 1; i++) assert_int_equal(leaf_level(BASE + i), 3);
+
+  /* or larger than max_page_size */
+  pool_init();
+  set_max_page_size(RISCV_PAGE_SIZE);
+  assert_int_equal(alloc_pages(BASE, LARGE, RW), LARGE);
+  for (i = 0; i < LARGE; i++) assert_int_equal(leaf_level(BASE + i), 3);
+
+  /* 4 KiB pages still come out of contiguous blocks */
+  assert_ptr_equal(page_ptr(BASE + 1), page_ptr(BASE) + RISCV_PAGE_SIZE);
+}
+
+void
+test_alloc_pages_keeps_mapped() {
+  uintptr_t kept;
+  size_t avail, i;
+
+  pool_init();
+  assert_int_not_equal(alloc_page(BASE + 7, RW), 0);
+  kept = translate((BASE + 7) << RISCV_PAGE_BITS);
+  page_ptr(BASE + 7)[0] = 0x5a;
+  avail = spa_available();
+
+  /* no megapage over a mapped page, and the page stays as it is */
+  assert_int_equal(alloc_pages(BASE, LARGE, RW), LARGE);
+  assert_int_equal(translate((BASE + 7) << RISCV_PAGE_BITS), kept);
+  assert_int_equal(page_ptr(BASE + 7)[0], 0x5a);
+  for (i = 0; i < LARGE; i++) assert_int_equal(leaf_level(BASE + i), 3);
+
+  /* and the block page it would have used went back */
+  assert_int_equal(spa_available(), avail - (LARGE - 1));
+}
+
+void
+test_alloc_pages_out_of_memory() {
+  size_t done, i;
+
+  pool_init();
+  set_max_page_size(RISCV_PAGE_SIZE);
+
+  done = alloc_pages(BASE, POOL_PAGES, RW);
+  assert_true(done > 0 && done < POOL_PAGES);
+  for (i = 0; i < done; i++) assert_int_equal(leaf_level(BASE + i), 3);
+  assert_int_equal(leaf_level(BASE + done), 0);
+  assert_true(spa_available() < RISCV_PT_LEVELS);
+}
+
+void
+test_promote() {
+  size_t avail, i;
+
+  pool_init();
+  set_max_page_size(RISCV_PAGE_SIZE);
+  assert_int_equal(alloc_pages(BASE, LARGE, RW), LARGE);
+  for (i = 0; i < LARGE; i++) page_ptr(BASE + i)[1] = (unsigned char)i;
+  avail = spa_available();
+
+  /* not above max_page_size */
+  promote_pages(BASE, LARGE);
+  assert_int_equal(leaf_level(BASE), 3);
+
+  set_max_page_size(MEGA);
+  promote_pages(BASE + 3, 5);
+  assert_int_equal(leaf_level(BASE), 2);
+  assert_int_equal(leaf_level(BASE + LARGE - 1), 2);
+  assert_int_equal(
+      *__walk(root_page_table, BASE << RISCV_PAGE_BITS, 2) & (PTE_R | PTE_W | PTE_U),
+      RW);
+
+  /* the contents moved along, and the L3 table was freed */
+  for (i = 0; i < LARGE; i++) assert_int_equal(page_ptr(BASE + i)[1], (unsigned char)i);
+  assert_int_equal(spa_available(), avail + 1);
+
+  /* a leaf is left alone */
+  assert_false(__promote(__walk(root_page_table, BASE << RISCV_PAGE_BITS, 2), 2));
+}
+
+void
+test_promote_refuses() {
+  pte* entry;
+
+  pool_init();
+  set_max_page_size(RISCV_PAGE_SIZE);
+  assert_int_equal(alloc_pages(BASE, LARGE, RW), LARGE);
+  set_max_page_size(MEGA);
+  entry = __walk(root_page_table, BASE << RISCV_PAGE_BITS, 2);
+
+  /* mixed permissions */
+  assert_int_not_equal(realloc_page(BASE + 9, PTE_D | PTE_A | PTE_V | RO), 0);
+  assert_false(__promote(entry, 2));
+  promote_pages(BASE, LARGE);
+  assert_int_equal(leaf_level(BASE), 3);
+  assert_int_not_equal(realloc_page(BASE + 9, PTE_D | PTE_A | PTE_V | RW), 0);
+
+  /* a hole */
+  free_page(BASE + 9);
+  assert_false(__promote(entry, 2));
+
+  /* memory outside the SPA, like the eapp's file pages */
+  assert_int_equal(map_page(BASE + 9, vpn(POOL_PA) - 1, RW), 1);
+  assert_false(__promote(entry, 2));
+  assert_int_equal(leaf_level(BASE), 3);
+
+  /* with all of that undone it goes through */
+  *__walk(root_page_table, (BASE + 9) << RISCV_PAGE_BITS, 3) = 0;
+  assert_int_not_equal(alloc_page(BASE + 9, RW), 0);
+  assert_true(__promote(entry, 2));
+  assert_int_equal(leaf_level(BASE), 2);
+}
+
+int
+main() {
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_set_max_page_size),
+      cmocka_unit_test(test_alloc_pages_large),
+      cmocka_unit_test(test_alloc_pages_small),
+      cmocka_unit_test(test_alloc_pages_keeps_mapped),
+      cmocka_unit_test(test_alloc_pages_out_of_memory),
+      cmocka_unit_test(test_promote),
+      cmocka_unit_test(test_promote_refuses),
+  };
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,297 @@
+#define _GNU_SOURCE
+
+#include "../mm/vma.c"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mock.h"
+
+void
+sbi_exit_enclave(uint64_t code) {
+  exit(code);
+}
+
+/* pages mapped outside of any region, like the eapp's image; none
+ * unless a test sets them */
+static uintptr_t mapped_start, mapped_end;
+
+size_t
+test_va_range(uintptr_t vpn, size_t count) {
+  size_t i;
+
+  for (i = 0; i < count; i++) {
+    uintptr_t va = (vpn + i) << RISCV_PAGE_BITS;
+    if (va >= mapped_start && va < mapped_end) break;
+  }
+  return i;
+}
+
+static size_t populated;
+
+bool
+populate_page(uintptr_t vpn, uintptr_t lo, uintptr_t hi, int flags, bool large) {
+  (void)flags;
+  (void)large;
+  assert_true(vpn >= lo && vpn < hi);
+  populated++;
+  return true;
+}
+
+void
+promote_pages(uintptr_t vpn, size_t count) {
+  (void)vpn;
+  (void)count;
+}
+
+void
+tlb_flush(void) {}
+
+static size_t fatal_faults;
+
+void
+rt_page_fault(struct encl_ctx* ctx) {
+  (void)ctx;
+  fatal_faults++;
+}
+
+#define RW (PTE_R | PTE_W | PTE_D | PTE_A | PTE_U)
+#define RO (PTE_R | PTE_A | PTE_U)
+#define ANON EYRIE_ANON_REGION_START
+#define MEGA RISCV_GET_LVL_PGSIZE(2)
+#define STACK_END (EYRIE_USER_STACK_START - EYRIE_USER_STACK_SIZE)
+
+/* the array is sorted and merged, and the tree matches a full rebuild */
+static void
+check_vmas(void) {
+  size_t i;
+
+  for (i = 0; i + 1 < vma_count; i++) {
+    assert_true(vmas[i].start < vmas[i].end);
+    assert_true(vmas[i].end <= vmas[i + 1].start);
+    assert_false(
+        vmas[i].end == vmas[i + 1].start && __vma_alike(&vmas[i], &vmas[i + 1]));
+  }
+  for (i = 0; i < GAP_LEAVES; i++)
+    assert_int_equal(gap_tree[GAP_LEAVES + i], __gap_size(i));
+  for (i = GAP_LEAVES - 1; i > 0; i--) {
+    uintptr_t left = gap_tree[2 * i], right = gap_tree[2 * i + 1];
+    assert_int_equal(gap_tree[i], left > right ? left : right);
+  }
+}
+
+static void
+fault(uintptr_t va, uintptr_t cause) {
+  struct encl_ctx ctx;
+
+  ctx.sbadaddr = va;
+  ctx.scause   = cause;
+  vma_handle_page_fault(&ctx);
+}
+
+void
+test_place() {
+  uintptr_t va;
+
+  vma_init();
+
+  va = vma_place(ANON, 3 * RISCV_PAGE_SIZE, RISCV_PAGE_BITS);
+  assert_int_equal(va, ANON);
+  assert_true(vma_add(va, va + 3 * RISCV_PAGE_SIZE, RW, 0));
+  check_vmas();
+
+  /* alignment skips the rest of the first megapage */
+  va = vma_place(ANON, 4 * MEGA, RISCV_GET_LVL_PGSIZE_BITS(2));
+  assert_int_equal(va, ANON + MEGA);
+  assert_true(vma_add(va, va + 4 * MEGA, RW, 0));
+  check_vmas();
+
+  /* small mappings fill the hole below it */
+  va = vma_place(ANON, RISCV_PAGE_SIZE, RISCV_PAGE_BITS);
+  assert_int_equal(va, ANON + 3 * RISCV_PAGE_SIZE);
+  assert_true(vma_add(va, va + RISCV_PAGE_SIZE, RW, 0));
+  check_vmas();
+
+  /* alike neighbours were merged */
+  assert_int_equal(vma_count, 2);
+  assert_int_equal(vmas[0].end, ANON + 4 * RISCV_PAGE_SIZE);
+
+  /* a hole too small for the request is passed over */
+  va = vma_place(ANON, MEGA, RISCV_PAGE_BITS);
+  assert_int_equal(va, ANON + 5 * MEGA);
+
+  /* and so is everything below from */
+  va = vma_place(ANON + 6 * MEGA, RISCV_PAGE_SIZE, RISCV_PAGE_BITS);
+  assert_int_equal(va, ANON + 6 * MEGA);
+
+  /* a region unlike its neighbours moves the ones above it */
+  va = ANON + 5 * RISCV_PAGE_SIZE;
+  assert_true(vma_add(va, va + RISCV_PAGE_SIZE, RO, 0));
+  check_vmas();
+  assert_int_equal(vma_count, 3);
+  assert_int_equal(vma_place(ANON, MEGA, RISCV_PAGE_BITS), ANON + 5 * MEGA);
+
+  assert_false(vma_add(ANON + MEGA - RISCV_PAGE_SIZE, ANON + MEGA + 1, RW, 0));
+  assert_int_equal(vma_place(ANON, 0, RISCV_PAGE_BITS), 0);
+  assert_int_equal(
+      vma_place(ANON, EYRIE_ANON_REGION_END - ANON + 1, RISCV_PAGE_BITS), 0);
+  check_vmas();
+}
+
+void
+test_remove_split() {
+  uintptr_t va;
+  size_t n;
+
+  vma_init();
+
+  assert_true(vma_add(ANON, ANON + 4 * MEGA, RW, 0));
+
+  /* a hole in the middle splits the region */
+  assert_true(vma_remove(ANON + MEGA, ANON + 2 * MEGA));
+  check_vmas();
+  assert_int_equal(vma_count, 2);
+  assert_int_equal(vmas[0].end, ANON + MEGA);
+  assert_int_equal(vmas[1].start, ANON + 2 * MEGA);
+  assert_null(vma_find(ANON + MEGA));
+  assert_int_equal(vma_place(ANON, MEGA, RISCV_PAGE_BITS), ANON + MEGA);
+
+  /* so does a protection change, and undoing it merges back */
+  assert_true(vma_protect(ANON + 3 * MEGA, ANON + 3 * MEGA + RISCV_PAGE_SIZE, RO));
+  check_vmas();
+  assert_int_equal(vma_count, 4);
+  assert_true(vma_protect(ANON + 3 * MEGA, ANON + 3 * MEGA + RISCV_PAGE_SIZE, RW));
+  check_vmas();
+  assert_int_equal(vma_count, 2);
+
+  /* removing across regions and holes drops all of them */
+  assert_true(vma_remove(ANON + MEGA / 2, ANON + 3 * MEGA));
+  check_vmas();
+  assert_int_equal(vma_count, 2);
+  assert_int_equal(vmas[0].end, ANON + MEGA / 2);
+  assert_int_equal(vmas[1].start, ANON + 3 * MEGA);
+
+  /* fill the table with regions two pages apart */
+  va = ANON + 8 * MEGA;
+  for (n = vma_count; n < VMA_MAX; n++, va += 2 * RISCV_PAGE_SIZE)
+    assert_true(vma_add(va, va + RISCV_PAGE_SIZE, RW, 0));
+  check_vmas();
+  assert_false(vma_add(va, va + RISCV_PAGE_SIZE, RW, 0));
+
+  /* a split needs a free slot; removing whole regions does not */
+  assert_false(vma_remove(ANON + RISCV_PAGE_SIZE, ANON + 2 * RISCV_PAGE_SIZE));
+  assert_int_equal(vma_count, VMA_MAX);
+  assert_true(vma_remove(ANON, ANON + MEGA));
+  check_vmas();
+  assert_int_equal(vma_count, VMA_MAX - 1);
+  assert_int_equal(vma_place(ANON, MEGA, RISCV_PAGE_BITS), ANON);
+}
+
+void
+test_grow() {
+  uintptr_t va;
+
+  vma_init();
+  populated    = 0;
+  fatal_faults = 0;
+
+  assert_true(vma_add(STACK_END, EYRIE_USER_STACK_START, RW, VMA_GROWSDOWN));
+
+  /* a fault right below the stack grows it down to that page */
+  va = STACK_END - RISCV_PAGE_SIZE - 8;
+  fault(va, RISCV_EXCP_STORE_PAGE_FAULT);
+  check_vmas();
+  assert_int_equal(fatal_faults, 0);
+  assert_int_equal(populated, 1);
+  assert_int_equal(vmas[0].start, PAGE_DOWN(va));
+
+  /* but not past EYRIE_USER_STACK_MAX */
+  fault(EYRIE_USER_STACK_START - EYRIE_USER_STACK_MAX - RISCV_PAGE_SIZE,
+        RISCV_EXCP_STORE_PAGE_FAULT);
+  assert_int_equal(fatal_faults, 1);
+  assert_int_equal(vmas[0].start, PAGE_DOWN(va));
+  fault(EYRIE_USER_STACK_START - EYRIE_USER_STACK_MAX,
+        RISCV_EXCP_STORE_PAGE_FAULT);
+  assert_int_equal(fatal_faults, 1);
+  assert_int_equal(
+      vmas[0].start, EYRIE_USER_STACK_START - EYRIE_USER_STACK_MAX);
+  check_vmas();
+
+  /* faults outside of any region, or against its flags, are fatal */
+  assert_true(vma_add(ANON, ANON + MEGA, RO, 0));
+  fault(ANON, RISCV_EXCP_STORE_PAGE_FAULT);
+  assert_int_equal(fatal_faults, 2);
+  fault(ANON + MEGA, RISCV_EXCP_LOAD_PAGE_FAULT);
+  assert_int_equal(fatal_faults, 3);
+  fault(ANON, RISCV_EXCP_LOAD_PAGE_FAULT);
+  assert_int_equal(fatal_faults, 3);
+}
+
+void
+test_grow_guard() {
+  uintptr_t below = STACK_END - 4 * RISCV_PAGE_SIZE;
+
+  vma_init();
+  fatal_faults = 0;
+
+  assert_true(vma_add(STACK_END, EYRIE_USER_STACK_START, RW, VMA_GROWSDOWN));
+  assert_true(vma_add(below - RISCV_PAGE_SIZE, below, RW, 0));
+
+  /* the stack grows until one page is left above the mapping below */
+  fault(STACK_END - RISCV_PAGE_SIZE, RISCV_EXCP_STORE_PAGE_FAULT);
+  fault(below + RISCV_PAGE_SIZE, RISCV_EXCP_STORE_PAGE_FAULT);
+  assert_int_equal(fatal_faults, 0);
+  assert_int_equal(vmas[1].start, below + RISCV_PAGE_SIZE);
+  check_vmas();
+
+  /* the guard page itself is never taken */
+  fault(below, RISCV_EXCP_STORE_PAGE_FAULT);
+  assert_int_equal(fatal_faults, 1);
+  assert_int_equal(vmas[1].start, below + RISCV_PAGE_SIZE);
+  assert_null(vma_find(below));
+}
+
+void
+test_can_replace() {
+  uintptr_t image = ANON + 4 * MEGA;
+
+  vma_init();
+  assert_true(vma_add(ANON, ANON + MEGA, RW, 0));
+  assert_true(vma_add(ANON + 2 * MEGA, ANON + 3 * MEGA, RO, 0));
+  assert_true(vma_add(STACK_END, EYRIE_USER_STACK_START, RW, VMA_GROWSDOWN));
+  mapped_start = image;
+  mapped_end   = image + 2 * RISCV_PAGE_SIZE;
+
+  /* regions, and the unmapped holes between them */
+  assert_true(vma_can_replace(ANON, ANON + MEGA));
+  assert_true(vma_can_replace(ANON + MEGA / 2, ANON + 3 * MEGA));
+  assert_true(vma_can_replace(ANON + 3 * MEGA, image));
+
+  /* not pages that were mapped without a region */
+  assert_false(vma_can_replace(ANON + 3 * MEGA, image + RISCV_PAGE_SIZE));
+  assert_false(vma_can_replace(image + RISCV_PAGE_SIZE, image + MEGA));
+  assert_true(vma_can_replace(mapped_end, mapped_end + MEGA));
+
+  /* nor anything the stack may grow into */
+  assert_false(vma_can_replace(STACK_END, STACK_END + RISCV_PAGE_SIZE));
+  assert_false(vma_can_replace(
+      EYRIE_USER_STACK_START - EYRIE_USER_STACK_MAX - RISCV_PAGE_SIZE,
+      EYRIE_USER_STACK_START - EYRIE_USER_STACK_MAX + RISCV_PAGE_SIZE));
+  assert_true(vma_can_replace(
+      EYRIE_USER_STACK_START - EYRIE_USER_STACK_MAX - RISCV_PAGE_SIZE,
+      EYRIE_USER_STACK_START - EYRIE_USER_STACK_MAX));
+
+  mapped_start = mapped_end = 0;
+}
+
+int
+main() {
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_place),
+      cmocka_unit_test(test_remove_split),
+      cmocka_unit_test(test_grow),
+      cmocka_unit_test(test_grow_guard),
+      cmocka_unit_test(test_can_replace),
+  };
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -48,6 +48,22 @@ untrusted_mmap();
 int
 attest_enclave(void* report, void* data, size_t size);
 
+/* Non-blocking file I/O (runtime built with ASYNC_IO). async_submit
+ * returns a tag or -1 if no request slot is free; async_complete returns
+ * the tag of a finished request and its result in *res, or -1 if none
+ * has finished (or, with wait, if none is in flight). For reads, buf is
+ * filled in by async_complete. */
+int
+async_submit(int op, int fd, void* buf, size_t len, int64_t offset);
+int
+async_complete(int64_t* res, int wait);
+
+/* Largest page the runtime maps anonymous memory (mmap, brk) with from
+ * now on: 4 KiB, 2 MiB or 1 GiB on RV64. Returns the previous size, or
+ * -1 if size is not a page size. */
+uintptr_t
+set_max_page_size(size_t size);
+
 int
 get_sealing_key(
     struct sealing_key* sealing_key_struct, size_t sealing_key_struct_size,
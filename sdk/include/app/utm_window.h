@@ -0,0 +1,46 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#ifndef __UTM_WINDOW_H__
+#define __UTM_WINDOW_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "edge/edge_common.h"
+
+/* A part of the untrusted shared memory mapped straight into the eapp.
+ * Data built in the window is visible to the host as is, so ocalls can
+ * pass a struct edge_data (offset and size) instead of copying the
+ * payload through the runtime. Anything in the window is untrusted:
+ * the host can read and modify it at any time. */
+struct utm_window {
+  uintptr_t base;
+  size_t size;
+  edge_data_offset offset; /* of base in the shared buffer */
+  size_t used;
+};
+
+/* Map the last size bytes (rounded up to pages) of the shared buffer.
+ * Only one window can be mapped. Returns 0 on success. */
+int
+utm_window_map(struct utm_window* window, size_t size);
+
+/* Bump allocator over the window; returns NULL when it is full */
+void*
+utm_window_alloc(struct utm_window* window, size_t size);
+/* Release everything allocated from the window */
+void
+utm_window_reset(struct utm_window* window);
+
+/* Describe an allocation for the host */
+struct edge_data
+utm_window_data(struct utm_window* window, void* ptr, size_t size);
+
+/* ocall whose argument is an edge_data pointing into the window */
+int
+utm_window_ocall(
+    struct utm_window* window, unsigned long call_id, void* ptr, size_t size,
+    void* return_buffer, size_t return_len);
+
+#endif /* __UTM_WINDOW_H__ */
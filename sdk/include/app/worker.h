@@ -0,0 +1,24 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#ifndef __WORKER_H__
+#define __WORKER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "shared/worker_call.h"
+
+/* Runs one job: input is the job payload, the handler writes up to
+ * *out_len bytes of output and updates *out_len. The return value is
+ * handed back to the host as the job status. */
+typedef int64_t (*worker_handler)(
+    const void* input, size_t input_len, void* output, size_t* out_len);
+
+/* Pulls jobs from the host (see shared/worker_call.h) and runs them with
+ * handler until the host tells the worker to exit. Returns 0 then, or -1
+ * if an ocall failed. */
+int
+worker_loop(worker_handler handler);
+
+#endif /* __WORKER_H__ */
@@ -0,0 +1,81 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#ifndef __EDGE_ASYNC_H_
+#define __EDGE_ASYNC_H_
+
+#include "edge_call.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Asynchronous proxied file I/O.
+ *
+ * The runtime carves a struct edge_async_area out of the shared buffer
+ * and submits requests with EDGECALL_ASYNC_SUBMIT. The host queues them
+ * (on io_uring where available) and returns right away; completions are
+ * posted into the area's completion ring by a host thread while the
+ * enclave keeps running. Each request owns one data slot until its
+ * completion has been consumed, so the ring never overflows.
+ * EDGECALL_ASYNC_WAIT blocks on the host until a completion is posted. */
+
+#define EDGECALL_ASYNC_SUBMIT MAX_EDGE_CALL + 3
+#define EDGECALL_ASYNC_WAIT MAX_EDGE_CALL + 4
+
+#define EDGE_ASYNC_SLOTS 8 /* must be a power of two */
+#define EDGE_ASYNC_SLOT_SIZE 4096
+
+/* request ops */
+#define EDGE_ASYNC_OP_READ 1
+#define EDGE_ASYNC_OP_WRITE 2
+#define EDGE_ASYNC_OP_FSYNC 3
+
+struct edge_async_cqe {
+  unsigned long slot;
+  int64_t res;
+};
+
+struct edge_async_area {
+  unsigned char data[EDGE_ASYNC_SLOTS][EDGE_ASYNC_SLOT_SIZE];
+  /* next completion to consume, only written by the enclave */
+  unsigned long cq_head;
+  /* next completion to post, only written by the host */
+  unsigned long cq_tail;
+  struct edge_async_cqe cq[EDGE_ASYNC_SLOTS];
+};
+
+#define EDGE_ASYNC_RESERVED sizeof(struct edge_async_area)
+
+struct edge_async_sqe {
+  unsigned long op;
+  unsigned long slot;
+  int fd;
+  size_t len;
+  int64_t offset;
+};
+
+/* EDGECALL_ASYNC_SUBMIT arguments; the return value is the number of
+ * requests queued or -errno */
+struct edge_async_submit {
+  edge_data_offset area;
+  size_t count;
+  struct edge_async_sqe sqes[];
+};
+
+/* EDGECALL_ASYNC_WAIT arguments */
+struct edge_async_wait {
+  edge_data_offset area;
+};
+
+void
+incoming_async_submit(struct edge_call* buffer);
+void
+incoming_async_wait(struct edge_call* buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EDGE_ASYNC_H_ */
@@ -7,6 +7,11 @@
 
 #include "edge_common.h"
 
+/* Asks the host to run the call whose header is at the argument offset.
+ * Calls in slots go through it, since the host looks for the call at the
+ * front of the buffer. */
+#define EDGECALL_FORWARD MAX_EDGE_CALL + 5
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -17,6 +22,9 @@ extern "C" {
 int
 edge_call_check_ptr_valid(uintptr_t ptr, size_t data_len);
 
+size_t
+edge_call_room(uintptr_t ptr);
+
 void
 edge_call_init_internals(uintptr_t buffer_start, size_t buffer_len);
 
@@ -34,6 +42,22 @@ int
 edge_call_ret_ptr(struct edge_call* edge_call, uintptr_t* ptr, size_t* size);
 uintptr_t
 edge_call_data_ptr();
+uintptr_t
+edge_call_data_ptr_of(struct edge_call* edge_call);
+size_t
+edge_call_data_len_of(struct edge_call* edge_call);
+uintptr_t
+edge_call_ret_ptr_after_args(struct edge_call* edge_call, size_t size);
+
+/* Shared buffer slots for concurrent edge calls */
+#define EDGE_CALL_SLOT_MAX (sizeof(unsigned long) * 8)
+
+size_t
+edge_call_slots_init(size_t slot_size, size_t count);
+struct edge_call*
+edge_call_slot_alloc();
+void
+edge_call_slot_free(struct edge_call* edge_call);
 int
 edge_call_setup_call(struct edge_call* edge_call, void* ptr, size_t size);
 int
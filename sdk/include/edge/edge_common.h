@@ -67,6 +67,11 @@ struct edge_call {
 
   /* Pre-set location to structure return data */
   struct edge_return return_data;
+
+  /* Bytes owned by this call, including this header. Set by
+   * edge_call_setup_call(); the other side keeps the call's data, like
+   * its return value, within them. */
+  size_t call_slot_len;
 };
 
 #endif /* __EDGE_COMMON_H_ */
@@ -0,0 +1,61 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#ifndef __EDGE_SWITCHLESS_H_
+#define __EDGE_SWITCHLESS_H_
+
+#include "edge_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Switchless edge calls.
+ *
+ * The last EDGE_SWITCHLESS_RESERVED bytes of the shared buffer hold a
+ * single-producer/single-consumer ring. The runtime (producer) posts the
+ * offset of a prepared struct edge_call and spins; a host worker thread
+ * (consumer) dispatches it and marks the slot done. If nobody picks the
+ * request up in time, the runtime cancels it and falls back to a regular
+ * enclave exit. */
+
+#define EDGE_SWITCHLESS_MAGIC 0x6b73776cUL
+#define EDGE_SWITCHLESS_RING_SIZE 8 /* must be a power of two */
+#define EDGE_SWITCHLESS_RESERVED 512
+
+/* slot states */
+#define SWITCHLESS_SLOT_FREE 0
+#define SWITCHLESS_SLOT_POSTED 1    /* enclave -> host */
+#define SWITCHLESS_SLOT_BUSY 2      /* host is running the call */
+#define SWITCHLESS_SLOT_DONE 3      /* host -> enclave */
+#define SWITCHLESS_SLOT_CANCELLED 4 /* enclave took a real exit instead */
+
+struct edge_switchless_slot {
+  unsigned long status;
+  edge_data_offset call_offset;
+};
+
+struct edge_switchless_ring {
+  /* set by the runtime once it reserved the ring */
+  unsigned long enclave_magic;
+  /* non-zero while a host worker is polling */
+  unsigned long host_active;
+  /* next slot to post, only written by the enclave */
+  unsigned long head;
+  /* next slot to serve, only written by the host */
+  unsigned long tail;
+  struct edge_switchless_slot slots[EDGE_SWITCHLESS_RING_SIZE];
+};
+
+static inline struct edge_switchless_ring*
+edge_switchless_ring_ptr(uintptr_t buffer_start, size_t buffer_len) {
+  return (struct edge_switchless_ring*)(buffer_start + buffer_len -
+                                        EDGE_SWITCHLESS_RESERVED);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EDGE_SWITCHLESS_H_ */
@@ -15,14 +15,42 @@
 extern "C" {
 #endif
 
-// Special call number
+// Special call numbers
 #define EDGECALL_SYSCALL MAX_EDGE_CALL + 1
+#define EDGECALL_SYSCALL_BATCH MAX_EDGE_CALL + 2
 
 struct edge_syscall {
   size_t syscall_num;
   unsigned char data[];
 };
 
+/* A batch lets one edge call carry several edge_syscall records. Each
+ * entry locates a record in the shared buffer (same offsets as
+ * edge_data); the host executes them in order and writes each
+ * syscall's return value back into its entry. */
+struct edge_syscall_batch_entry {
+  size_t offset;
+  size_t size;
+  int64_t ret;
+};
+
+struct edge_syscall_batch {
+  size_t count;
+  struct edge_syscall_batch_entry entries[];
+};
+
+// Max number of segments in a proxied readv/writev
+#define EDGE_SYSCALL_IOV_MAX 64
+
+/* iov[] locates each segment in the shared buffer */
+typedef struct sargs_SYS_writev {
+  int fd;
+  int iovcnt;
+  struct edge_data iov[];
+} sargs_SYS_writev;
+
+typedef sargs_SYS_writev sargs_SYS_readv;
+
 typedef struct sargs_SYS_openat {
   int dirfd;
   int flags;
@@ -215,6 +243,8 @@ typedef struct sargs_SYS_sendfile {
 
 void
 incoming_syscall(struct edge_call* buffer);
+void
+incoming_syscall_batch(struct edge_call* buffer);
 
 #ifdef __cplusplus
 }
@@ -5,10 +5,14 @@
 #pragma once
 
 #include <fcntl.h>
+#include <sys/types.h>
 #include <unistd.h>
 
 #include <iostream>
+#include <memory>
 #include <string>
+#include <tuple>
+#include <vector>
 
 #include "./common.h"
 #include "shared/keystone_user.h"
@@ -19,13 +23,44 @@ extern "C" {
 
 namespace Keystone {
 
+/* identifies a file's contents for the image and measurement caches */
+struct ElfFileKey {
+  dev_t dev;
+  ino_t ino;
+  int64_t mtimeSec;
+  int64_t mtimeNsec;
+  off_t size;
+
+  bool operator<(const ElfFileKey& other) const {
+    return std::tie(dev, ino, mtimeSec, mtimeNsec, size) <
+           std::tie(
+               other.dev, other.ino, other.mtimeSec, other.mtimeNsec,
+               other.size);
+  }
+};
+
+/* Files are mapped once per process and shared by every ElfFile opened
+ * on the same (dev, inode, mtime, size), so that creating many enclaves
+ * from the same binaries does not map and fault them in again. */
 class ElfFile {
  public:
   explicit ElfFile(std::string filename);
+  /* wraps an image already in memory, which must outlive the ElfFile */
+  ElfFile(const void* buffer, size_t size);
   ~ElfFile();
-  size_t getFileSize() { return fileSize; }
+  /* NULL for in-memory images */
+  const ElfFileKey* getKey() { return mapping ? &key : NULL; }
+  /* drops the mappings no ElfFile uses anymore */
+  static void clearCache();
+  /* a file mapping shared through the cache */
+  struct Mapping;
+  size_t getFileSize() { return loadable.empty() ? fileSize : loadable.size(); }
   bool isValid();
-  void* getPtr() { return ptr; }
+  void* getPtr() { return loadable.empty() ? ptr : loadable.data(); }
+  /* Switches getPtr() and getFileSize() to a copy of the file that only
+   * holds the headers and the PT_LOAD contents, still a valid ELF file */
+  bool extractLoadable();
+  bool isLoadableOnly() { return !loadable.empty(); }
 
   uintptr_t getMinVaddr() { return minVaddr; }
   size_t getTotalMemorySize() { return maxVaddr - minVaddr; }
@@ -44,7 +79,9 @@ class ElfFile {
   void* getProgramSegment(size_t ph);
 
  private:
-  int filep;
+  std::shared_ptr<Mapping> mapping;
+  ElfFileKey key;
+  void parse();
 
   /* virtual addresses */
   uintptr_t minVaddr;
@@ -52,6 +89,7 @@ class ElfFile {
 
   void* ptr;
   size_t fileSize;
+  std::vector<unsigned char> loadable;
 
   /* is this runtime binary */
   bool isRuntime;
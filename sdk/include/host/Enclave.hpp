@@ -11,10 +11,12 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <cerrno>
 #include <cstring>
 #include <functional>
 #include <iostream>
+#include <thread>
 
 #include "./common.h"
 extern "C" {
@@ -40,23 +42,41 @@ class Enclave {
   void* shared_buffer;
   size_t shared_buffer_size;
   OcallFunc oFuncDispatch;
+  std::thread switchlessThread;
+  std::atomic<bool> switchlessStop;
+  /* restored and not run yet, still stopped in an edge call */
+  bool restored;
   bool mapUntrusted(size_t size);
+  void startSwitchless();
+  void stopSwitchless();
+  void switchlessWorker();
   void copyFile(uintptr_t filePtr, size_t fileSize);
   void allocUninitialized(ElfFile* elfFile);
   void loadElf(ElfFile* elfFile);
 
   bool initFiles(const char*, const char*);
   bool initDevice();
-  bool prepareEnclaveMemory(size_t requiredPages, uintptr_t alternatePhysAddr);
+  bool prepareEnclaveMemory(size_t minPages, uintptr_t alternatePhysAddr);
   bool initMemory();
 
  public:
   Enclave();
   ~Enclave();
-  static Error measure(char* hash, const char* eapppath, const char* runtimepath, const char* loaderpath);
+  static Error measure(
+      char* hash, const char* eapppath, const char* runtimepath, const char* loaderpath,
+      bool loadableOnly = false);
+  /* Same with images already opened or in memory. Results for
+   * file-backed images are kept for the life of the process. */
+  static Error measure(
+      char* hash, ElfFile* eapp, ElfFile* runtime, ElfFile* loader,
+      bool loadableOnly = false);
+  static Error calculateEpm(
+      const char* eapppath, const char* runtimepath, const char* loaderpath, Params* params);
+  static Error measurePrelinked(char* hash, const char* imagepath, const char* loaderpath);
   void* getSharedBuffer();
   size_t getSharedBufferSize();
   Memory* getMemory();
+  Params getParams() { return params; }
   uintptr_t getRuntimeElfAddr() { return runtimeElfAddr; }
   uintptr_t getEnclaveElfAddr() { return enclaveElfAddr; }
   Error registerOcallDispatch(OcallFunc func);
@@ -64,11 +84,21 @@ class Enclave {
   Error init(
       const char* eapppath, const char* runtimepath, const char* loaderpath, Params _params,
       uintptr_t alternatePhysAddr);
+  Error init(
+      ElfFile* eapp, ElfFile* runtime, ElfFile* loader, Params _params,
+      uintptr_t alternatePhysAddr = 0);
+  Error initPrelinked(const char* imagepath, const char* loaderpath, Params _params);
+  Error cloneFrom(const Enclave& tmpl);
   Error destroy();
+  Error reset();
+  Error checkpoint(const char* path);
+  Error restore(const char* path, Params _params);
   Error run(uintptr_t* ret = nullptr);
 };
 
-uint64_t
-calculate_required_pages(ElfFile** elfFiles, size_t numElfFiles);
+EpmBreakdown
+calculate_epm_breakdown(
+    Params params, ElfFile* loader, ElfFile* runtime, ElfFile* eapp,
+    size_t prelinkedSize = 0);
 
 }  // namespace Keystone
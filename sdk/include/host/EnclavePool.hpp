@@ -0,0 +1,74 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Enclave.hpp"
+#include "Params.hpp"
+
+namespace Keystone {
+
+/* Keeps a number of initialized, never-run enclaves of the same image ready
+ * so that acquire() does not pay for Enclave::init (driver create, EPM copy
+ * and SM hashing). Refill threads top the pool up to the high watermark
+ * whenever it drops to the low watermark. Enclaves are single-use: run
+ * the one you acquired and let it go; the pool never takes it back. */
+class EnclavePool {
+ public:
+  EnclavePool(
+      const char* eapppath, const char* runtimepath, const char* loaderpath,
+      Params params, size_t lowWatermark, size_t highWatermark,
+      size_t refillThreads = 1);
+  ~EnclavePool();
+
+  /* Hands out a ready enclave, or initializes one on the spot if the pool
+   * is empty. Returns nullptr if that initialization fails. */
+  std::unique_ptr<Enclave> acquire();
+  /* Blocks until the pool holds at least `count` enclaves (capped at the
+   * high watermark) or refilling keeps failing. */
+  void warmup(size_t count);
+
+  size_t getReady();
+  size_t getLowWatermark() { return lowWatermark; }
+  size_t getHighWatermark() { return highWatermark; }
+  uint64_t getHits() { return hits.load(); }
+  uint64_t getMisses() { return misses.load(); }
+  uint64_t getFailures() { return failures.load(); }
+
+ private:
+  std::string eapppath;
+  std::string runtimepath;
+  std::string loaderpath;
+  Params params;
+  size_t lowWatermark;
+  size_t highWatermark;
+
+  std::mutex lock;
+  std::condition_variable refillCond;
+  std::condition_variable readyCond;
+  std::deque<std::unique_ptr<Enclave>> ready;
+  /* enclaves being initialized by refill threads */
+  size_t pending;
+  bool refilling;
+  bool stopping;
+  std::vector<std::thread> refillers;
+
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> misses;
+  std::atomic<uint64_t> failures;
+
+  std::unique_ptr<Enclave> create();
+  void refillWorker();
+};
+
+}  // namespace Keystone
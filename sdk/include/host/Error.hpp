@@ -25,6 +25,10 @@ enum class Error {
   PageAllocationFailure,
   EdgeCallHost,
   EnclaveInterrupted,
+  JobRejected,
+  IoctlErrorReset,
+  IoctlErrorCheckpoint,
+  IoctlErrorRestore,
 };
 
 }  // namespace Keystone
@@ -15,6 +15,7 @@
 #include <cerrno>
 #include <cstring>
 #include <iostream>
+#include <set>
 
 #include "./common.h"
 #include "Error.hpp"
@@ -30,10 +31,13 @@ class KeystoneDevice {
 
  private:
   int fd;
+  /* resume across timer interrupts inside the driver (if supported) */
+  bool runUntilEdge;
   Error __run(bool resume, uintptr_t* ret);
 
  public:
   virtual uintptr_t getPhysAddr() { return physAddr; }
+  int getEid() const { return eid; }
 
   KeystoneDevice();
   virtual ~KeystoneDevice() {}
@@ -42,17 +46,22 @@ class KeystoneDevice {
   virtual uintptr_t initUTM(size_t size);
   virtual Error finalize(
       uintptr_t runtimePhysAddr, uintptr_t eappPhysAddr, uintptr_t freePhysAddr,
-      uintptr_t freeRequested);
+      uintptr_t freeRequested, uintptr_t timeslice, bool checkpoint = false);
   virtual Error destroy();
+  virtual Error reset();
+  virtual Error clone(int templateEid);
+  virtual Error checkpoint(void* image, size_t size);
+  virtual Error restore(const void* image, size_t size);
   virtual Error run(uintptr_t* ret);
   virtual Error resume(uintptr_t* ret);
   virtual void* map(uintptr_t addr, size_t size);
+  virtual void unmap(void* ptr, size_t size);
 };
 
 class MockKeystoneDevice : public KeystoneDevice {
  private:
-  /* allocated buffer with map() */
-  void* sharedBuffer;
+  /* buffers allocated with map() and not unmapped yet */
+  std::set<void*> mappings;
 
  public:
   MockKeystoneDevice() {}
@@ -62,11 +71,16 @@ class MockKeystoneDevice : public KeystoneDevice {
   uintptr_t initUTM(size_t size);
   Error finalize(
       uintptr_t runtimePhysAddr, uintptr_t eappPhysAddr, uintptr_t freePhysAddr,
-      uintptr_t freeRequested);
+      uintptr_t freeRequested, uintptr_t timeslice, bool checkpoint = false);
   Error destroy();
+  Error reset();
+  Error clone(int templateEid);
+  Error checkpoint(void* image, size_t size);
+  Error restore(const void* image, size_t size);
   Error run(uintptr_t* ret);
   Error resume(uintptr_t* ret);
   void* map(uintptr_t addr, size_t size);
+  void unmap(void* ptr, size_t size);
 };
 
 }  // namespace Keystone
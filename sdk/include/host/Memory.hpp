@@ -30,12 +30,15 @@ class Memory {
   virtual void writeMem(uintptr_t src, uintptr_t dst, size_t size) = 0;
   virtual uintptr_t allocMem(size_t size)                          = 0;
   virtual uintptr_t allocUtm(size_t size)                          = 0;
+  /* release any host mapping of the EPM; must be called before finalize */
+  virtual void endStaging() {}
   size_t epmAllocVspace(uintptr_t addr, size_t num_pages);
   uintptr_t allocPages(size_t size); 
 
 
   // getters to be deprecated
   uintptr_t getStartAddr() { return startAddr; }
+  size_t getEpmSize() { return epmSize; }
   uintptr_t getCurrentOffset() { return epmFreeList; }
   uintptr_t getCurrentEPMAddress() { return epmFreeList + startAddr; }
 
@@ -66,13 +69,18 @@ class Memory {
 
 class PhysicalEnclaveMemory : public Memory {
  public:
-  PhysicalEnclaveMemory() {}
+  PhysicalEnclaveMemory() { epmStaging = NULL; }
   ~PhysicalEnclaveMemory() {}
   void init(KeystoneDevice* dev, uintptr_t phys_addr, size_t min_pages);
   uintptr_t readMem(uintptr_t src, size_t size);
   void writeMem(uintptr_t src, uintptr_t dst, size_t size);
   uintptr_t allocMem(size_t size);
   uintptr_t allocUtm(size_t size);
+  void endStaging();
+
+ private:
+  /* host mapping of the whole EPM, valid only until finalize */
+  void* epmStaging;
 };
 
 // Simulated memory reads/writes from calloc'ed memory
@@ -24,25 +24,84 @@
 #endif
 
 #define DEFAULT_UNTRUSTED_SIZE 8192  // 8 KB
+#define DEFAULT_TIMESLICE 10000      // cycles between runtime timer ticks
+#define TIMESLICE_TICKLESS 0         // only yield on edge calls (and host IRQs)
 
 /* parameters for enclave creation */
 namespace Keystone {
 
+/* EPM pages of an enclave, as computed by Enclave::init() from the ELF
+ * program headers. Everything but freePages is what the loader and the
+ * runtime need before the eapp allocates anything. */
+struct EpmBreakdown {
+  uint64_t filePages;      /* loader, runtime and eapp as copied in */
+  uint64_t loadedPages;    /* .bss and partial pages the ELF loaders allocate */
+  uint64_t pageTablePages; /* runtime, eapp, stack and UTM mappings */
+  uint64_t stackPages;     /* the top of the stack, set up by eyrie_boot */
+  uint64_t freePages;      /* Params::setFreeMemSize() */
+  uint64_t allocatorPages; /* runtime page allocator metadata */
+
+  uint64_t total() const {
+    return filePages + loadedPages + pageTablePages + stackPages +
+           freePages + allocatorPages;
+  }
+};
+
 class Params {
  public:
   Params() {
     untrusted_size = DEFAULT_UNTRUSTED_SIZE;
     freemem_size   = DEFAULT_FREEMEM_SIZE;
+    timeslice      = DEFAULT_TIMESLICE;
+    switchless     = false;
+    resettable     = false;
+    loadableOnly   = false;
+    epm            = EpmBreakdown();
   }
 
   void setUntrustedSize(uint64_t size) { untrusted_size = size; }
   void setFreeMemSize(uint64_t size) { freemem_size = size; }
   uintptr_t getUntrustedSize() { return untrusted_size; }
   uintptr_t getFreeMemSize() { return freemem_size; }
+  /* cycles the runtime runs before yielding to the host;
+   * TIMESLICE_TICKLESS disables the runtime timer altogether */
+  void setTimeslice(uint64_t cycles) { timeslice = cycles; }
+  uintptr_t getTimeslice() { return timeslice; }
+  /* serve edge calls from a host worker thread polling the shared buffer
+   * (requires a runtime built with SWITCHLESS) */
+  void setSwitchless(bool enable) { switchless = enable; }
+  bool getSwitchless() { return switchless; }
+  /* have the SM keep a pristine copy of the enclave image so that
+   * Enclave::reset() can run it again without a new create */
+  void setResettable(bool enable) { resettable = enable; }
+  bool getResettable() { return resettable; }
+  /* copy and measure only the headers and PT_LOAD contents of the runtime
+   * and the eapp, not debug info or symbols; Enclave::measure() must be
+   * called with loadableOnly set to match */
+  void setLoadableOnly(bool enable) { loadableOnly = enable; }
+  bool getLoadableOnly() { return loadableOnly; }
+  /* set by Enclave::init() and Enclave::calculateEpm() */
+  void setEpmBreakdown(const EpmBreakdown& breakdown) { epm = breakdown; }
+  const EpmBreakdown& getEpmBreakdown() { return epm; }
+  void printEpmBreakdown(FILE* out = stdout) {
+    fprintf(
+        out,
+        "EPM pages: %lu files, %lu loaded, %lu page tables, %lu stack, "
+        "%lu free, %lu allocator = %lu\n",
+        (unsigned long)epm.filePages, (unsigned long)epm.loadedPages,
+        (unsigned long)epm.pageTablePages, (unsigned long)epm.stackPages,
+        (unsigned long)epm.freePages, (unsigned long)epm.allocatorPages,
+        (unsigned long)epm.total());
+  }
 
  private:
   uint64_t untrusted_size;
   uint64_t freemem_size;
+  uint64_t timeslice;
+  bool switchless;
+  bool resettable;
+  bool loadableOnly;
+  EpmBreakdown epm;
 };
 
 }  // namespace Keystone
@@ -0,0 +1,51 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <vector>
+
+#include "./common.h"
+#include "ElfFile.hpp"
+#include "Error.hpp"
+extern "C" {
+#include "shared/eyrie_prelink.h"
+}
+
+namespace Keystone {
+
+/* Lays out a runtime and an eapp the way the loader and eyrie_boot would,
+ * page tables included, and writes the result as a prelinked image
+ * (shared/eyrie_prelink.h). Enclave::initPrelinked() boots it without
+ * parsing any ELF file in the enclave. The image only depends on the two
+ * ELF files, so its measurement is as stable as theirs. */
+class Prelinker {
+ public:
+  static Error build(
+      const char* eapppath, const char* runtimepath, const char* outpath);
+
+ private:
+  struct Mapping {
+    size_t offset;
+    int flags;
+  };
+
+  std::vector<unsigned char> image;
+  std::map<uintptr_t, Mapping> mappings;
+  std::vector<struct eyrie_prelink_reloc> relocs;
+  struct eyrie_prelink header;
+
+  size_t allocPages(size_t count);
+  bool mapSegment(elf_t* elf, size_t ph, bool user, uintptr_t runtimeVa);
+  bool placeRuntime(ElfFile* runtime);
+  bool placeEapp(ElfFile* eapp);
+  void buildPageTables();
+  bool collectRelocs();
+};
+
+}  // namespace Keystone
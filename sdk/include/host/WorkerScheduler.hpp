@@ -0,0 +1,102 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Enclave.hpp"
+#include "Error.hpp"
+#include "Params.hpp"
+
+namespace Keystone {
+
+struct JobResult {
+  int64_t status;
+  std::vector<unsigned char> output;
+};
+
+/* Runs jobs on long-lived worker enclaves instead of creating an enclave
+ * per request. There is one worker per hart; each is driven by a host
+ * thread pinned to that hart, so the enclave always runs there too. The
+ * eapp runs worker_loop() (app/worker.h) and fetches jobs with the ocall
+ * protocol in shared/worker_call.h. submit() spreads jobs over the
+ * per-worker queues and a worker whose queue is empty steals from the
+ * back of its peers' queues before going idle. */
+class WorkerScheduler {
+ public:
+  /* workers == 0 means one per online hart */
+  WorkerScheduler(
+      const char* eapppath, const char* runtimepath, const char* loaderpath,
+      Params params, size_t workers = 0);
+  ~WorkerScheduler();
+
+  /* Edge calls other than the worker protocol are passed to func, with
+   * the shared buffer of the worker enclave that made them. Must be set
+   * before start(). */
+  void setOcallDispatch(OcallFunc func) { fallbackDispatch = func; }
+  /* Creates and starts all worker enclaves */
+  Error start();
+  /* Lets the workers finish the queued jobs, then stops them */
+  void stop();
+  Error submit(const void* data, size_t len, std::future<JobResult>* result);
+
+  size_t getWorkers() { return workers.size(); }
+  uint64_t getCompleted() { return completed.load(); }
+  uint64_t getSteals() { return steals.load(); }
+
+ private:
+  struct Job {
+    uint64_t id;
+    std::vector<unsigned char> input;
+    std::promise<JobResult> result;
+  };
+
+  struct Worker {
+    size_t hart;
+    std::thread thread;
+    std::mutex lock;
+    std::deque<std::unique_ptr<Job>> queue;
+    /* job handed to the enclave, finished on its next call */
+    std::unique_ptr<Job> current;
+    Enclave enclave;
+  };
+
+  std::string eapppath;
+  std::string runtimepath;
+  std::string loaderpath;
+  Params params;
+  size_t numWorkers;
+  OcallFunc fallbackDispatch;
+  std::vector<std::unique_ptr<Worker>> workers;
+
+  /* protects queued, stopping and the startup state */
+  std::mutex idleLock;
+  std::condition_variable idleCond;
+  size_t queued;
+  bool stopping;
+  size_t started;
+  Error startError;
+
+  std::atomic<uint64_t> nextJobId;
+  std::atomic<size_t> nextWorker;
+  std::atomic<uint64_t> completed;
+  std::atomic<uint64_t> steals;
+
+  void runWorker(Worker* worker);
+  void handleCall(Worker* worker, void* buffer);
+  std::unique_ptr<Job> nextJob(Worker* worker);
+  std::unique_ptr<Job> takeJob(Worker* worker, bool steal);
+  static void failJob(std::unique_ptr<Job> job);
+};
+
+}  // namespace Keystone
@@ -16,6 +16,18 @@
 #define PAGE_DOWN(n) ROUND_DOWN(n, PAGE_BITS)
 #define PAGE_UP(n) ROUND_UP(n, PAGE_BITS)
 
+/* enclave page table geometry, see runtime mm/vm_defs.h */
+#if __riscv_xlen == 32
+#define PT_INDEX_BITS 10
+#define PT_LEVELS 2
+#else
+#define PT_INDEX_BITS 9
+#define PT_LEVELS 3
+#endif
+#define PT_ENTRIES (1UL << PT_INDEX_BITS)
+#define PT_LEVEL_BITS(level) (PT_INDEX_BITS * (PT_LEVELS - (level)) + PAGE_BITS)
+#define PT_INDEX(va, level) (((va) >> PT_LEVEL_BITS(level)) & (PT_ENTRIES - 1))
+
 #define BOOST_STRINGIZE(X) BOOST_DO_STRINGIZE(X)
 #define BOOST_DO_STRINGIZE(X) #X
 
@@ -1 +1,4 @@
 #include "Enclave.hpp"
+#include "EnclavePool.hpp"
+#include "Prelinker.hpp"
+#include "WorkerScheduler.hpp"
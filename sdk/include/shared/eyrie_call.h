@@ -6,6 +6,15 @@
 #define RUNTIME_SYSCALL_SHAREDCOPY          1002
 #define RUNTIME_SYSCALL_ATTEST_ENCLAVE      1003
 #define RUNTIME_SYSCALL_GET_SEALING_KEY     1004
+#define RUNTIME_SYSCALL_ASYNC_SUBMIT        1005
+#define RUNTIME_SYSCALL_ASYNC_COMPLETE      1006
+#define RUNTIME_SYSCALL_MAP_SHARED          1007
+#define RUNTIME_SYSCALL_SET_MAX_PAGE_SIZE   1008
 #define RUNTIME_SYSCALL_EXIT                1101
 
+/* ops for RUNTIME_SYSCALL_ASYNC_SUBMIT */
+#define ASYNC_IO_READ                       1
+#define ASYNC_IO_WRITE                      2
+#define ASYNC_IO_FSYNC                      3
+
 #endif  // __EYRIE_CALL_H__
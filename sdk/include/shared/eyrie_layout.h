@@ -0,0 +1,26 @@
+#ifndef __EYRIE_LAYOUT_H__
+#define __EYRIE_LAYOUT_H__
+
+/* Parts of Eyrie's memory layout that the host needs to size the EPM.
+ * Included by the runtime (mm/vm_defs.h) and by the host SDK. */
+
+/* The eapp stack grows down from EYRIE_USER_STACK_START. eyrie_boot sets
+ * up its first EYRIE_USER_STACK_SIZE bytes as a region whose pages are
+ * only mapped when they are first touched, and faults below it grow it
+ * down to EYRIE_USER_STACK_MAX. At boot, only the top
+ * EYRIE_USER_STACK_BOOT_PAGES pages are touched, for argc, envp and the
+ * aux vector (setup_start()). */
+#if __riscv_xlen == 32
+#define EYRIE_USER_STACK_START 0x40000000
+#else
+#define EYRIE_USER_STACK_START 0x0000001fc0000000
+#endif
+#define EYRIE_USER_STACK_SIZE 0x20000
+#define EYRIE_USER_STACK_MAX 0x800000
+#define EYRIE_USER_STACK_BOOT_PAGES 1
+
+/* The free page allocator (mm/freemem.c) keeps this many bytes per page
+ * of free memory at the start of free memory. */
+#define EYRIE_FREEMEM_META_PER_PAGE 1
+
+#endif /* __EYRIE_LAYOUT_H__ */
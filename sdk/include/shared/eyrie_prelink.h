@@ -0,0 +1,49 @@
+#ifndef __EYRIE_PRELINK_H__
+#define __EYRIE_PRELINK_H__
+
+#include <stdint.h>
+
+/* Prelinked Eyrie image, built on the host by Keystone::Prelinker.
+ *
+ * The image replaces the runtime and eapp ELF files in the EPM, right
+ * after the loader, and is measured like them:
+ *
+ *   runtime_base                 struct eyrie_prelink (one page)
+ *   + runtime_offset             runtime memory, rt_base onwards, .bss included
+ *   user_base = + user_offset    first page of the eapp ELF (Ehdr and Phdrs)
+ *                                eapp memory, .bss included
+ *   + root_offset                page tables for the runtime and the eapp
+ *   free_base = + image_size
+ *
+ * Page table entries hold physical page numbers relative to runtime_base,
+ * so the image does not depend on where the EPM ends up. The loader adds
+ * the base to every entry listed in relocs[] and installs the root; the
+ * runtime then maps the EPM and the UTM as usual and skips ELF loading. */
+
+#define EYRIE_PRELINK_MAGIC   0x4b4e4c4552505945ULL /* "EYPRELNK" */
+#define EYRIE_PRELINK_VERSION 1
+#define EYRIE_PRELINK_PAGE    4096
+
+/* run of consecutive page table entries to relocate */
+struct eyrie_prelink_reloc {
+  uint32_t offset; /* from runtime_base, in bytes */
+  uint32_t count;
+};
+
+struct eyrie_prelink {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t n_relocs;
+  uint64_t runtime_offset;
+  uint64_t runtime_va;
+  uint64_t user_offset;
+  uint64_t root_offset;
+  uint64_t image_size;
+  struct eyrie_prelink_reloc relocs[];
+};
+
+#define EYRIE_PRELINK_MAX_RELOCS                             \
+  ((EYRIE_PRELINK_PAGE - sizeof(struct eyrie_prelink)) / \
+   sizeof(struct eyrie_prelink_reloc))
+
+#endif  // __EYRIE_PRELINK_H__
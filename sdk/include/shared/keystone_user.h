@@ -26,6 +26,25 @@
   _IOR(KEYSTONE_IOC_MAGIC, 0x06, struct keystone_ioctl_create_enclave)
 #define KEYSTONE_IOC_UTM_INIT \
   _IOR(KEYSTONE_IOC_MAGIC, 0x07, struct keystone_ioctl_create_enclave)
+// run/resume, but keep resuming in the kernel across timer interrupts;
+// returns on edge call, exit, error, or a pending signal
+#define KEYSTONE_IOC_RUN_UNTIL_EDGE \
+  _IOR(KEYSTONE_IOC_MAGIC, 0x08, struct keystone_ioctl_run_enclave)
+#define KEYSTONE_IOC_RESUME_UNTIL_EDGE \
+  _IOR(KEYSTONE_IOC_MAGIC, 0x09, struct keystone_ioctl_run_enclave)
+// bring an exited enclave back to FRESH (needs checkpoint at finalize)
+#define KEYSTONE_IOC_RESET_ENCLAVE \
+  _IOR(KEYSTONE_IOC_MAGIC, 0x0a, struct keystone_ioctl_create_enclave)
+// finalize a created enclave (EPM and UTM allocated) as a copy of a FRESH
+// template enclave instead of measuring its EPM
+#define KEYSTONE_IOC_CLONE_ENCLAVE \
+  _IOR(KEYSTONE_IOC_MAGIC, 0x0b, struct keystone_ioctl_create_enclave)
+// write an encrypted image of an enclave stopped in an edge call
+#define KEYSTONE_IOC_CHECKPOINT_ENCLAVE \
+  _IOR(KEYSTONE_IOC_MAGIC, 0x0c, struct keystone_ioctl_checkpoint)
+// finalize a created enclave (EPM and UTM allocated) from such an image
+#define KEYSTONE_IOC_RESTORE_ENCLAVE \
+  _IOR(KEYSTONE_IOC_MAGIC, 0x0d, struct keystone_ioctl_checkpoint)
 
 #define RT_NOEXEC 0
 #define USER_NOEXEC 1
@@ -45,6 +64,11 @@ struct keystone_ioctl_create_enclave {
   uintptr_t user_paddr;
   uintptr_t free_paddr;
   uintptr_t free_requested;
+  uintptr_t timeslice;
+  uintptr_t checkpoint; // keep a pristine copy for reset
+
+  // host -> driver // clone
+  uintptr_t template_eid;
 
   // driver -> host
   uintptr_t epm_paddr;
@@ -52,6 +76,12 @@ struct keystone_ioctl_create_enclave {
   uintptr_t utm_paddr;
 };
 
+struct keystone_ioctl_checkpoint {
+  uintptr_t eid;
+  uintptr_t image; // user buffer, at least SM_CHECKPOINT_SIZE(epm_size)
+  uintptr_t size;
+};
+
 struct keystone_ioctl_run_enclave {
   uintptr_t eid;
   uintptr_t error;
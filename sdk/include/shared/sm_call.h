@@ -15,6 +15,10 @@
 #define SBI_SM_DESTROY_ENCLAVE   2002
 #define SBI_SM_RUN_ENCLAVE       2003
 #define SBI_SM_RESUME_ENCLAVE    2005
+#define SBI_SM_RESET_ENCLAVE     2006
+#define SBI_SM_CLONE_ENCLAVE     2007
+#define SBI_SM_CHECKPOINT_ENCLAVE 2008
+#define SBI_SM_RESTORE_ENCLAVE   2009
 #define FID_RANGE_HOST           2999
 
 /* 3000-3999 are called by enclave */
@@ -49,6 +53,7 @@ struct runtime_params_t {
   uintptr_t untrusted_base;
   uintptr_t untrusted_size;
   uintptr_t free_requested; // for attestation
+  uintptr_t timeslice;      // runtime timer period in cycles, 0 = tickless
 };
 
 struct keystone_sbi_pregion_t {
@@ -64,6 +69,36 @@ struct keystone_sbi_create_t {
   uintptr_t user_paddr;
   uintptr_t free_paddr;
   uintptr_t free_requested;
+  uintptr_t timeslice;
+
+  /* SM-only copy of the pages below free_paddr, taken at create so
+   * that SBI_SM_RESET_ENCLAVE can restore them; size 0 if unused */
+  struct keystone_sbi_pregion_t checkpoint_region;
 };
 
+/* Image written by SBI_SM_CHECKPOINT_ENCLAVE: this header, followed by
+ * SM_CHECKPOINT_STATE_SIZE bytes of thread state and then the whole EPM,
+ * both encrypted under a key derived from the enclave's sealing key. The
+ * MAC covers the header up to the MAC itself and the encrypted body. */
+#define SM_CHECKPOINT_MAGIC       0x4b435054
+#define SM_CHECKPOINT_VERSION     1
+#define SM_CHECKPOINT_HASH_SIZE   64
+#define SM_CHECKPOINT_NONCE_SIZE  32
+#define SM_CHECKPOINT_MAC_SIZE    64
+#define SM_CHECKPOINT_STATE_SIZE  1024
+
+struct keystone_sbi_checkpoint_t {
+  uintptr_t magic;
+  uintptr_t version;
+  unsigned char hash[SM_CHECKPOINT_HASH_SIZE];
+  unsigned char nonce[SM_CHECKPOINT_NONCE_SIZE];
+  /* layout of the checkpointed enclave, its PAs only serve as offsets */
+  struct runtime_params_t params;
+  unsigned char mac[SM_CHECKPOINT_MAC_SIZE];
+};
+
+#define SM_CHECKPOINT_SIZE(epm_size)                 \
+  (sizeof(struct keystone_sbi_checkpoint_t) +        \
+   SM_CHECKPOINT_STATE_SIZE + (epm_size))
+
 #endif  // __SM_CALL_H__
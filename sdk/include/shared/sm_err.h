@@ -19,6 +19,11 @@
 #define SBI_ERR_SM_ENCLAVE_SBI_PROHIBITED              100014
 #define SBI_ERR_SM_ENCLAVE_ILLEGAL_PTE                 100015
 #define SBI_ERR_SM_ENCLAVE_NOT_FRESH                   100016
+#define SBI_ERR_SM_ENCLAVE_NOT_RESETTABLE              100017
+#define SBI_ERR_SM_ENCLAVE_NOT_CHECKPOINTABLE          100018
+#define SBI_ERR_SM_ENCLAVE_CHECKPOINT_INVALID          100019
+/* not an error: returned to a restored enclave on its first resume */
+#define SBI_ERR_SM_ENCLAVE_RESTORED                    100030
 #define SBI_ERR_SM_DEPRECATED                          100099
 #define SBI_ERR_SM_NOT_IMPLEMENTED                     100100
 
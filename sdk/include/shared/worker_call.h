@@ -0,0 +1,39 @@
+#ifndef __WORKER_CALL_H__
+#define __WORKER_CALL_H__
+
+#include <stdint.h>
+
+/* Job protocol between a persistent worker enclave and the host's
+ * Keystone::WorkerScheduler.
+ *
+ * The worker issues a single ocall, WORKER_CALL_NEXT_JOB, whose argument
+ * is a struct worker_msg carrying the result of the job it just finished
+ * (WORKER_JOB_NONE on its first call). The host answers with the next
+ * job in a struct worker_msg, blocking the worker until one is queued.
+ * A reply flagged WORKER_MSG_EXIT tells the worker to leave its loop.
+ * One round trip per job, with no host dispatch in between. */
+
+/* MAX_EDGE_CALL + 5, next to the edge calls reserved for syscalls */
+#define WORKER_CALL_NEXT_JOB  15
+
+#define WORKER_JOB_NONE       ((uint64_t)-1)
+
+/* flags */
+#define WORKER_MSG_EXIT       0x1
+
+/* largest job input or output, including the header; must fit in the
+ * shared buffer after the edge call header */
+#define WORKER_MSG_MAX        4096
+
+struct worker_msg {
+  uint64_t job_id;
+  uint64_t flags;
+  /* result from the worker, unused in jobs */
+  int64_t status;
+  uint64_t len;
+  unsigned char data[];
+};
+
+#define WORKER_MSG_DATA_MAX   (WORKER_MSG_MAX - sizeof(struct worker_msg))
+
+#endif  // __WORKER_CALL_H__
@@ -24,6 +24,11 @@ attest_enclave(void* report, void* data, size_t size) {
   return SYSCALL_3(RUNTIME_SYSCALL_ATTEST_ENCLAVE, report, data, size);
 }
 
+uintptr_t
+set_max_page_size(size_t size) {
+  return SYSCALL_1(RUNTIME_SYSCALL_SET_MAX_PAGE_SIZE, size);
+}
+
 /* returns sealing key */
 int
 get_sealing_key(
@@ -33,3 +38,13 @@ get_sealing_key(
       sealing_key_struct, sealing_key_struct_size,
       key_ident, key_ident_size);
 }
+
+int
+async_submit(int op, int fd, void* buf, size_t len, int64_t offset) {
+  return SYSCALL_5(RUNTIME_SYSCALL_ASYNC_SUBMIT, op, fd, buf, len, offset);
+}
+
+int
+async_complete(int64_t* res, int wait) {
+  return SYSCALL_2(RUNTIME_SYSCALL_ASYNC_COMPLETE, res, wait);
+}
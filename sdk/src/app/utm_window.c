@@ -0,0 +1,53 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#include "utm_window.h"
+#include "syscall.h"
+
+#define UTM_WINDOW_ALIGN sizeof(uintptr_t)
+
+int
+utm_window_map(struct utm_window* window, size_t size) {
+  edge_data_offset offset;
+  uintptr_t base = SYSCALL_2(RUNTIME_SYSCALL_MAP_SHARED, size, &offset);
+
+  if (base == (uintptr_t)-1) return -1;
+
+  window->base   = base;
+  window->size   = (size + 4095) & ~(size_t)4095;
+  window->offset = offset;
+  window->used   = 0;
+  return 0;
+}
+
+void*
+utm_window_alloc(struct utm_window* window, size_t size) {
+  size = (size + UTM_WINDOW_ALIGN - 1) & ~(UTM_WINDOW_ALIGN - 1);
+  if (size > window->size - window->used) return NULL;
+
+  void* ptr = (void*)(window->base + window->used);
+  window->used += size;
+  return ptr;
+}
+
+void
+utm_window_reset(struct utm_window* window) {
+  window->used = 0;
+}
+
+struct edge_data
+utm_window_data(struct utm_window* window, void* ptr, size_t size) {
+  struct edge_data data;
+  data.offset = window->offset + ((uintptr_t)ptr - window->base);
+  data.size   = size;
+  return data;
+}
+
+int
+utm_window_ocall(
+    struct utm_window* window, unsigned long call_id, void* ptr, size_t size,
+    void* return_buffer, size_t return_len) {
+  struct edge_data data = utm_window_data(window, ptr, size);
+  return ocall(call_id, &data, sizeof(data), return_buffer, return_len);
+}
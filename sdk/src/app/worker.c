@@ -0,0 +1,40 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#include "worker.h"
+#include "syscall.h"
+
+static unsigned char job_buf[WORKER_MSG_MAX];
+static unsigned char result_buf[WORKER_MSG_MAX];
+
+int
+worker_loop(worker_handler handler) {
+  struct worker_msg* job    = (struct worker_msg*)job_buf;
+  struct worker_msg* result = (struct worker_msg*)result_buf;
+  size_t out_len;
+
+  result->job_id = WORKER_JOB_NONE;
+  result->flags  = 0;
+  result->status = 0;
+  result->len    = 0;
+
+  while (1) {
+    if (ocall(
+            WORKER_CALL_NEXT_JOB, result,
+            sizeof(struct worker_msg) + result->len, job,
+            WORKER_MSG_MAX) != 0)
+      return -1;
+
+    if (job->flags & WORKER_MSG_EXIT) return 0;
+
+    /* the host is untrusted, never go past our buffer */
+    if (job->len > WORKER_MSG_DATA_MAX) job->len = WORKER_MSG_DATA_MAX;
+
+    out_len        = WORKER_MSG_DATA_MAX;
+    result->status = handler(job->data, job->len, result->data, &out_len);
+    result->job_id = job->job_id;
+    result->len =
+        out_len > WORKER_MSG_DATA_MAX ? WORKER_MSG_DATA_MAX : out_len;
+  }
+}
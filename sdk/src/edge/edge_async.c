@@ -0,0 +1,265 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#include "edge_async.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define EDGE_ASYNC_URING
+#endif
+
+/* Only one enclave area is served at a time. Completions may be posted
+ * from the reaper thread and from the dispatching thread, so posting
+ * happens under async_lock too. */
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_posted = PTHREAD_COND_INITIALIZER;
+static struct edge_async_area* async_area;
+static unsigned long async_inflight;
+
+static void
+async_post(unsigned long slot, int64_t res) {
+  pthread_mutex_lock(&async_lock);
+  struct edge_async_area* area = async_area;
+  unsigned long tail           = area->cq_tail;
+
+  area->cq[tail & (EDGE_ASYNC_SLOTS - 1)].slot = slot;
+  area->cq[tail & (EDGE_ASYNC_SLOTS - 1)].res  = res;
+  __atomic_store_n(&area->cq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  async_inflight--;
+  pthread_cond_broadcast(&async_posted);
+  pthread_mutex_unlock(&async_lock);
+}
+
+#ifdef EDGE_ASYNC_URING
+static struct {
+  int fd;
+  unsigned *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe* sqes;
+  struct io_uring_cqe* cqes;
+} uring = {.fd = -1};
+
+static int uring_failed;
+static struct iovec slot_iov[EDGE_ASYNC_SLOTS];
+
+/* Posts io_uring completions into the enclave's completion ring */
+static void*
+uring_reaper(void* arg) {
+  while (1) {
+    if (syscall(
+            __NR_io_uring_enter, uring.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL,
+            0) < 0 &&
+        errno != EINTR)
+      break;
+
+    unsigned head = *uring.cq_head;
+    while (head != __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe* cqe = &uring.cqes[head & *uring.cq_mask];
+      async_post(cqe->user_data, cqe->res);
+      head++;
+    }
+    __atomic_store_n(uring.cq_head, head, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+static int
+uring_init() {
+  struct io_uring_params p;
+  pthread_t reaper;
+  void *sq, *cq;
+
+  memset(&p, 0, sizeof(p));
+  uring.fd = syscall(__NR_io_uring_setup, EDGE_ASYNC_SLOTS, &p);
+  if (uring.fd < 0) return -1;
+
+  sq = mmap(
+      NULL, p.sq_off.array + p.sq_entries * sizeof(unsigned),
+      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd,
+      IORING_OFF_SQ_RING);
+  cq = mmap(
+      NULL, p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe),
+      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd,
+      IORING_OFF_CQ_RING);
+  uring.sqes = mmap(
+      NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQES);
+  if (sq == MAP_FAILED || cq == MAP_FAILED || uring.sqes == MAP_FAILED)
+    goto fail;
+
+  uring.sq_tail  = (unsigned*)((uintptr_t)sq + p.sq_off.tail);
+  uring.sq_mask  = (unsigned*)((uintptr_t)sq + p.sq_off.ring_mask);
+  uring.sq_array = (unsigned*)((uintptr_t)sq + p.sq_off.array);
+  uring.cq_head  = (unsigned*)((uintptr_t)cq + p.cq_off.head);
+  uring.cq_tail  = (unsigned*)((uintptr_t)cq + p.cq_off.tail);
+  uring.cq_mask  = (unsigned*)((uintptr_t)cq + p.cq_off.ring_mask);
+  uring.cqes     = (struct io_uring_cqe*)((uintptr_t)cq + p.cq_off.cqes);
+
+  if (pthread_create(&reaper, NULL, uring_reaper, NULL) != 0) goto fail;
+  pthread_detach(reaper);
+  return 0;
+
+fail:
+  close(uring.fd);
+  uring.fd = -1;
+  return -1;
+}
+
+/* Queues a request on io_uring. Returns 0, or -1 if the caller has to
+ * run it synchronously instead. */
+static int
+uring_queue(struct edge_async_sqe* req, void* data) {
+  if (uring.fd < 0) {
+    if (uring_failed || uring_init() != 0) {
+      uring_failed = 1;
+      return -1;
+    }
+  }
+
+  unsigned tail            = *uring.sq_tail;
+  unsigned idx             = tail & *uring.sq_mask;
+  struct io_uring_sqe* sqe = &uring.sqes[idx];
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->fd        = req->fd;
+  sqe->user_data = req->slot;
+  if (req->op == EDGE_ASYNC_OP_FSYNC) {
+    sqe->opcode = IORING_OP_FSYNC;
+  } else {
+    slot_iov[req->slot].iov_base = data;
+    slot_iov[req->slot].iov_len  = req->len;
+    sqe->opcode =
+        req->op == EDGE_ASYNC_OP_READ ? IORING_OP_READV : IORING_OP_WRITEV;
+    sqe->addr = (uintptr_t)&slot_iov[req->slot];
+    sqe->len  = 1;
+    sqe->off  = req->offset;
+  }
+  uring.sq_array[idx] = idx;
+  __atomic_store_n(uring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  if (syscall(__NR_io_uring_enter, uring.fd, 1, 0, 0, NULL, 0) != 1) {
+    /* take it back, nothing was consumed */
+    __atomic_store_n(uring.sq_tail, tail, __ATOMIC_RELEASE);
+    return -1;
+  }
+  return 0;
+}
+#endif /* EDGE_ASYNC_URING */
+
+static int64_t
+async_run_sync(struct edge_async_sqe* req, void* data) {
+  int64_t ret;
+  switch (req->op) {
+    case EDGE_ASYNC_OP_READ:
+      ret = pread(req->fd, data, req->len, req->offset);
+      break;
+    case EDGE_ASYNC_OP_WRITE:
+      ret = pwrite(req->fd, data, req->len, req->offset);
+      break;
+    default:
+      ret = fsync(req->fd);
+      break;
+  }
+  return ret < 0 ? -errno : ret;
+}
+
+void
+incoming_async_submit(struct edge_call* edge_call) {
+  struct edge_async_submit* args;
+  struct edge_async_area* area;
+  size_t args_size;
+  uintptr_t ptr, ret_ptr;
+  int64_t ret = 0;
+  size_t i;
+
+  if (edge_call_args_ptr(edge_call, (uintptr_t*)&args, &args_size) != 0 ||
+      args_size < sizeof(struct edge_async_submit) ||
+      args->count > EDGE_ASYNC_SLOTS ||
+      args->count > (args_size - sizeof(struct edge_async_submit)) /
+                        sizeof(struct edge_async_sqe) ||
+      edge_call_get_ptr_from_offset(
+          args->area, sizeof(struct edge_async_area), &ptr) != 0)
+    goto submit_error;
+  area = (struct edge_async_area*)ptr;
+
+  pthread_mutex_lock(&async_lock);
+  if (async_area != area && async_inflight != 0) {
+    pthread_mutex_unlock(&async_lock);
+    ret = -EBUSY;
+    goto done;
+  }
+  async_area = area;
+  pthread_mutex_unlock(&async_lock);
+
+  for (i = 0; i < args->count; i++) {
+    struct edge_async_sqe* req = &args->sqes[i];
+    if (req->slot >= EDGE_ASYNC_SLOTS || req->len > EDGE_ASYNC_SLOT_SIZE ||
+        req->op < EDGE_ASYNC_OP_READ || req->op > EDGE_ASYNC_OP_FSYNC) {
+      if (i == 0) ret = -EINVAL;
+      break;
+    }
+
+    pthread_mutex_lock(&async_lock);
+    async_inflight++;
+    pthread_mutex_unlock(&async_lock);
+
+#ifdef EDGE_ASYNC_URING
+    if (uring_queue(req, area->data[req->slot]) == 0) {
+      ret++;
+      continue;
+    }
+#endif /* EDGE_ASYNC_URING */
+    async_post(req->slot, async_run_sync(req, area->data[req->slot]));
+    ret++;
+  }
+
+done:
+  edge_call->return_data.call_status = CALL_STATUS_OK;
+  ret_ptr = edge_call_ret_ptr_after_args(edge_call, sizeof(int64_t));
+  if (!ret_ptr) goto submit_error;
+  *(int64_t*)ret_ptr = ret;
+  if (edge_call_setup_ret(edge_call, (void*)ret_ptr, sizeof(int64_t)) != 0)
+    goto submit_error;
+  return;
+
+submit_error:
+  edge_call->return_data.call_status = CALL_STATUS_SYSCALL_FAILED;
+  return;
+}
+
+void
+incoming_async_wait(struct edge_call* edge_call) {
+  struct edge_async_wait* args;
+  size_t args_size;
+  uintptr_t ptr;
+
+  if (edge_call_args_ptr(edge_call, (uintptr_t*)&args, &args_size) != 0 ||
+      args_size < sizeof(struct edge_async_wait) ||
+      edge_call_get_ptr_from_offset(
+          args->area, sizeof(struct edge_async_area), &ptr) != 0) {
+    edge_call->return_data.call_status = CALL_STATUS_SYSCALL_FAILED;
+    return;
+  }
+
+  pthread_mutex_lock(&async_lock);
+  if (async_area == (struct edge_async_area*)ptr) {
+    while (async_inflight != 0 &&
+           __atomic_load_n(&async_area->cq_tail, __ATOMIC_ACQUIRE) ==
+               __atomic_load_n(&async_area->cq_head, __ATOMIC_ACQUIRE))
+      pthread_cond_wait(&async_posted, &async_lock);
+  }
+  pthread_mutex_unlock(&async_lock);
+
+  edge_call->return_data.call_status   = CALL_STATUS_OK;
+  edge_call->return_data.call_ret_size = 0;
+}
@@ -10,10 +10,26 @@
 uintptr_t _shared_start;
 size_t _shared_len;
 
+/* Slot allocator: slot_count slots at the end of the buffer, each holding
+ * one call header and its data, so several calls can be outstanding (or
+ * nested) at once. The classic call at the front of the buffer owns what
+ * is left before them. */
+static size_t slot_size;
+static size_t slot_count;
+static unsigned long slot_map;
+
 void
 edge_call_init_internals(uintptr_t buffer_start, size_t buffer_len) {
   _shared_start = buffer_start;
   _shared_len   = buffer_len;
+  slot_size     = 0;
+  slot_count    = 0;
+  __atomic_store_n(&slot_map, 0UL, __ATOMIC_RELEASE);
+}
+
+static uintptr_t
+edge_call_slots_start() {
+  return _shared_start + _shared_len - slot_count * slot_size;
 }
 
 int
@@ -37,6 +53,24 @@ edge_call_get_ptr_from_offset(
   return 0;
 }
 
+/* End of the area ptr is in: the buffer, or with slots set up, ptr's
+ * slot or the front area before them */
+static uintptr_t
+edge_call_area_end(uintptr_t ptr) {
+  uintptr_t end = _shared_start + _shared_len;
+  uintptr_t slots;
+
+  if (slot_count) {
+    slots = edge_call_slots_start();
+    if (ptr < slots) {
+      return slots;
+    } else if (ptr < end) {
+      return ptr + slot_size - (ptr - slots) % slot_size;
+    }
+  }
+  return end;
+}
+
 int
 edge_call_check_ptr_valid(uintptr_t ptr, size_t data_len) {
   // TODO double check these checks
@@ -50,14 +84,24 @@ edge_call_check_ptr_valid(uintptr_t ptr, size_t data_len) {
     return 2;
   }
 
-  /* Validate that the end is in range */
-  if (ptr + data_len > _shared_start + _shared_len) {
+  /* Validate that the end is in range, and doesn't run into another
+   * call's slot */
+  if (ptr + data_len > edge_call_area_end(ptr)) {
     return 3;
   }
 
   return 0;
 }
 
+/* Bytes left from ptr to the end of its area, 0 if ptr is outside */
+size_t
+edge_call_room(uintptr_t ptr) {
+  if (edge_call_check_ptr_valid(ptr, 0) != 0) {
+    return 0;
+  }
+  return edge_call_area_end(ptr) - ptr;
+}
+
 int
 edge_call_get_offset_from_ptr(
     uintptr_t ptr, size_t data_len, edge_data_offset* offset) {
@@ -84,6 +128,7 @@ edge_call_ret_ptr(struct edge_call* edge_call, uintptr_t* ptr, size_t* size) {
 
 int
 edge_call_setup_call(struct edge_call* edge_call, void* ptr, size_t size) {
+  edge_call->call_slot_len = edge_call_room((uintptr_t)edge_call);
   edge_call->call_arg_size = size;
   return edge_call_get_offset_from_ptr(
       (uintptr_t)ptr, size, &edge_call->call_arg_offset);
@@ -101,23 +146,23 @@ int
 edge_call_setup_wrapped_ret(
     struct edge_call* edge_call, void* ptr, size_t size) {
   struct edge_data data_wrapper;
+  uintptr_t data = edge_call_data_ptr_of(edge_call);
+
+  if (size > edge_call_data_len_of(edge_call) ||
+      edge_call_data_len_of(edge_call) - size < sizeof(struct edge_data))
+    return -1;
+
   data_wrapper.size = size;
   edge_call_get_offset_from_ptr(
-      _shared_start + sizeof(struct edge_call) + sizeof(struct edge_data),
-      sizeof(struct edge_data), &data_wrapper.offset);
+      data + sizeof(struct edge_data), size, &data_wrapper.offset);
 
-  memcpy(
-      (void*)(_shared_start + sizeof(struct edge_call) + sizeof(struct edge_data)),
-      ptr, size);
+  memcpy((void*)(data + sizeof(struct edge_data)), ptr, size);
 
-  memcpy(
-      (void*)(_shared_start + sizeof(struct edge_call)), &data_wrapper,
-      sizeof(struct edge_data));
+  memcpy((void*)data, &data_wrapper, sizeof(struct edge_data));
 
   edge_call->return_data.call_ret_size = sizeof(struct edge_data);
   return edge_call_get_offset_from_ptr(
-      _shared_start + sizeof(struct edge_call), sizeof(struct edge_data),
-      &edge_call->return_data.call_ret_offset);
+      data, sizeof(struct edge_data), &edge_call->return_data.call_ret_offset);
 }
 
 /* This is temporary until we have a better way to handle multiple things */
@@ -125,3 +170,88 @@ uintptr_t
 edge_call_data_ptr() {
   return _shared_start + sizeof(struct edge_call);
 }
+
+/* Data area of a given call: right behind its header, up to the end of
+ * what the call owns. A header that didn't come from
+ * edge_call_setup_call() gets the rest of the buffer. */
+uintptr_t
+edge_call_data_ptr_of(struct edge_call* edge_call) {
+  return (uintptr_t)edge_call + sizeof(struct edge_call);
+}
+
+size_t
+edge_call_data_len_of(struct edge_call* edge_call) {
+  size_t room = edge_call_room(edge_call_data_ptr_of(edge_call));
+  size_t len  = edge_call->call_slot_len;
+
+  if (len < sizeof(struct edge_call) || len - sizeof(struct edge_call) > room)
+    return room;
+  return len - sizeof(struct edge_call);
+}
+
+/* Where to put size bytes of return data without overwriting the call's
+ * arguments: behind them, inside the call's data area. Returns 0 if
+ * that doesn't fit. */
+uintptr_t
+edge_call_ret_ptr_after_args(struct edge_call* edge_call, size_t size) {
+  uintptr_t data = edge_call_data_ptr_of(edge_call);
+  size_t len     = edge_call_data_len_of(edge_call);
+  uintptr_t args, ret;
+  size_t args_size;
+
+  if (edge_call_args_ptr(edge_call, &args, &args_size) != 0) return 0;
+  ret = args + args_size;
+  ret = (ret + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1);
+
+  if (ret < data) ret = data;
+  if (ret > data + len || size > data + len - ret) return 0;
+  return ret;
+}
+
+/* Sets up count slots of slot_size bytes at the end of the buffer,
+ * dropping any earlier ones. The front call has to keep at least a slot's
+ * worth. Returns the number of slots, 0 if they don't fit. */
+size_t
+edge_call_slots_init(size_t size, size_t count) {
+  size = (size + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1);
+  if (count > EDGE_CALL_SLOT_MAX) count = EDGE_CALL_SLOT_MAX;
+  if (size <= sizeof(struct edge_call) || count == 0 ||
+      _shared_len / size <= count)
+    return 0;
+
+  slot_size  = size;
+  slot_count = count;
+  __atomic_store_n(&slot_map, 0UL, __ATOMIC_RELEASE);
+  return count;
+}
+
+struct edge_call*
+edge_call_slot_alloc() {
+  unsigned long map = __atomic_load_n(&slot_map, __ATOMIC_ACQUIRE);
+  size_t i;
+
+  for (i = 0; i < slot_count; i++) {
+    if (map & (1UL << i)) continue;
+    if (!(__atomic_fetch_or(&slot_map, 1UL << i, __ATOMIC_ACQ_REL) &
+          (1UL << i))) {
+      struct edge_call* edge_call =
+          (struct edge_call*)(edge_call_slots_start() + i * slot_size);
+      memset(edge_call, 0, sizeof(struct edge_call));
+      edge_call->call_slot_len = slot_size;
+      return edge_call;
+    }
+  }
+  return NULL;
+}
+
+void
+edge_call_slot_free(struct edge_call* edge_call) {
+  uintptr_t offset = (uintptr_t)edge_call - edge_call_slots_start();
+  size_t i;
+
+  if (slot_count == 0 || offset % slot_size) return;
+  i = offset / slot_size;
+  if (i >= slot_count) return;
+
+  __atomic_fetch_and(&slot_map, ~(1UL << i), __ATOMIC_RELEASE);
+}
@@ -5,22 +5,58 @@
 #include "edge_call.h"
 
 #ifdef IO_SYSCALL_WRAPPING
+#include "edge_async.h"
 #include "edge_syscall.h"
 #endif /*  IO_SYSCALL_WRAPPING */
 
 edgecallwrapper edge_call_table[MAX_EDGE_CALL];
 
+/* Runs a call the enclave made from a slot, whose header the call at the
+ * front of the buffer points to */
+static void
+incoming_forward(struct edge_call* edge_call) {
+  struct edge_call* target;
+
+  if (edge_call_get_ptr_from_offset(
+          edge_call->call_arg_offset, sizeof(struct edge_call),
+          (uintptr_t*)&target) != 0 ||
+      target == edge_call || target->call_id == EDGECALL_FORWARD) {
+    edge_call->return_data.call_status = CALL_STATUS_BAD_PTR;
+    return;
+  }
+
+  incoming_call_dispatch(target);
+  edge_call->return_data.call_status = CALL_STATUS_OK;
+}
+
 /* Registered handler for incoming edge calls */
 void
 incoming_call_dispatch(void* buffer) {
   struct edge_call* edge_call = (struct edge_call*)buffer;
 
+  if (edge_call->call_id == EDGECALL_FORWARD) {
+    incoming_forward(edge_call);
+    return;
+  }
+
 #ifdef IO_SYSCALL_WRAPPING
   /* If its a syscall handle it specially */
   if (edge_call->call_id == EDGECALL_SYSCALL) {
     incoming_syscall(buffer);
     return;
   }
+  if (edge_call->call_id == EDGECALL_SYSCALL_BATCH) {
+    incoming_syscall_batch(buffer);
+    return;
+  }
+  if (edge_call->call_id == EDGECALL_ASYNC_SUBMIT) {
+    incoming_async_submit(buffer);
+    return;
+  }
+  if (edge_call->call_id == EDGECALL_ASYNC_WAIT) {
+    incoming_async_wait(buffer);
+    return;
+  }
 #endif /*  IO_SYSCALL_WRAPPING */
 
   /* Otherwise try to lookup the call in the table */
@@ -6,25 +6,38 @@
 #include <sys/socket.h>
 #include <sys/select.h>
 #include <sys/sendfile.h>
-// Special edge-call handler for syscall proxying
-void
-incoming_syscall(struct edge_call* edge_call) {
-  struct edge_syscall* syscall_info;
+#include <sys/uio.h>
 
-  size_t args_size;
-
-  if (edge_call_args_ptr(edge_call, (uintptr_t*)&syscall_info, &args_size) != 0)
-    goto syscall_error;
+/* readv/writev straight into/out of the shared buffer segments */
+static int64_t
+proxied_rwv(sargs_SYS_writev* args, int is_write) {
+  struct iovec iov[EDGE_SYSCALL_IOV_MAX];
+  uintptr_t ptr;
+  int i;
 
-  // NOTE: Right now we assume that the args data is safe, even though
-  // it may be changing under us. This should be safer in the future.
+  if (args->iovcnt < 0 || args->iovcnt > EDGE_SYSCALL_IOV_MAX) return -1;
 
-  edge_call->return_data.call_status = CALL_STATUS_OK;
+  for (i = 0; i < args->iovcnt; i++) {
+    if (edge_call_get_ptr_from_offset(
+            args->iov[i].offset, args->iov[i].size, &ptr) != 0)
+      return -1;
+    iov[i].iov_base = (void*)ptr;
+    iov[i].iov_len  = args->iov[i].size;
+  }
 
+  if (is_write) return writev(args->fd, iov, args->iovcnt);
+  return readv(args->fd, iov, args->iovcnt);
+}
+/* Executes a single proxied syscall record. Returns 0 and stores the
+ * syscall's return value in *retp, or -1 if the syscall is not handled. */
+static int
+dispatch_syscall(struct edge_syscall* syscall_info, int64_t* retp) {
   int64_t ret;
-  int is_str_ret = 0; 
   char* retbuf;
 
+  // NOTE: Right now we assume that the args data is safe, even though
+  // it may be changing under us. This should be safer in the future.
+
   // Right now we only handle some io syscalls. See runtime for how
   // others are handled.
   switch (syscall_info->syscall_num) {
@@ -60,7 +73,8 @@ incoming_syscall(struct edge_call* edge_call) {
     case (SYS_getcwd):;  // TODO: how to handle string return 
       sargs_SYS_getcwd* getcwd_args = (sargs_SYS_getcwd*)syscall_info->data;
 			retbuf = getcwd(getcwd_args->buf, getcwd_args->size);
-      is_str_ret = 1;
+      // the runtime gets the host pointer back (see io_syscall_getcwd)
+      ret = (int64_t)(uintptr_t)retbuf;
 			break;
     case (SYS_write):;
       sargs_SYS_write* write_args = (sargs_SYS_write*)syscall_info->data;
@@ -189,22 +203,85 @@ incoming_syscall(struct edge_call* edge_call) {
       sigset_t *sigmask = pselect_args->sigmask_is_null ? NULL : &pselect_args->sigmask; 
       ret = pselect(pselect_args->nfds, readfds, writefds, exceptfds, timeout, sigmask);
       break;
+    case (SYS_writev):;
+      sargs_SYS_writev* writev_args = (sargs_SYS_writev*)syscall_info->data;
+      ret = proxied_rwv(writev_args, 1);
+      break;
+    case (SYS_readv):;
+      sargs_SYS_readv* readv_args = (sargs_SYS_readv*)syscall_info->data;
+      ret = proxied_rwv(readv_args, 0);
+      break;
     default:
-      goto syscall_error;
+      return -1;
   }
 
-  /* Setup return value */
-  void* ret_data_ptr      = (void*)edge_call_data_ptr();
-  if (is_str_ret) {
-    *(char**) ret_data_ptr = retbuf; // TODO: check ptr stuff
-    if (edge_call_setup_ret(edge_call, ret_data_ptr, sizeof(int64_t)) != 0)
-      goto syscall_error;
-  } else {
-    *(int64_t*)ret_data_ptr = ret;
-    if (edge_call_setup_ret(edge_call, ret_data_ptr, sizeof(int64_t)) != 0)
-      goto syscall_error;
+  *retp = ret;
+  return 0;
+}
+
+// Special edge-call handler for syscall proxying
+void
+incoming_syscall(struct edge_call* edge_call) {
+  struct edge_syscall* syscall_info;
+  size_t args_size;
+  int64_t ret;
+
+  if (edge_call_args_ptr(edge_call, (uintptr_t*)&syscall_info, &args_size) != 0)
+    goto syscall_error;
+
+  edge_call->return_data.call_status = CALL_STATUS_OK;
+
+  if (dispatch_syscall(syscall_info, &ret) != 0)
+    goto syscall_error;
+
+  /* Setup return value behind the arguments; if they fill the call's
+   * area, they are done with by now */
+  void* ret_data_ptr =
+      (void*)edge_call_ret_ptr_after_args(edge_call, sizeof(int64_t));
+  if (!ret_data_ptr) ret_data_ptr = (void*)edge_call_data_ptr_of(edge_call);
+  *(int64_t*)ret_data_ptr = ret;
+  if (edge_call_setup_ret(edge_call, ret_data_ptr, sizeof(int64_t)) != 0)
+    goto syscall_error;
+
+  return;
+
+syscall_error:
+  edge_call->return_data.call_status = CALL_STATUS_SYSCALL_FAILED;
+  return;
+}
+
+// Handler for a batch of syscall records sent with a single edge call.
+// Records are executed in order and each result is stored in its entry,
+// so the batch itself is the return data.
+void
+incoming_syscall_batch(struct edge_call* edge_call) {
+  struct edge_syscall_batch* batch;
+  size_t args_size;
+  size_t i;
+
+  if (edge_call_args_ptr(edge_call, (uintptr_t*)&batch, &args_size) != 0)
+    goto syscall_error;
+
+  if (args_size < sizeof(struct edge_syscall_batch) ||
+      batch->count > (args_size - sizeof(struct edge_syscall_batch)) /
+                         sizeof(struct edge_syscall_batch_entry))
+    goto syscall_error;
+
+  edge_call->return_data.call_status = CALL_STATUS_OK;
+
+  for (i = 0; i < batch->count; i++) {
+    struct edge_syscall_batch_entry* entry = &batch->entries[i];
+    uintptr_t record;
+    if (entry->size < sizeof(struct edge_syscall) ||
+        edge_call_get_ptr_from_offset(entry->offset, entry->size, &record) !=
+            0 ||
+        dispatch_syscall((struct edge_syscall*)record, &entry->ret) != 0)
+      entry->ret = -1;
   }
 
+  if (edge_call_setup_ret(edge_call, batch, args_size) != 0)
+    goto syscall_error;
+
   return;
 
 syscall_error:
@@ -5,38 +5,78 @@
 #include "ElfFile.hpp"
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <cstring>
+#include <map>
+#include <mutex>
 
 namespace Keystone {
 
-static size_t
-fstatFileSize(int filep) {
-  int rc;
-  struct stat stat_buf;
-  rc = fstat(filep, &stat_buf);
-  return (rc == 0 ? stat_buf.st_size : 0);
-}
+struct ElfFile::Mapping {
+  void* ptr;
+  size_t size;
+  ~Mapping() { munmap(ptr, size); }
+};
+
+/* guarded by cacheLock */
+static std::mutex cacheLock;
+static std::map<ElfFileKey, std::shared_ptr<ElfFile::Mapping>> cache;
 
 ElfFile::ElfFile(std::string filename) {
   fileSize = 0;
   ptr      = NULL;
-  filep    = open(filename.c_str(), O_RDONLY);
+  int filep = open(filename.c_str(), O_RDONLY);
 
   if (filep < 0) {
     ERROR("file does not exist - %s", filename.c_str());
     return;
   }
 
-  fileSize = fstatFileSize(filep);
-  if (!fileSize) {
+  struct stat stat_buf;
+  if (fstat(filep, &stat_buf) != 0 || stat_buf.st_size == 0) {
     ERROR("invalid file size - %s", filename.c_str());
+    close(filep);
+    return;
   }
+  key.dev       = stat_buf.st_dev;
+  key.ino       = stat_buf.st_ino;
+  key.mtimeSec  = stat_buf.st_mtim.tv_sec;
+  key.mtimeNsec = stat_buf.st_mtim.tv_nsec;
+  key.size      = stat_buf.st_size;
 
-  ptr = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, filep, 0);
-
-  if (!ptr) {
-    ERROR("mmap failed for %s", filename.c_str());
+  std::lock_guard<std::mutex> guard(cacheLock);
+  auto it = cache.find(key);
+  if (it != cache.end()) {
+    mapping = it->second;
+  } else {
+    void* map = mmap(
+        NULL, stat_buf.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, filep,
+        0);
+    if (map == MAP_FAILED) {
+      ERROR("mmap failed for %s", filename.c_str());
+      close(filep);
+      return;
+    }
+    mapping.reset(new Mapping());
+    mapping->ptr  = map;
+    mapping->size = stat_buf.st_size;
+    cache[key]    = mapping;
   }
-    /* preparation for libelf */
+  close(filep);
+
+  ptr      = mapping->ptr;
+  fileSize = mapping->size;
+  parse();
+}
+
+ElfFile::ElfFile(const void* buffer, size_t size) {
+  ptr      = const_cast<void*>(buffer);
+  fileSize = size;
+  parse();
+}
+
+void
+ElfFile::parse() {
+  /* preparation for libelf */
   if (elf_newFile(ptr, fileSize, &elf)) {
     return;
   }
@@ -51,9 +91,129 @@ ElfFile::ElfFile(std::string filename) {
   maxVaddr = ROUND_UP(maxVaddr, PAGE_BITS);
 }
 
-ElfFile::~ElfFile() {
-  close(filep);
-  munmap(ptr, fileSize);
+void
+ElfFile::clearCache() {
+  std::lock_guard<std::mutex> guard(cacheLock);
+  for (auto it = cache.begin(); it != cache.end();) {
+    if (it->second.use_count() == 1) {
+      it = cache.erase(it);
+    } else {
+      ++it;
+    }
+  }
 }
 
+/* Lays out the PT_LOAD contents back to back, each at an offset that is
+ * congruent to its vaddr modulo the page size, because the Eyrie loaders
+ * map file pages in place. Segments that overlap the ELF and program
+ * headers keep their offset. Other program headers are rebased into the
+ * segment that holds them, or emptied. A single null section header is
+ * kept so that elf_newFile() accepts the result. */
+template <typename Ehdr, typename Phdr, typename Shdr>
+static bool
+extractLoadableSegments(
+    const unsigned char* file, size_t size, std::vector<unsigned char>* out) {
+  const Ehdr* ehdr = (const Ehdr*)file;
+  size_t phEnd     = ehdr->e_phoff + (size_t)ehdr->e_phnum * sizeof(Phdr);
+  if (ehdr->e_phentsize != sizeof(Phdr) || phEnd > size) {
+    return false;
+  }
+
+  std::vector<Phdr> phdrs(
+      (const Phdr*)(file + ehdr->e_phoff),
+      (const Phdr*)(file + ehdr->e_phoff) + ehdr->e_phnum);
+  std::vector<size_t> offsets(phdrs.size(), 0);
+  size_t cursor = phEnd;
+
+  out->assign(file, file + phEnd);
+  /* segments holding the headers first, so nothing gets placed there */
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t i = 0; i < phdrs.size(); i++) {
+      const Phdr& ph = phdrs[i];
+      if (ph.p_type != PT_LOAD || (ph.p_offset < phEnd) != (pass == 0)) {
+        continue;
+      }
+      if (ph.p_offset + ph.p_filesz > size) {
+        return false;
+      }
+
+      size_t offset = ph.p_offset;
+      if (pass == 1) {
+        offset = cursor +
+                 (ph.p_offset % PAGE_SIZE + PAGE_SIZE - cursor % PAGE_SIZE) %
+                     PAGE_SIZE;
+      }
+      if (out->size() < offset + ph.p_filesz) {
+        out->resize(offset + ph.p_filesz, 0);
+      }
+      memcpy(out->data() + offset, file + ph.p_offset, ph.p_filesz);
+      offsets[i] = offset;
+      if (cursor < offset + ph.p_filesz) {
+        cursor = offset + ph.p_filesz;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < phdrs.size(); i++) {
+    Phdr& ph = phdrs[i];
+    if (ph.p_type == PT_LOAD) {
+      continue;
+    }
+    if (ph.p_offset + ph.p_filesz <= phEnd) {
+      offsets[i] = ph.p_offset;
+      continue;
+    }
+    bool placed = false;
+    for (size_t j = 0; j < phdrs.size() && !placed; j++) {
+      const Phdr& load = phdrs[j];
+      if (load.p_type == PT_LOAD && ph.p_offset >= load.p_offset &&
+          ph.p_offset + ph.p_filesz <= load.p_offset + load.p_filesz) {
+        offsets[i] = offsets[j] + (ph.p_offset - load.p_offset);
+        placed     = true;
+      }
+    }
+    if (!placed) {
+      ph.p_filesz = 0;
+    }
+  }
+  for (size_t i = 0; i < phdrs.size(); i++) {
+    phdrs[i].p_offset = offsets[i];
+  }
+
+  size_t shOff = ROUND_UP(out->size(), 3);
+  out->resize(shOff + sizeof(Shdr), 0);
+
+  Ehdr* newEhdr        = (Ehdr*)out->data();
+  newEhdr->e_shoff     = shOff;
+  newEhdr->e_shentsize = sizeof(Shdr);
+  newEhdr->e_shnum     = 1;
+  newEhdr->e_shstrndx  = SHN_UNDEF;
+  memcpy(
+      out->data() + ehdr->e_phoff, phdrs.data(), phdrs.size() * sizeof(Phdr));
+  return true;
+}
+
+bool
+ElfFile::extractLoadable() {
+  elf_t file;
+  if (ptr == NULL || elf_newFile(ptr, fileSize, &file)) {
+    return false;
+  }
+
+  bool ok;
+  if (file.elfClass == ELFCLASS64) {
+    ok = extractLoadableSegments<Elf64_Ehdr, Elf64_Phdr, Elf64_Shdr>(
+        (const unsigned char*)ptr, fileSize, &loadable);
+  } else {
+    ok = extractLoadableSegments<Elf32_Ehdr, Elf32_Phdr, Elf32_Shdr>(
+        (const unsigned char*)ptr, fileSize, &loadable);
+  }
+  if (!ok) {
+    loadable.clear();
+  }
+  return ok;
+}
+
+ElfFile::~ElfFile() {}
+
 }  // namespace Keystone
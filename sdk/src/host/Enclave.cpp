@@ -4,59 +4,154 @@
 //------------------------------------------------------------------------------
 #include "Enclave.hpp"
 #include <math.h>
+#include <stdio.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 extern "C" {
 #include "common/sha3.h"
+#include "shared/eyrie_layout.h"
+#include "shared/eyrie_prelink.h"
 #include "shared/keystone_user.h"
 }
 #include "ElfFile.hpp"
+#include "edge/edge_switchless.h"
 #include "hash_util.hpp"
 
 namespace Keystone {
 
+/* Host side of a checkpoint file, followed by the SM's encrypted image
+ * and a plain copy of the untrusted buffer */
+#define CHECKPOINT_FILE_MAGIC 0x31304b434b53454bULL /* "KESKCK01" */
+
+struct checkpoint_file_header {
+  uint64_t magic;
+  uint64_t epm_pages;
+  uint64_t utm_size;
+  uint64_t image_size;
+};
+
 Enclave::Enclave() {
+  pMemory            = NULL;
+  pDevice            = NULL;
+  shared_buffer      = NULL;
+  shared_buffer_size = 0;
+  oFuncDispatch      = NULL;
+  restored           = false;
 }
 
 Enclave::~Enclave() {
   destroy();
 }
 
-uint64_t
-calculate_required_pages(ElfFile** elfFiles, size_t numElfFiles) {
-  uint64_t req_pages = 0;
+/* Follows what map_page() and alloc_page_generic() do to the enclave page
+ * tables, without the memory: which leaves get mapped and which tables
+ * get allocated. The root table is the loader's and is not counted. */
+class PageTableModel {
+ public:
+  /* maps the page at level that holds va; false if it was mapped */
+  bool map(uintptr_t va, int level) {
+    for (int lvl = 2; lvl <= level; lvl++) {
+      tables.insert(std::make_pair(lvl, va >> PT_LEVEL_BITS(lvl - 1)));
+    }
+    return leaves.insert(std::make_pair(level, va >> PT_LEVEL_BITS(level))).second;
+  }
+  size_t getTables() { return tables.size(); }
+
+ private:
+  std::set<std::pair<int, uintptr_t>> tables;
+  std::set<std::pair<int, uintptr_t>> leaves;
+};
+
+/* Pages that loadElf() allocates for file: whole file pages are mapped
+ * in place, partial pages and .bss are copied to free memory. */
+static uint64_t
+modelLoadElf(ElfFile* file, PageTableModel* pt) {
+  elf_t elf;
+  if (elf_newFile(file->getPtr(), file->getFileSize(), &elf)) {
+    return 0;
+  }
+
+  uint64_t count = 0;
+  for (size_t i = 0; i < elf_getNumProgramHeaders(&elf); i++) {
+    if (elf_getProgramHeaderType(&elf, i) != PT_LOAD) {
+      continue;
+    }
+    uintptr_t va      = elf_getProgramHeaderVaddr(&elf, i);
+    uintptr_t fileEnd = va + elf_getProgramHeaderFileSize(&elf, i);
+    uintptr_t memEnd  = va + elf_getProgramHeaderMemorySize(&elf, i);
+
+    if (va % PAGE_SIZE) {
+      count += pt->map(va, PT_LEVELS);
+      va = PAGE_DOWN(va) + PAGE_SIZE;
+    }
+    for (; va + PAGE_SIZE <= fileEnd; va += PAGE_SIZE) {
+      pt->map(va, PT_LEVELS);
+    }
+    for (; va < memEnd; va += PAGE_SIZE) {
+      count += pt->map(va, PT_LEVELS);
+    }
+  }
+  return count;
+}
+
+/* Replays the loader and eyrie_boot for this layout. runtime and eapp are
+ * NULL for a prelinked image of prelinkedSize bytes, whose loaded pages
+ * and tables are part of the file. */
+EpmBreakdown
+calculate_epm_breakdown(
+    Params params, ElfFile* loader, ElfFile* runtime, ElfFile* eapp,
+    size_t prelinkedSize) {
+  EpmBreakdown epm = EpmBreakdown();
+  PageTableModel pt;
+
+  epm.filePages = PAGE_UP(loader->getFileSize()) / PAGE_SIZE +
+                  PAGE_UP(prelinkedSize) / PAGE_SIZE;
+  if (runtime != NULL && eapp != NULL) {
+    epm.filePages += PAGE_UP(runtime->getFileSize()) / PAGE_SIZE +
+                     PAGE_UP(eapp->getFileSize()) / PAGE_SIZE;
+  }
 
-  for (int i = 0; i < numElfFiles; i++) {
-    ElfFile* elfFile = elfFiles[i];
-    req_pages += ceil(elfFile->getFileSize() / PAGE_SIZE);
+  /* loader: the runtime and the UTM; the EPM itself is mapped with the
+   * loader's own tables */
+  if (runtime != NULL) {
+    epm.loadedPages += modelLoadElf(runtime, &pt);
+  }
+  for (uintptr_t va = 0; va < params.getUntrustedSize(); va += PAGE_SIZE) {
+    pt.map(DEFAULT_UNTRUSTED_PTR + va, PT_LEVELS);
   }
-  /* FIXME: calculate the required number of pages for the page table.
-   * We actually don't know how many page tables the enclave might need,
-   * because the SDK never knows how its memory will be aligned.
-   * Ideally, this should be managed by the driver.
-   * For now, we naively allocate enough pages so that we can temporarily get
-   * away from this problem.
-   * 15 pages will be more than sufficient to cover several hundreds of
-   * megabytes of enclave/runtime. */
-  /* FIXME Part 2: now that loader does loading, .bss sections also eat up
-   * space. Eapp dev must make FREEMEM big enough to fit this!!
-   * Possible fix -- re-add exact .bss calculations?
-   */
 
-  /* Add one page each for bss segments of runtime and eapp */ 
-  // TODO: add space for stack?
-  req_pages += 16;
-  return req_pages;
+  /* eyrie_boot: the eapp and the top of the stack, always with 4 KiB
+   * pages. The rest of the stack and larger pages only come later, out of
+   * free memory, when they are touched. */
+  if (eapp != NULL) {
+    epm.loadedPages += modelLoadElf(eapp, &pt);
+  }
+  for (uintptr_t va =
+           EYRIE_USER_STACK_START - EYRIE_USER_STACK_BOOT_PAGES * PAGE_SIZE;
+       va < EYRIE_USER_STACK_START; va += PAGE_SIZE) {
+    pt.map(va, PT_LEVELS);
+  }
+  epm.stackPages     = EYRIE_USER_STACK_BOOT_PAGES;
+  epm.pageTablePages = pt.getTables();
+
+  epm.freePages = PAGE_UP(params.getFreeMemSize()) / PAGE_SIZE;
+
+  /* the runtime's page allocator takes its metadata out of free memory,
+   * for the free pages and for the metadata pages themselves */
+  size_t perPage = PAGE_SIZE / EYRIE_FREEMEM_META_PER_PAGE;
+  epm.allocatorPages = (epm.freePages + perPage - 2) / (perPage - 1);
+  return epm;
 }
 
 bool
-Enclave::prepareEnclaveMemory(size_t requiredPages, uintptr_t alternatePhysAddr) {
-  // FIXME: this will be deprecated with complete freemem support.
-  // We just add freemem size for now.
-  uint64_t minPages;
-  minPages = ROUND_UP(params.getFreeMemSize(), PAGE_BITS) / PAGE_SIZE; 
-  minPages += requiredPages;
-
+Enclave::prepareEnclaveMemory(size_t minPages, uintptr_t alternatePhysAddr) {
   /* Call Enclave Driver */
   if (pDevice->create(minPages) != Error::Success) {
     return false;
@@ -76,34 +171,27 @@ Enclave::prepareEnclaveMemory(size_t requiredPages, uintptr_t alternatePhysAddr)
 
 void
 Enclave::copyFile(uintptr_t filePtr, size_t fileSize) {
-	uintptr_t startOffset = pMemory->getCurrentOffset(); 
-  size_t bytesRemaining = fileSize; 
-	
-	uintptr_t currOffset;
-	while (bytesRemaining > 0) {
-		currOffset = pMemory->getCurrentOffset(); 
-    pMemory->incrementEPMFreeList();
-
-		size_t bytesToWrite = (bytesRemaining > PAGE_SIZE) ? PAGE_SIZE : bytesRemaining;
-		size_t bytesWritten = fileSize - bytesRemaining;
-
-    // need 0 padding for hashes to be consistent,
-    // and to keep code aligned to be able to map page-wise without copying.
-    if (bytesToWrite < PAGE_SIZE) {
-      char page[PAGE_SIZE];
-      memset(page, 0, PAGE_SIZE);
-      memcpy(page, (const void*) (filePtr + bytesWritten), (size_t)(bytesToWrite));
-      pMemory->writeMem((uintptr_t) page, currOffset, PAGE_SIZE);
-    } else {
-		  pMemory->writeMem(filePtr + bytesWritten, currOffset, bytesToWrite);
-    }
-		bytesRemaining -= bytesToWrite;
-	}
+  uintptr_t startOffset = pMemory->allocPages(fileSize);
+  size_t fullBytes      = fileSize & ~(PAGE_SIZE - 1);
+  size_t tailBytes      = fileSize - fullBytes;
+
+  /* all whole pages go in with a single copy */
+  if (fullBytes) {
+    pMemory->writeMem(filePtr, startOffset, fullBytes);
+  }
+
+  // need 0 padding for hashes to be consistent,
+  // and to keep code aligned to be able to map page-wise without copying.
+  if (tailBytes) {
+    char page[PAGE_SIZE];
+    memset(page, 0, PAGE_SIZE);
+    memcpy(page, (const void*)(filePtr + fullBytes), tailBytes);
+    pMemory->writeMem((uintptr_t)page, startOffset + fullBytes, PAGE_SIZE);
+  }
 }
 
-static void measureElfFile(hash_ctx_t* hash_ctx, ElfFile* file) {
-  uintptr_t fptr = (uintptr_t) file->getPtr();
-  uintptr_t fend = fptr + (uintptr_t) file->getFileSize();
+static void measureBuffer(hash_ctx_t* hash_ctx, uintptr_t fptr, size_t size) {
+  uintptr_t fend = fptr + size;
 
   for (; fptr < fend; fptr += PAGE_SIZE) {
     if (fend - fptr < PAGE_SIZE) {
@@ -117,25 +205,125 @@ static void measureElfFile(hash_ctx_t* hash_ctx, ElfFile* file) {
   }
 }
 
+static void measureElfFile(hash_ctx_t* hash_ctx, ElfFile* file) {
+  measureBuffer(hash_ctx, (uintptr_t) file->getPtr(), file->getFileSize());
+}
+
+/* Reads an image written by Prelinker::build() and checks that its
+ * header describes it */
+static bool readPrelinkedImage(const char* path, std::vector<unsigned char>* image) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    PERROR("cannot open prelinked image");
+    return false;
+  }
+  bool valid = fseek(file, 0, SEEK_END) == 0;
+  long size  = ftell(file);
+  valid      = valid && size >= (long) PAGE_SIZE && fseek(file, 0, SEEK_SET) == 0;
+  if (valid) {
+    image->resize(size);
+    valid = fread(image->data(), 1, image->size(), file) == image->size();
+  }
+  fclose(file);
+
+  struct eyrie_prelink* hdr = (struct eyrie_prelink*) image->data();
+  valid = valid && hdr->magic == EYRIE_PRELINK_MAGIC &&
+          hdr->version == EYRIE_PRELINK_VERSION &&
+          hdr->image_size == image->size() &&
+          IS_ALIGNED(hdr->image_size, PAGE_SIZE) &&
+          IS_ALIGNED(hdr->user_offset, PAGE_SIZE) &&
+          hdr->user_offset > 0 && hdr->user_offset < hdr->image_size;
+  if (!valid) {
+    ERROR("invalid prelinked image %s", path);
+  }
+  return valid;
+}
+
 Error
-Enclave::measure(char* hash, const char* eapppath, const char* runtimepath, const char* loaderpath) {
+Enclave::measure(
+    char* hash, const char* eapppath, const char* runtimepath, const char* loaderpath,
+    bool loadableOnly) {
+  ElfFile loader(loaderpath);
+  ElfFile runtime(runtimepath);
+  ElfFile eapp(eapppath);
+
+  return measure(hash, &eapp, &runtime, &loader, loadableOnly);
+}
+
+/* measurements of file-backed images, by file identity */
+typedef std::tuple<ElfFileKey, ElfFileKey, ElfFileKey, bool> MeasurementKey;
+static std::mutex measurementLock;
+static std::map<MeasurementKey, std::string> measurements;
+
+Error
+Enclave::measure(
+    char* hash, ElfFile* eapp, ElfFile* runtime, ElfFile* loader, bool loadableOnly) {
+  if (loader->getPtr() == NULL || runtime->getPtr() == NULL || eapp->getPtr() == NULL) {
+    return Error::FileInitFailure;
+  }
+
+  /* files stripped by the caller do not match their key */
+  bool cacheable = loader->getKey() && runtime->getKey() && eapp->getKey() &&
+                   (loadableOnly || (!runtime->isLoadableOnly() && !eapp->isLoadableOnly()));
+  MeasurementKey key;
+  if (cacheable) {
+    key = std::make_tuple(*loader->getKey(), *runtime->getKey(), *eapp->getKey(), loadableOnly);
+    std::lock_guard<std::mutex> guard(measurementLock);
+    auto it = measurements.find(key);
+    if (it != measurements.end()) {
+      memcpy(hash, it->second.data(), MDSIZE);
+      return Error::Success;
+    }
+  }
+
+  if (loadableOnly && (!runtime->extractLoadable() || !eapp->extractLoadable())) {
+    return Error::ELFLoadFailure;
+  }
+
   hash_ctx_t hash_ctx;
   hash_init(&hash_ctx);
 
-  ElfFile* loader = new ElfFile(loaderpath);
-  ElfFile* runtime = new ElfFile(runtimepath);
-  ElfFile* eapp = new ElfFile(eapppath);
-
   uintptr_t sizes[3] = { PAGE_UP(loader->getFileSize()), PAGE_UP(runtime->getFileSize()),
                           PAGE_UP(eapp->getFileSize()) };
   hash_extend(&hash_ctx, (void*) sizes, sizeof(sizes));
 
   measureElfFile(&hash_ctx, loader);
-  delete loader;
   measureElfFile(&hash_ctx, runtime);
-  delete runtime;
   measureElfFile(&hash_ctx, eapp);
-  delete eapp;
+
+  hash_finalize(hash, &hash_ctx);
+
+  if (cacheable) {
+    std::lock_guard<std::mutex> guard(measurementLock);
+    measurements[key] = std::string(hash, MDSIZE);
+  }
+  return Error::Success;
+}
+
+/* The SM hashes the region sizes and pages between runtime_base and
+ * free_base, so a prelinked image is measured like the files it replaces */
+Error
+Enclave::measurePrelinked(char* hash, const char* imagepath, const char* loaderpath) {
+  std::vector<unsigned char> image;
+  if (!readPrelinkedImage(imagepath, &image)) {
+    return Error::FileInitFailure;
+  }
+  struct eyrie_prelink* hdr = (struct eyrie_prelink*) image.data();
+
+  ElfFile loader(loaderpath);
+  if (loader.getPtr() == NULL) {
+    return Error::FileInitFailure;
+  }
+
+  hash_ctx_t hash_ctx;
+  hash_init(&hash_ctx);
+
+  uintptr_t sizes[3] = { PAGE_UP(loader.getFileSize()), hdr->user_offset,
+                          hdr->image_size - hdr->user_offset };
+  hash_extend(&hash_ctx, (void*) sizes, sizeof(sizes));
+
+  measureElfFile(&hash_ctx, &loader);
+  measureBuffer(&hash_ctx, (uintptr_t) image.data(), image.size());
 
   hash_finalize(hash, &hash_ctx);
 
@@ -151,24 +339,44 @@ Error
 Enclave::init(
     const char* eapppath, const char* runtimepath, const char* loaderpath, Params _params,
     uintptr_t alternatePhysAddr) {
+  ElfFile enclaveFile(eapppath);
+  ElfFile runtimeFile(runtimepath);
+  ElfFile loaderFile(loaderpath);
+
+  return init(&enclaveFile, &runtimeFile, &loaderFile, _params, alternatePhysAddr);
+}
+
+Error
+Enclave::init(
+    ElfFile* enclaveFile, ElfFile* runtimeFile, ElfFile* loaderFile, Params _params,
+    uintptr_t alternatePhysAddr) {
   params = _params;
 
+  if (loaderFile->getPtr() == NULL || runtimeFile->getPtr() == NULL ||
+      enclaveFile->getPtr() == NULL) {
+    return Error::FileInitFailure;
+  }
+
   pMemory = new PhysicalEnclaveMemory();
   pDevice = new KeystoneDevice();
 
-  ElfFile* enclaveFile = new ElfFile(eapppath);
-  ElfFile* runtimeFile = new ElfFile(runtimepath);
-  ElfFile* loaderFile = new ElfFile(loaderpath);
-
   if (!pDevice->initDevice(params)) {
     destroy();
     return Error::DeviceInitFailure;
   }
 
-  ElfFile* elfFiles[3] = {enclaveFile, runtimeFile, loaderFile};
-  size_t requiredPages = calculate_required_pages(elfFiles, 3);
+  /* the EPM gets the stripped copies; the loader is a flat binary */
+  if (params.getLoadableOnly() &&
+      (!enclaveFile->extractLoadable() || !runtimeFile->extractLoadable())) {
+    ERROR("failed to extract the loadable segments");
+    destroy();
+    return Error::ELFLoadFailure;
+  }
 
-  if (!prepareEnclaveMemory(requiredPages, alternatePhysAddr)) {
+  params.setEpmBreakdown(
+      calculate_epm_breakdown(params, loaderFile, runtimeFile, enclaveFile));
+
+  if (!prepareEnclaveMemory(params.getEpmBreakdown().total(), alternatePhysAddr)) {
     destroy();
     return Error::DeviceError;
   }
@@ -188,9 +396,13 @@ Enclave::init(
   copyFile((uintptr_t) enclaveFile->getPtr(), enclaveFile->getFileSize());
 
   pMemory->startFreeMem();
+
+  /* the EPM must not stay mapped in the host once the enclave is sealed */
+  pMemory->endStaging();
   if (pDevice->finalize(
           pMemory->getRuntimePhysAddr(), pMemory->getEappPhysAddr(),
-          pMemory->getFreePhysAddr(), params.getFreeMemSize()) != Error::Success) {
+          pMemory->getFreePhysAddr(), params.getFreeMemSize(),
+          params.getTimeslice(), params.getResettable()) != Error::Success) {
     destroy();
     return Error::DeviceError;
   }
@@ -201,11 +413,141 @@ Enclave::init(
     destroy();
     return Error::DeviceMemoryMapError;
   }
+  return Error::Success;
+}
 
-  /* ELF files are no longer needed */
-  delete enclaveFile;
-  delete runtimeFile;
-  delete loaderFile;
+/* Fills in params' EPM breakdown for this enclave without creating it */
+Error
+Enclave::calculateEpm(
+    const char* eapppath, const char* runtimepath, const char* loaderpath, Params* params) {
+  ElfFile loader(loaderpath);
+  ElfFile runtime(runtimepath);
+  ElfFile eapp(eapppath);
+
+  if (loader.getPtr() == NULL || runtime.getPtr() == NULL || eapp.getPtr() == NULL) {
+    return Error::FileInitFailure;
+  }
+  if (params->getLoadableOnly() && (!eapp.extractLoadable() || !runtime.extractLoadable())) {
+    return Error::ELFLoadFailure;
+  }
+  params->setEpmBreakdown(calculate_epm_breakdown(*params, &loader, &runtime, &eapp));
+  return Error::Success;
+}
+
+/* Like init(), with the runtime and the eapp taken from an image built
+ * by Prelinker::build(). The loader finds the prebuilt page tables in it
+ * and the runtime does not parse or load any ELF file. */
+Error
+Enclave::initPrelinked(const char* imagepath, const char* loaderpath, Params _params) {
+  std::vector<unsigned char> image;
+  if (!readPrelinkedImage(imagepath, &image)) {
+    return Error::FileInitFailure;
+  }
+  struct eyrie_prelink* hdr = (struct eyrie_prelink*) image.data();
+
+  ElfFile loaderFile(loaderpath);
+  if (loaderFile.getPtr() == NULL) {
+    return Error::FileInitFailure;
+  }
+
+  params = _params;
+
+  pMemory = new PhysicalEnclaveMemory();
+  pDevice = new KeystoneDevice();
+
+  if (!pDevice->initDevice(params)) {
+    destroy();
+    return Error::DeviceInitFailure;
+  }
+
+  /* .bss and the runtime and eapp page tables are part of the image */
+  params.setEpmBreakdown(
+      calculate_epm_breakdown(params, &loaderFile, NULL, NULL, image.size()));
+
+  if (!prepareEnclaveMemory(params.getEpmBreakdown().total(), 0)) {
+    destroy();
+    return Error::DeviceError;
+  }
+  if (!pMemory->allocUtm(params.getUntrustedSize())) {
+    ERROR("failed to init untrusted memory - ioctl() failed");
+    destroy();
+    return Error::DeviceError;
+  }
+
+  copyFile((uintptr_t) loaderFile.getPtr(), loaderFile.getFileSize());
+
+  pMemory->startRuntimeMem();
+  copyFile((uintptr_t) image.data(), hdr->user_offset);
+
+  pMemory->startEappMem();
+  copyFile((uintptr_t) image.data() + hdr->user_offset, hdr->image_size - hdr->user_offset);
+
+  pMemory->startFreeMem();
+
+  pMemory->endStaging();
+  if (pDevice->finalize(
+          pMemory->getRuntimePhysAddr(), pMemory->getEappPhysAddr(),
+          pMemory->getFreePhysAddr(), params.getFreeMemSize(),
+          params.getTimeslice(), params.getResettable()) != Error::Success) {
+    destroy();
+    return Error::DeviceError;
+  }
+  if (!mapUntrusted(params.getUntrustedSize())) {
+    ERROR(
+        "failed to finalize enclave - cannot obtain the untrusted buffer "
+        "pointer \n");
+    destroy();
+    return Error::DeviceMemoryMapError;
+  }
+  return Error::Success;
+}
+
+/* Creates this enclave as a copy of tmpl, which must be initialized and
+ * not run yet. The SM copies the template's EPM and keeps its hash, so no
+ * ELF file is loaded or measured. The clone gets its own UTM. */
+Error
+Enclave::cloneFrom(const Enclave& tmpl) {
+  if (tmpl.pMemory == NULL || tmpl.pDevice == NULL) {
+    return Error::InvalidEnclave;
+  }
+
+  params  = tmpl.params;
+  pMemory = new PhysicalEnclaveMemory();
+  pDevice = new KeystoneDevice();
+
+  if (!pDevice->initDevice(params)) {
+    destroy();
+    return Error::DeviceInitFailure;
+  }
+
+  /* same EPM size, the SM relies on it to keep the template's layout */
+  size_t epmPages = tmpl.pMemory->getEpmSize() / PAGE_SIZE;
+  if (pDevice->create(epmPages) != Error::Success) {
+    destroy();
+    return Error::DeviceError;
+  }
+  pMemory->init(pDevice, pDevice->getPhysAddr(), epmPages);
+  pMemory->endStaging();
+
+  if (!pMemory->allocUtm(params.getUntrustedSize())) {
+    ERROR("failed to init untrusted memory - ioctl() failed");
+    destroy();
+    return Error::DeviceError;
+  }
+  if (pDevice->clone(tmpl.pDevice->getEid()) != Error::Success) {
+    destroy();
+    return Error::DeviceError;
+  }
+  if (!mapUntrusted(params.getUntrustedSize())) {
+    ERROR(
+        "failed to clone enclave - cannot obtain the untrusted buffer "
+        "pointer \n");
+    destroy();
+    return Error::DeviceMemoryMapError;
+  }
+
+  runtimeElfAddr = tmpl.runtimeElfAddr;
+  enclaveElfAddr = tmpl.enclaveElfAddr;
   return Error::Success;
 }
 
@@ -226,14 +568,226 @@ Enclave::mapUntrusted(size_t size) {
   return true;
 }
 
+/* Returns an enclave that has exited to the state it had after init(),
+ * without copying or measuring the image again. Only for enclaves
+ * created with Params::setResettable(true). */
+Error
+Enclave::reset() {
+  if (!params.getResettable()) {
+    return Error::InvalidEnclave;
+  }
+  return pDevice->reset();
+}
+
+/* Saves this enclave to path for restore(), e.g. after init work that
+ * is worth skipping on the next cold start. Must be called from an ocall
+ * handler, before it writes its reply: the enclave is saved stopped in
+ * that edge call, and the host that restores it answers the call again.
+ * The image can only be decrypted by the same SM. */
+Error
+Enclave::checkpoint(const char* path) {
+  if (pMemory == NULL) {
+    return Error::InvalidEnclave;
+  }
+
+  struct checkpoint_file_header hdr;
+  hdr.magic      = CHECKPOINT_FILE_MAGIC;
+  hdr.epm_pages  = pMemory->getEpmSize() / PAGE_SIZE;
+  hdr.utm_size   = shared_buffer_size;
+  hdr.image_size = SM_CHECKPOINT_SIZE(pMemory->getEpmSize());
+
+  std::vector<unsigned char> image(hdr.image_size);
+  Error ret = pDevice->checkpoint(image.data(), image.size());
+  if (ret != Error::Success) {
+    return ret;
+  }
+
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) {
+    PERROR("cannot open checkpoint file");
+    return Error::FileInitFailure;
+  }
+  bool written =
+      fwrite(&hdr, sizeof(hdr), 1, file) == 1 &&
+      fwrite(image.data(), 1, image.size(), file) == image.size() &&
+      fwrite(shared_buffer, 1, hdr.utm_size, file) == hdr.utm_size;
+  if (fclose(file) != 0 || !written) {
+    ERROR("failed to write checkpoint file %s", path);
+    return Error::FileInitFailure;
+  }
+  return Error::Success;
+}
+
+/* Creates this enclave from a file written by checkpoint(). The SM
+ * decrypts it into a new EPM and keeps the original measurement. run()
+ * first dispatches the edge call the enclave was saved in and then
+ * resumes it. The EPM and untrusted sizes come from the file; the rest of
+ * params only configures the host side. */
+Error
+Enclave::restore(const char* path, Params _params) {
+  struct checkpoint_file_header hdr;
+  std::vector<unsigned char> image, utm;
+
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    PERROR("cannot open checkpoint file");
+    return Error::FileInitFailure;
+  }
+  bool valid = fread(&hdr, sizeof(hdr), 1, file) == 1 &&
+               hdr.magic == CHECKPOINT_FILE_MAGIC &&
+               hdr.image_size == SM_CHECKPOINT_SIZE(hdr.epm_pages * PAGE_SIZE);
+  if (valid) {
+    image.resize(hdr.image_size);
+    utm.resize(hdr.utm_size);
+    valid = fread(image.data(), 1, image.size(), file) == image.size() &&
+            fread(utm.data(), 1, utm.size(), file) == utm.size();
+  }
+  fclose(file);
+  if (!valid) {
+    ERROR("invalid checkpoint file %s", path);
+    return Error::FileInitFailure;
+  }
+
+  params = _params;
+  params.setUntrustedSize(hdr.utm_size);
+  /* the measured pages are gone, there is nothing to reset to */
+  params.setResettable(false);
+  pMemory = new PhysicalEnclaveMemory();
+  pDevice = new KeystoneDevice();
+
+  if (!pDevice->initDevice(params)) {
+    destroy();
+    return Error::DeviceInitFailure;
+  }
+  if (pDevice->create(hdr.epm_pages) != Error::Success) {
+    destroy();
+    return Error::DeviceError;
+  }
+  pMemory->init(pDevice, pDevice->getPhysAddr(), hdr.epm_pages);
+  pMemory->endStaging();
+
+  if (!pMemory->allocUtm(hdr.utm_size)) {
+    ERROR("failed to init untrusted memory - ioctl() failed");
+    destroy();
+    return Error::DeviceError;
+  }
+  if (pDevice->restore(image.data(), image.size()) != Error::Success) {
+    destroy();
+    return Error::DeviceError;
+  }
+  if (!mapUntrusted(hdr.utm_size)) {
+    ERROR(
+        "failed to restore enclave - cannot obtain the untrusted buffer "
+        "pointer \n");
+    destroy();
+    return Error::DeviceMemoryMapError;
+  }
+  /* the SM clears the UTM, put back the pending edge call */
+  if (hdr.utm_size) {
+    memcpy(shared_buffer, utm.data(), hdr.utm_size);
+  }
+
+  restored = true;
+  return Error::Success;
+}
+
 Error
 Enclave::destroy() {
+  /* init failed before it got to the device */
+  if (pDevice == NULL) {
+    return Error::Success;
+  }
+  /* drop a leftover staging mapping if init failed before finalize */
+  if (pMemory) {
+    pMemory->endStaging();
+  }
   return pDevice->destroy();
 }
 
+/* Polls the switchless ring at the end of the shared buffer and serves
+ * the posted edge calls while the enclave keeps running. Only one edge
+ * call is ever in flight, so this never races with the dispatch done by
+ * run() after a regular exit. */
+void
+Enclave::switchlessWorker() {
+  struct edge_switchless_ring* ring = edge_switchless_ring_ptr(
+      (uintptr_t)shared_buffer, shared_buffer_size);
+  size_t dataSize = shared_buffer_size - EDGE_SWITCHLESS_RESERVED;
+  unsigned long idle = 0;
+
+  while (!switchlessStop.load(std::memory_order_acquire)) {
+    unsigned long tail = ring->tail;
+    if (__atomic_load_n(&ring->enclave_magic, __ATOMIC_ACQUIRE) !=
+            EDGE_SWITCHLESS_MAGIC ||
+        __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail) {
+      if (++idle > 1024) std::this_thread::yield();
+      continue;
+    }
+    idle = 0;
+
+    struct edge_switchless_slot* slot =
+        &ring->slots[tail & (EDGE_SWITCHLESS_RING_SIZE - 1)];
+    unsigned long status = SWITCHLESS_SLOT_POSTED;
+    if (__atomic_compare_exchange_n(
+            &slot->status, &status, SWITCHLESS_SLOT_BUSY, false,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      edge_data_offset offset = slot->call_offset;
+      if (offset <= dataSize - sizeof(struct edge_call)) {
+        oFuncDispatch(
+            reinterpret_cast<void*>((uintptr_t)shared_buffer + offset));
+      }
+      __atomic_store_n(&slot->status, SWITCHLESS_SLOT_DONE, __ATOMIC_RELEASE);
+    }
+    /* cancelled slots are simply skipped */
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  }
+}
+
+void
+Enclave::startSwitchless() {
+  if (!params.getSwitchless() || oFuncDispatch == NULL ||
+      shared_buffer_size <= EDGE_SWITCHLESS_RESERVED + sizeof(struct edge_call)) {
+    return;
+  }
+
+  struct edge_switchless_ring* ring = edge_switchless_ring_ptr(
+      (uintptr_t)shared_buffer, shared_buffer_size);
+  memset(ring, 0, sizeof(struct edge_switchless_ring));
+  __atomic_store_n(&ring->host_active, 1, __ATOMIC_RELEASE);
+
+  switchlessStop.store(false);
+  switchlessThread = std::thread(&Enclave::switchlessWorker, this);
+}
+
+void
+Enclave::stopSwitchless() {
+  if (!switchlessThread.joinable()) {
+    return;
+  }
+
+  struct edge_switchless_ring* ring = edge_switchless_ring_ptr(
+      (uintptr_t)shared_buffer, shared_buffer_size);
+  __atomic_store_n(&ring->host_active, 0, __ATOMIC_RELEASE);
+
+  switchlessStop.store(true, std::memory_order_release);
+  switchlessThread.join();
+}
+
 Error
 Enclave::run(uintptr_t* retval) {
-  Error ret = pDevice->run(retval);
+  startSwitchless();
+
+  Error ret;
+  if (restored) {
+    /* answer the edge call it was checkpointed in, then carry on */
+    restored = false;
+    if (oFuncDispatch != NULL) {
+      oFuncDispatch(getSharedBuffer());
+    }
+    ret = pDevice->resume(retval);
+  } else {
+    ret = pDevice->run(retval);
+  }
   while (ret == Error::EdgeCallHost || ret == Error::EnclaveInterrupted) {
     /* enclave is stopped in the middle. */
     if (ret == Error::EdgeCallHost && oFuncDispatch != NULL) {
@@ -242,6 +796,8 @@ Enclave::run(uintptr_t* retval) {
     ret = pDevice->resume(retval);
   }
 
+  stopSwitchless();
+
   if (ret != Error::Success) {
     ERROR("failed to run enclave - ioctl() failed");
     destroy();
@@ -0,0 +1,151 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#include "EnclavePool.hpp"
+
+namespace Keystone {
+
+EnclavePool::EnclavePool(
+    const char* _eapppath, const char* _runtimepath, const char* _loaderpath,
+    Params _params, size_t _lowWatermark, size_t _highWatermark,
+    size_t refillThreads)
+    : eapppath(_eapppath),
+      runtimepath(_runtimepath),
+      loaderpath(_loaderpath),
+      params(_params),
+      lowWatermark(_lowWatermark),
+      highWatermark(_highWatermark),
+      pending(0),
+      refilling(false),
+      stopping(false),
+      hits(0),
+      misses(0),
+      failures(0) {
+  if (highWatermark == 0) {
+    highWatermark = 1;
+  }
+  if (lowWatermark > highWatermark) {
+    lowWatermark = highWatermark;
+  }
+  if (refillThreads == 0) {
+    refillThreads = 1;
+  }
+
+  refilling = true;
+  for (size_t i = 0; i < refillThreads; i++) {
+    refillers.push_back(std::thread(&EnclavePool::refillWorker, this));
+  }
+}
+
+EnclavePool::~EnclavePool() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  refillCond.notify_all();
+  readyCond.notify_all();
+  for (auto& t : refillers) {
+    t.join();
+  }
+  /* the remaining enclaves are destroyed along with the deque */
+}
+
+std::unique_ptr<Enclave>
+EnclavePool::create() {
+  std::unique_ptr<Enclave> enclave(new Enclave());
+  if (enclave->init(
+          eapppath.c_str(), runtimepath.c_str(), loaderpath.c_str(),
+          params) != Error::Success) {
+    return nullptr;
+  }
+  return enclave;
+}
+
+/* Builds enclaves while refilling is on, i.e. from the moment the pool
+ * drops to the low watermark until it reaches the high one. A failed
+ * init turns refilling off so a broken device does not make the threads
+ * spin; the next acquire() turns it back on. */
+void
+EnclavePool::refillWorker() {
+  std::unique_lock<std::mutex> guard(lock);
+
+  while (true) {
+    refillCond.wait(guard, [this] {
+      return stopping ||
+             (refilling && ready.size() + pending < highWatermark);
+    });
+    if (stopping) {
+      return;
+    }
+
+    pending++;
+    guard.unlock();
+    std::unique_ptr<Enclave> enclave = create();
+    guard.lock();
+    pending--;
+
+    if (enclave) {
+      ready.push_back(std::move(enclave));
+    } else {
+      failures++;
+      refilling = false;
+    }
+    if (ready.size() + pending >= highWatermark) {
+      refilling = false;
+    }
+    readyCond.notify_all();
+  }
+}
+
+std::unique_ptr<Enclave>
+EnclavePool::acquire() {
+  std::unique_ptr<Enclave> enclave;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!ready.empty()) {
+      enclave = std::move(ready.front());
+      ready.pop_front();
+    }
+    if (!refilling && ready.size() + pending <= lowWatermark) {
+      refilling = true;
+      refillCond.notify_all();
+    }
+  }
+
+  if (enclave) {
+    hits++;
+    return enclave;
+  }
+
+  /* pool ran dry; pay the full init cost on the caller's thread */
+  misses++;
+  enclave = create();
+  if (!enclave) {
+    failures++;
+  }
+  return enclave;
+}
+
+void
+EnclavePool::warmup(size_t count) {
+  std::unique_lock<std::mutex> guard(lock);
+  if (count > highWatermark) {
+    count = highWatermark;
+  }
+  if (ready.size() < count && !refilling) {
+    refilling = true;
+    refillCond.notify_all();
+  }
+  readyCond.wait(guard, [this, count] {
+    return stopping || ready.size() >= count || (!refilling && pending == 0);
+  });
+}
+
+size_t
+EnclavePool::getReady() {
+  std::lock_guard<std::mutex> guard(lock);
+  return ready.size();
+}
+
+}  // namespace Keystone
@@ -7,7 +7,10 @@
 
 namespace Keystone {
 
-KeystoneDevice::KeystoneDevice() { eid = -1; }
+KeystoneDevice::KeystoneDevice() {
+  eid          = -1;
+  runUntilEdge = true;
+}
 
 Error
 KeystoneDevice::create(uint64_t minPages) {
@@ -41,13 +44,15 @@ KeystoneDevice::initUTM(size_t size) {
 Error
 KeystoneDevice::finalize(
     uintptr_t runtimePhysAddr, uintptr_t eappPhysAddr, uintptr_t freePhysAddr,
-    uintptr_t freeRequested) {
+    uintptr_t freeRequested, uintptr_t timeslice, bool checkpoint) {
   struct keystone_ioctl_create_enclave encl;
   encl.eid            = eid;
   encl.runtime_paddr  = runtimePhysAddr;
   encl.user_paddr     = eappPhysAddr;
   encl.free_paddr     = freePhysAddr;
   encl.free_requested = freeRequested;
+  encl.timeslice      = timeslice;
+  encl.checkpoint     = checkpoint;
 
   if (ioctl(fd, KEYSTONE_IOC_FINALIZE_ENCLAVE, &encl)) {
     perror("ioctl error");
@@ -74,6 +79,60 @@ KeystoneDevice::destroy() {
   return Error::Success;
 }
 
+Error
+KeystoneDevice::reset() {
+  struct keystone_ioctl_create_enclave encl;
+  encl.eid = eid;
+
+  if (ioctl(fd, KEYSTONE_IOC_RESET_ENCLAVE, &encl)) {
+    perror("ioctl error");
+    return Error::IoctlErrorReset;
+  }
+
+  return Error::Success;
+}
+
+Error
+KeystoneDevice::clone(int templateEid) {
+  struct keystone_ioctl_create_enclave encl;
+  encl.eid          = eid;
+  encl.template_eid = templateEid;
+
+  if (ioctl(fd, KEYSTONE_IOC_CLONE_ENCLAVE, &encl)) {
+    perror("ioctl error");
+    return Error::IoctlErrorFinalize;
+  }
+  return Error::Success;
+}
+
+Error
+KeystoneDevice::checkpoint(void* image, size_t size) {
+  struct keystone_ioctl_checkpoint ckpt;
+  ckpt.eid   = eid;
+  ckpt.image = (uintptr_t)image;
+  ckpt.size  = size;
+
+  if (ioctl(fd, KEYSTONE_IOC_CHECKPOINT_ENCLAVE, &ckpt)) {
+    perror("ioctl error");
+    return Error::IoctlErrorCheckpoint;
+  }
+  return Error::Success;
+}
+
+Error
+KeystoneDevice::restore(const void* image, size_t size) {
+  struct keystone_ioctl_checkpoint ckpt;
+  ckpt.eid   = eid;
+  ckpt.image = (uintptr_t)image;
+  ckpt.size  = size;
+
+  if (ioctl(fd, KEYSTONE_IOC_RESTORE_ENCLAVE, &ckpt)) {
+    perror("ioctl error");
+    return Error::IoctlErrorRestore;
+  }
+  return Error::Success;
+}
+
 Error
 KeystoneDevice::__run(bool resume, uintptr_t* ret) {
   struct keystone_ioctl_run_enclave encl;
@@ -84,13 +143,20 @@ KeystoneDevice::__run(bool resume, uintptr_t* ret) {
 
   if (resume) {
     error   = Error::IoctlErrorResume;
-    request = KEYSTONE_IOC_RESUME_ENCLAVE;
+    request = runUntilEdge ? KEYSTONE_IOC_RESUME_UNTIL_EDGE
+                           : KEYSTONE_IOC_RESUME_ENCLAVE;
   } else {
     error   = Error::IoctlErrorRun;
-    request = KEYSTONE_IOC_RUN_ENCLAVE;
+    request = runUntilEdge ? KEYSTONE_IOC_RUN_UNTIL_EDGE
+                           : KEYSTONE_IOC_RUN_ENCLAVE;
   }
 
   if (ioctl(fd, request, &encl)) {
+    /* older drivers do not know the in-kernel resume loop */
+    if (runUntilEdge && (errno == ENOSYS || errno == ENOTTY)) {
+      runUntilEdge = false;
+      return __run(resume, ret);
+    }
     return error;
   }
 
@@ -131,6 +197,11 @@ KeystoneDevice::map(uintptr_t addr, size_t size) {
   return ret;
 }
 
+void
+KeystoneDevice::unmap(void* ptr, size_t size) {
+  munmap(ptr, size);
+}
+
 bool
 KeystoneDevice::initDevice(Params params) { // TODO: why does this need params
   /* open device driver */
@@ -156,7 +227,7 @@ MockKeystoneDevice::initUTM(size_t size) {
 Error
 MockKeystoneDevice::finalize(
     uintptr_t runtimePhysAddr, uintptr_t eappPhysAddr, uintptr_t freePhysAddr,
-    uintptr_t freeRequested) {
+    uintptr_t freeRequested, uintptr_t timeslice, bool checkpoint) {
   return Error::Success;
 }
 
@@ -165,6 +236,26 @@ MockKeystoneDevice::destroy() {
   return Error::Success;
 }
 
+Error
+MockKeystoneDevice::reset() {
+  return Error::Success;
+}
+
+Error
+MockKeystoneDevice::clone(int templateEid) {
+  return Error::Success;
+}
+
+Error
+MockKeystoneDevice::checkpoint(void* image, size_t size) {
+  return Error::Success;
+}
+
+Error
+MockKeystoneDevice::restore(const void* image, size_t size) {
+  return Error::Success;
+}
+
 Error
 MockKeystoneDevice::run(uintptr_t* ret) {
   return Error::Success;
@@ -182,12 +273,18 @@ MockKeystoneDevice::initDevice(Params params) {
 
 void*
 MockKeystoneDevice::map(uintptr_t addr, size_t size) {
-  sharedBuffer = malloc(size);
-  return sharedBuffer;
+  void* ptr = malloc(size);
+  if (ptr) mappings.insert(ptr);
+  return ptr;
+}
+
+void
+MockKeystoneDevice::unmap(void* ptr, size_t size) {
+  if (mappings.erase(ptr)) free(ptr);
 }
 
 MockKeystoneDevice::~MockKeystoneDevice() {
-  if (sharedBuffer) free(sharedBuffer);
+  for (void* ptr : mappings) free(ptr);
 }
 
 }  // namespace Keystone
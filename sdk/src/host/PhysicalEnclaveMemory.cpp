@@ -14,6 +14,18 @@ PhysicalEnclaveMemory::init(
   epmSize       = PAGE_SIZE * min_pages;
   epmFreeList   = 0; 
   startAddr 		= phys_addr;
+
+  /* Map the whole EPM once so that the image can be streamed in with
+   * large copies instead of one mmap() per page */
+  epmStaging    = pDevice->map(0, epmSize);
+}
+
+void
+PhysicalEnclaveMemory::endStaging() {
+  if (epmStaging) {
+    pDevice->unmap(epmStaging, epmSize);
+    epmStaging = NULL;
+  }
 }
 
 uintptr_t
@@ -28,31 +40,29 @@ PhysicalEnclaveMemory::allocUtm(size_t size) {
 /* Only used to allocate memory for root page table */
 uintptr_t
 PhysicalEnclaveMemory::allocMem(size_t size) {
-  uintptr_t ret;
-
-  assert(pDevice);
-
-  ret = reinterpret_cast<uintptr_t>(pDevice->map(0, size));
-  return ret;
+  return readMem(0, size);
 }
 
-// unused 
+/* While the EPM is staged, reads come out of the staging mapping instead
+ * of an mmap() each. Afterwards the caller gets a mapping of its own. */
 uintptr_t
 PhysicalEnclaveMemory::readMem(uintptr_t src, size_t size) {
-  uintptr_t ret;
-
   assert(pDevice);
 
-  ret = reinterpret_cast<uintptr_t>(pDevice->map(src, size));
-  return ret;
+  if (epmStaging && src <= epmSize && size <= epmSize - src) {
+    return (uintptr_t)epmStaging + src;
+  }
+  return reinterpret_cast<uintptr_t>(pDevice->map(src, size));
 }
 
 /* src: virtual address */
 void
 PhysicalEnclaveMemory::writeMem(uintptr_t src, uintptr_t offset, size_t size) {
-  assert(pDevice);
-  void* va_dst = pDevice->map(offset, size);
-  memcpy(va_dst, reinterpret_cast<void*>(src), size);
+  assert(epmStaging);
+  assert(offset + size <= epmSize);
+  memcpy(
+      reinterpret_cast<void*>((uintptr_t)epmStaging + offset),
+      reinterpret_cast<void*>(src), size);
 }
 
 }  // namespace Keystone
@@ -0,0 +1,256 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#include "Prelinker.hpp"
+#include <stdio.h>
+#include <cstring>
+
+namespace Keystone {
+
+/* PTE bits of the enclave, see runtime mm/vm_defs.h */
+#if __riscv_xlen == 32
+typedef uint32_t pte_t;
+#else
+typedef uint64_t pte_t;
+#endif
+
+#define PTE_V 0x001
+#define PTE_R 0x002
+#define PTE_W 0x004
+#define PTE_X 0x008
+#define PTE_U 0x010
+#define PTE_A 0x040
+#define PTE_D 0x080
+#define PTE_PPN_SHIFT 10
+
+/* same as pt_mode_from_elf() in the runtime's ELF loader */
+static int
+ptModeFromElf(int flags) {
+  return ((flags & PF_X) ? PTE_X : 0) |
+         ((flags & PF_W) ? (PTE_W | PTE_R | PTE_D) : 0) |
+         ((flags & PF_R) ? PTE_R : 0);
+}
+
+static pte_t
+pteCreate(size_t offset, int flags) {
+  return (pte_t)(((offset >> PAGE_BITS) << PTE_PPN_SHIFT) | PTE_V | flags);
+}
+
+/* appends count zeroed pages to the image and returns the offset of the
+ * first one */
+size_t
+Prelinker::allocPages(size_t count) {
+  size_t offset = image.size();
+  image.resize(offset + count * PAGE_SIZE, 0);
+  return offset;
+}
+
+/* Copies a PT_LOAD segment into the image and records its page mappings.
+ * Runtime pages sit at a fixed offset from rt_base because the runtime
+ * finds its physical address with kernel_offset; eapp pages are
+ * allocated as they come. A page shared with a previous segment keeps
+ * its first mapping, as in loadElf(). */
+bool
+Prelinker::mapSegment(elf_t* elf, size_t ph, bool user, uintptr_t runtimeVa) {
+  uintptr_t start    = elf_getProgramHeaderVaddr(elf, ph);
+  uintptr_t fileEnd  = start + elf_getProgramHeaderFileSize(elf, ph);
+  uintptr_t memEnd   = start + elf_getProgramHeaderMemorySize(elf, ph);
+  const char* src    = (const char*)elf_getProgramSegment(elf, ph);
+  int flags          = ptModeFromElf(elf_getProgramHeaderFlags(elf, ph));
+
+  if (src == NULL ||
+      (start % PAGE_SIZE) !=
+          (elf_getProgramHeaderOffset(elf, ph) % PAGE_SIZE)) {
+    ERROR("segment %zu is misaligned", ph);
+    return false;
+  }
+  if (user) {
+    flags |= PTE_U;
+  }
+
+  for (uintptr_t va = PAGE_DOWN(start); va < memEnd; va += PAGE_SIZE) {
+    auto it = mappings.find(va);
+    if (it == mappings.end()) {
+      Mapping mapping;
+      mapping.offset = user ? allocPages(1)
+                            : header.runtime_offset + (va - runtimeVa);
+      mapping.flags  = flags;
+      it             = mappings.emplace(va, mapping).first;
+    }
+
+    /* file bytes that fall into this page, .bss stays zero */
+    uintptr_t from = va < start ? start : va;
+    uintptr_t to   = va + PAGE_SIZE < fileEnd ? va + PAGE_SIZE : fileEnd;
+    if (from < to) {
+      memcpy(
+          &image[it->second.offset + (from - va)], src + (from - start),
+          to - from);
+    }
+  }
+  return true;
+}
+
+bool
+Prelinker::placeRuntime(ElfFile* runtime) {
+  elf_t elf;
+  if (elf_newFile(runtime->getPtr(), runtime->getFileSize(), &elf)) {
+    ERROR("runtime is not a valid ELF file");
+    return false;
+  }
+
+  uintptr_t lo, hi;
+  elf_getMemoryBounds(&elf, VIRTUAL, &lo, &hi);
+  lo = PAGE_DOWN(lo);
+  hi = PAGE_UP(hi);
+
+  header.runtime_offset = allocPages((hi - lo) / PAGE_SIZE);
+  header.runtime_va     = lo;
+  for (size_t i = 0; i < elf_getNumProgramHeaders(&elf); i++) {
+    if (elf_getProgramHeaderType(&elf, i) != PT_LOAD) {
+      continue;
+    }
+    if (!mapSegment(&elf, i, false, lo)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool
+Prelinker::placeEapp(ElfFile* eapp) {
+  elf_t elf;
+  if (elf_newFile(eapp->getPtr(), eapp->getFileSize(), &elf)) {
+    ERROR("eapp is not a valid ELF file");
+    return false;
+  }
+
+  /* the runtime still reads the ELF and program headers at user_base to
+   * build the auxiliary vector, so they must fit in the first page */
+  size_t phdrEnd;
+  if (elf.elfClass == ELFCLASS64) {
+    Elf64_Ehdr* ehdr = (Elf64_Ehdr*)eapp->getPtr();
+    phdrEnd = ehdr->e_phoff + (size_t)ehdr->e_phnum * ehdr->e_phentsize;
+  } else {
+    Elf32_Ehdr* ehdr = (Elf32_Ehdr*)eapp->getPtr();
+    phdrEnd = ehdr->e_phoff + (size_t)ehdr->e_phnum * ehdr->e_phentsize;
+  }
+  if (phdrEnd > PAGE_SIZE) {
+    ERROR("eapp program headers do not fit in the first page");
+    return false;
+  }
+
+  header.user_offset = allocPages(1);
+  memcpy(&image[header.user_offset], eapp->getPtr(), phdrEnd);
+  for (size_t i = 0; i < elf_getNumProgramHeaders(&elf); i++) {
+    if (elf_getProgramHeaderType(&elf, i) != PT_LOAD) {
+      continue;
+    }
+    if (!mapSegment(&elf, i, true, 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Builds the tables after all data pages so that the tables end the
+ * image. Entries are relative to runtime_base, like map_page() would
+ * have made them with the image loaded at physical address 0. */
+void
+Prelinker::buildPageTables() {
+  header.root_offset = allocPages(1);
+
+  for (auto& entry : mappings) {
+    uintptr_t va = entry.first;
+    size_t table = header.root_offset;
+
+    for (int level = 1; level < PT_LEVELS; level++) {
+      pte_t* pte = (pte_t*)&image[table] + PT_INDEX(va, level);
+      if (!(*pte & PTE_V)) {
+        size_t next = allocPages(1);
+        /* image may have moved */
+        pte  = (pte_t*)&image[table] + PT_INDEX(va, level);
+        *pte = pteCreate(next, 0);
+      }
+      table = (*pte >> PTE_PPN_SHIFT) << PAGE_BITS;
+    }
+
+    pte_t* leaf = (pte_t*)&image[table] + PT_INDEX(va, PT_LEVELS);
+    *leaf = pteCreate(entry.second.offset, PTE_D | PTE_A | entry.second.flags);
+  }
+}
+
+/* every valid entry of every table needs runtime_base added */
+bool
+Prelinker::collectRelocs() {
+  pte_t* ptes  = (pte_t*)&image[header.root_offset];
+  size_t count = (image.size() - header.root_offset) / sizeof(pte_t);
+
+  for (size_t i = 0; i < count; i++) {
+    if (!(ptes[i] & PTE_V)) {
+      continue;
+    }
+    uint32_t offset = header.root_offset + i * sizeof(pte_t);
+    if (!relocs.empty() &&
+        relocs.back().offset + relocs.back().count * sizeof(pte_t) ==
+            offset) {
+      relocs.back().count++;
+      continue;
+    }
+    if (relocs.size() == EYRIE_PRELINK_MAX_RELOCS) {
+      ERROR("too many page table relocations");
+      return false;
+    }
+    struct eyrie_prelink_reloc reloc = {offset, 1};
+    relocs.push_back(reloc);
+  }
+  return true;
+}
+
+Error
+Prelinker::build(
+    const char* eapppath, const char* runtimepath, const char* outpath) {
+  Prelinker prelinker;
+  ElfFile runtime(runtimepath);
+  ElfFile eapp(eapppath);
+
+  if (runtime.getPtr() == NULL || eapp.getPtr() == NULL) {
+    return Error::FileInitFailure;
+  }
+
+  memset(&prelinker.header, 0, sizeof(prelinker.header));
+  prelinker.allocPages(1);
+  if (!prelinker.placeRuntime(&runtime) || !prelinker.placeEapp(&eapp)) {
+    return Error::ELFLoadFailure;
+  }
+  prelinker.buildPageTables();
+  if (!prelinker.collectRelocs()) {
+    return Error::ELFLoadFailure;
+  }
+
+  struct eyrie_prelink* hdr = (struct eyrie_prelink*)&prelinker.image[0];
+  *hdr                      = prelinker.header;
+  hdr->magic                = EYRIE_PRELINK_MAGIC;
+  hdr->version              = EYRIE_PRELINK_VERSION;
+  hdr->n_relocs             = prelinker.relocs.size();
+  hdr->image_size           = prelinker.image.size();
+  memcpy(
+      hdr->relocs, prelinker.relocs.data(),
+      prelinker.relocs.size() * sizeof(struct eyrie_prelink_reloc));
+
+  FILE* file = fopen(outpath, "wb");
+  if (file == NULL) {
+    PERROR("cannot open prelinked image");
+    return Error::FileInitFailure;
+  }
+  bool written = fwrite(
+                     prelinker.image.data(), 1, prelinker.image.size(),
+                     file) == prelinker.image.size();
+  if (fclose(file) != 0 || !written) {
+    ERROR("failed to write prelinked image %s", outpath);
+    return Error::FileInitFailure;
+  }
+  return Error::Success;
+}
+
+}  // namespace Keystone
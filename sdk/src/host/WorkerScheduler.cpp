@@ -0,0 +1,287 @@
+//******************************************************************************
+// Copyright (c) 2018, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#include "WorkerScheduler.hpp"
+#include <pthread.h>
+#include <sched.h>
+extern "C" {
+#include "shared/worker_call.h"
+}
+#include "edge/edge_common.h"
+
+namespace Keystone {
+
+WorkerScheduler::WorkerScheduler(
+    const char* _eapppath, const char* _runtimepath, const char* _loaderpath,
+    Params _params, size_t _workers)
+    : eapppath(_eapppath),
+      runtimepath(_runtimepath),
+      loaderpath(_loaderpath),
+      params(_params),
+      numWorkers(_workers),
+      fallbackDispatch(NULL),
+      queued(0),
+      stopping(false),
+      started(0),
+      startError(Error::Success),
+      nextJobId(0),
+      nextWorker(0),
+      completed(0),
+      steals(0) {
+  if (numWorkers == 0) {
+    numWorkers = std::thread::hardware_concurrency();
+  }
+  if (numWorkers == 0) {
+    numWorkers = 1;
+  }
+}
+
+WorkerScheduler::~WorkerScheduler() {
+  stop();
+}
+
+Error
+WorkerScheduler::start() {
+  if (!workers.empty()) {
+    return Error::Success;
+  }
+  /* jobs are passed right after the edge call header */
+  if (params.getUntrustedSize() < sizeof(struct edge_call) + WORKER_MSG_MAX) {
+    ERROR("untrusted memory is too small for worker jobs");
+    return Error::JobRejected;
+  }
+
+  stopping = false;
+  started  = 0;
+  for (size_t i = 0; i < numWorkers; i++) {
+    std::unique_ptr<Worker> worker(new Worker());
+    worker->hart = i;
+    workers.push_back(std::move(worker));
+  }
+  for (auto& worker : workers) {
+    worker->thread =
+        std::thread(&WorkerScheduler::runWorker, this, worker.get());
+  }
+
+  std::unique_lock<std::mutex> guard(idleLock);
+  idleCond.wait(guard, [this] { return started == workers.size(); });
+  Error ret = startError;
+  guard.unlock();
+
+  if (ret != Error::Success) {
+    stop();
+  }
+  return ret;
+}
+
+void
+WorkerScheduler::stop() {
+  {
+    std::lock_guard<std::mutex> guard(idleLock);
+    stopping = true;
+  }
+  idleCond.notify_all();
+
+  for (auto& worker : workers) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+  /* only left over if every worker enclave died */
+  for (auto& worker : workers) {
+    while (!worker->queue.empty()) {
+      failJob(std::move(worker->queue.front()));
+      worker->queue.pop_front();
+    }
+  }
+  workers.clear();
+  queued = 0;
+}
+
+Error
+WorkerScheduler::submit(
+    const void* data, size_t len, std::future<JobResult>* result) {
+  if (len > WORKER_MSG_DATA_MAX || workers.empty()) {
+    return Error::JobRejected;
+  }
+
+  std::unique_ptr<Job> job(new Job());
+  job->id = nextJobId++;
+  job->input.assign(
+      static_cast<const unsigned char*>(data),
+      static_cast<const unsigned char*>(data) + len);
+  *result = job->result.get_future();
+
+  Worker* worker = workers[nextWorker++ % workers.size()].get();
+  {
+    std::lock_guard<std::mutex> guard(worker->lock);
+    worker->queue.push_back(std::move(job));
+  }
+  {
+    std::lock_guard<std::mutex> guard(idleLock);
+    queued++;
+  }
+  idleCond.notify_all();
+  return Error::Success;
+}
+
+void
+WorkerScheduler::failJob(std::unique_ptr<Job> job) {
+  JobResult result;
+  result.status = -1;
+  job->result.set_value(std::move(result));
+}
+
+/* Own jobs are taken from the front, stolen ones from the back so the
+ * owner and the thief do not fight over the same end. */
+std::unique_ptr<WorkerScheduler::Job>
+WorkerScheduler::takeJob(Worker* worker, bool steal) {
+  std::unique_ptr<Job> job;
+  {
+    std::lock_guard<std::mutex> guard(worker->lock);
+    if (worker->queue.empty()) {
+      return nullptr;
+    }
+    if (steal) {
+      job = std::move(worker->queue.back());
+      worker->queue.pop_back();
+    } else {
+      job = std::move(worker->queue.front());
+      worker->queue.pop_front();
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(idleLock);
+  queued--;
+  return job;
+}
+
+/* Blocks until there is a job for this worker. Returns nullptr once the
+ * scheduler is stopping and every queue has been drained. */
+std::unique_ptr<WorkerScheduler::Job>
+WorkerScheduler::nextJob(Worker* worker) {
+  while (true) {
+    std::unique_ptr<Job> job = takeJob(worker, false);
+    if (job) {
+      return job;
+    }
+    for (size_t i = 1; i < workers.size(); i++) {
+      Worker* peer = workers[(worker->hart + i) % workers.size()].get();
+      job          = takeJob(peer, true);
+      if (job) {
+        steals++;
+        return job;
+      }
+    }
+
+    std::unique_lock<std::mutex> guard(idleLock);
+    idleCond.wait(guard, [this] { return stopping || queued > 0; });
+    if (stopping && queued == 0) {
+      return nullptr;
+    }
+  }
+}
+
+/* Serves WORKER_CALL_NEXT_JOB: completes the job the worker reports on
+ * and hands it the next one. Everything read from the shared buffer is
+ * bounds checked against this worker's buffer. */
+void
+WorkerScheduler::handleCall(Worker* worker, void* buffer) {
+  struct edge_call* call = (struct edge_call*)buffer;
+  uintptr_t base         = (uintptr_t)worker->enclave.getSharedBuffer();
+  size_t size            = worker->enclave.getSharedBufferSize();
+
+  if (call->call_id != WORKER_CALL_NEXT_JOB) {
+    if (fallbackDispatch != NULL) {
+      fallbackDispatch(buffer);
+    } else {
+      call->return_data.call_status = CALL_STATUS_BAD_CALL_ID;
+    }
+    return;
+  }
+
+  if (call->call_arg_offset > size ||
+      call->call_arg_size > size - call->call_arg_offset ||
+      call->call_arg_size < sizeof(struct worker_msg)) {
+    call->return_data.call_status = CALL_STATUS_BAD_OFFSET;
+    return;
+  }
+
+  struct worker_msg* msg =
+      (struct worker_msg*)(base + call->call_arg_offset);
+  if (worker->current) {
+    JobResult result;
+    result.status = -1;
+    if (msg->job_id == worker->current->id) {
+      size_t len = call->call_arg_size - sizeof(struct worker_msg);
+      if (msg->len < len) {
+        len = msg->len;
+      }
+      result.status = msg->status;
+      result.output.assign(msg->data, msg->data + len);
+    }
+    worker->current->result.set_value(std::move(result));
+    worker->current.reset();
+    completed++;
+  }
+
+  /* the reply overwrites the arguments, which are consumed by now */
+  struct worker_msg* reply =
+      (struct worker_msg*)(base + sizeof(struct edge_call));
+  std::unique_ptr<Job> job = nextJob(worker);
+  if (job) {
+    reply->job_id = job->id;
+    reply->flags  = 0;
+    reply->len    = job->input.size();
+    memcpy(reply->data, job->input.data(), job->input.size());
+    worker->current = std::move(job);
+  } else {
+    reply->job_id = WORKER_JOB_NONE;
+    reply->flags  = WORKER_MSG_EXIT;
+    reply->len    = 0;
+  }
+  reply->status = 0;
+
+  call->return_data.call_ret_offset = sizeof(struct edge_call);
+  call->return_data.call_ret_size   = sizeof(struct worker_msg) + reply->len;
+  call->return_data.call_status     = CALL_STATUS_OK;
+}
+
+void
+WorkerScheduler::runWorker(Worker* worker) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(worker->hart, &cpus);
+  /* the enclave runs on whichever hart issues the run ioctl */
+  if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+    ERROR("failed to pin worker %zu to its hart", worker->hart);
+  }
+
+  Error ret = worker->enclave.init(
+      eapppath.c_str(), runtimepath.c_str(), loaderpath.c_str(), params);
+  {
+    std::lock_guard<std::mutex> guard(idleLock);
+    if (ret != Error::Success && startError == Error::Success) {
+      startError = ret;
+    }
+    started++;
+  }
+  idleCond.notify_all();
+  if (ret != Error::Success) {
+    return;
+  }
+
+  worker->enclave.registerOcallDispatch(
+      [this, worker](void* buffer) { handleCall(worker, buffer); });
+  if (worker->enclave.run() != Error::Success) {
+    ERROR("worker %zu exited with an error", worker->hart);
+  }
+
+  /* the enclave died in the middle of a job */
+  if (worker->current) {
+    failJob(std::move(worker->current));
+  }
+}
+
+}  // namespace Keystone
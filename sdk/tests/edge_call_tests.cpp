@@ -0,0 +1,193 @@
+//******************************************************************************
+// Copyright (c) 2020, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#include <edge_call.h>
+
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+#define SHARED_SIZE 4096
+
+/* Host side of a shared buffer the enclave never zeroed */
+class EdgeCall : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    memset(buffer, 0xff, SHARED_SIZE);
+    edge_call_init_internals((uintptr_t)buffer, SHARED_SIZE);
+    call = (struct edge_call*)buffer;
+  }
+
+  alignas(8) unsigned char buffer[SHARED_SIZE];
+  struct edge_call* call;
+};
+
+TEST_F(EdgeCall, DataAreaIsRestOfBuffer) {
+  EXPECT_EQ(
+      edge_call_data_ptr_of(call), (uintptr_t)buffer + sizeof(struct edge_call));
+  EXPECT_EQ(edge_call_data_ptr_of(call), edge_call_data_ptr());
+  EXPECT_EQ(
+      edge_call_data_len_of(call), SHARED_SIZE - sizeof(struct edge_call));
+}
+
+TEST_F(EdgeCall, Room) {
+  EXPECT_EQ(edge_call_room((uintptr_t)buffer), SHARED_SIZE);
+  EXPECT_EQ(edge_call_room((uintptr_t)buffer + SHARED_SIZE - 8), 8);
+  EXPECT_EQ(edge_call_room((uintptr_t)buffer + SHARED_SIZE), 0);
+  EXPECT_EQ(edge_call_room((uintptr_t)buffer + SHARED_SIZE + 8), 0);
+  EXPECT_EQ(edge_call_room((uintptr_t)buffer - 8), 0);
+}
+
+TEST_F(EdgeCall, WrappedRet) {
+  const char msg[] = "wrapped return value";
+  uintptr_t ret, data;
+  size_t ret_size;
+
+  ASSERT_EQ(edge_call_setup_wrapped_ret(call, (void*)msg, sizeof(msg)), 0);
+
+  /* the wrapper sits right behind the header, the value behind it */
+  ASSERT_EQ(edge_call_ret_ptr(call, &ret, &ret_size), 0);
+  EXPECT_EQ(ret, edge_call_data_ptr_of(call));
+  EXPECT_EQ(ret_size, sizeof(struct edge_data));
+
+  struct edge_data* wrapper = (struct edge_data*)ret;
+  EXPECT_EQ(wrapper->size, sizeof(msg));
+  ASSERT_EQ(
+      edge_call_get_ptr_from_offset(wrapper->offset, wrapper->size, &data), 0);
+  EXPECT_EQ(data, ret + sizeof(struct edge_data));
+  EXPECT_STREQ((const char*)data, msg);
+}
+
+TEST_F(EdgeCall, WrappedRetFillsBuffer) {
+  static unsigned char value[SHARED_SIZE];
+  size_t fits =
+      SHARED_SIZE - sizeof(struct edge_call) - sizeof(struct edge_data);
+
+  EXPECT_EQ(edge_call_setup_wrapped_ret(call, value, fits), 0);
+  EXPECT_NE(edge_call_setup_wrapped_ret(call, value, fits + 1), 0);
+  EXPECT_NE(edge_call_setup_wrapped_ret(call, value, SHARED_SIZE), 0);
+}
+
+TEST_F(EdgeCall, SetupCallSetsSlotLen) {
+  ASSERT_EQ(edge_call_setup_call(call, (void*)edge_call_data_ptr(), 16), 0);
+  EXPECT_EQ(call->call_slot_len, SHARED_SIZE);
+  EXPECT_EQ(call->call_arg_offset, sizeof(struct edge_call));
+}
+
+TEST_F(EdgeCall, DataLenFollowsSlotLen) {
+  call->call_slot_len = 512;
+  EXPECT_EQ(edge_call_data_len_of(call), 512 - sizeof(struct edge_call));
+
+  /* nonsense falls back to the rest of the buffer */
+  call->call_slot_len = 8;
+  EXPECT_EQ(
+      edge_call_data_len_of(call), SHARED_SIZE - sizeof(struct edge_call));
+  call->call_slot_len = SHARED_SIZE + 8;
+  EXPECT_EQ(
+      edge_call_data_len_of(call), SHARED_SIZE - sizeof(struct edge_call));
+}
+
+TEST_F(EdgeCall, RetPtrAfterArgs) {
+  uintptr_t data = edge_call_data_ptr_of(call);
+  size_t len     = SHARED_SIZE - sizeof(struct edge_call);
+
+  /* aligned, right behind the arguments */
+  ASSERT_EQ(edge_call_setup_call(call, (void*)data, 20), 0);
+  EXPECT_EQ(edge_call_ret_ptr_after_args(call, sizeof(int64_t)), data + 24);
+
+  /* not when the arguments fill the call's area */
+  ASSERT_EQ(edge_call_setup_call(call, (void*)data, len - 4), 0);
+  EXPECT_EQ(edge_call_ret_ptr_after_args(call, sizeof(int64_t)), 0);
+
+  /* or the slot length the other side gave */
+  ASSERT_EQ(edge_call_setup_call(call, (void*)data, 20), 0);
+  call->call_slot_len = sizeof(struct edge_call) + 24;
+  EXPECT_EQ(edge_call_ret_ptr_after_args(call, 0), data + 24);
+  EXPECT_EQ(edge_call_ret_ptr_after_args(call, 1), 0);
+}
+
+TEST_F(EdgeCall, Slots) {
+  uintptr_t slots = (uintptr_t)buffer + SHARED_SIZE - 3 * 256;
+  struct edge_call* got[3];
+
+  EXPECT_EQ(edge_call_slot_alloc(), nullptr);
+  EXPECT_EQ(edge_call_slots_init(sizeof(struct edge_call), 1), 0);
+  EXPECT_EQ(edge_call_slots_init(256, SHARED_SIZE / 256), 0);
+  ASSERT_EQ(edge_call_slots_init(250, 3), 3);
+
+  for (int i = 0; i < 3; i++) {
+    got[i] = edge_call_slot_alloc();
+    ASSERT_NE(got[i], nullptr);
+    EXPECT_EQ((uintptr_t)got[i], slots + i * 256);
+    EXPECT_EQ(got[i]->call_slot_len, 256);
+    EXPECT_EQ(got[i]->call_id, 0);
+    EXPECT_EQ(edge_call_data_len_of(got[i]), 256 - sizeof(struct edge_call));
+  }
+  EXPECT_EQ(edge_call_slot_alloc(), nullptr);
+
+  edge_call_slot_free(got[1]);
+  edge_call_slot_free(call);
+  EXPECT_EQ(edge_call_slot_alloc(), got[1]);
+  EXPECT_EQ(edge_call_slot_alloc(), nullptr);
+
+  /* a re-init drops them */
+  edge_call_init_internals((uintptr_t)buffer, SHARED_SIZE);
+  EXPECT_EQ(edge_call_slot_alloc(), nullptr);
+}
+
+TEST_F(EdgeCall, SlotsBoundTheFrontCall) {
+  uintptr_t slots = (uintptr_t)buffer + SHARED_SIZE - 2 * 256;
+  uintptr_t data  = edge_call_data_ptr();
+
+  ASSERT_EQ(edge_call_slots_init(256, 2), 2);
+  EXPECT_EQ(edge_call_room((uintptr_t)buffer), SHARED_SIZE - 2 * 256);
+  EXPECT_EQ(edge_call_room(slots + 8), 248);
+
+  /* the front call's data can't run into the slots, nor slots into
+   * each other */
+  EXPECT_EQ(edge_call_check_ptr_valid(data, slots - data), 0);
+  EXPECT_NE(edge_call_check_ptr_valid(data, slots - data + 1), 0);
+  EXPECT_NE(edge_call_check_ptr_valid(slots + 128, 256), 0);
+
+  ASSERT_EQ(edge_call_setup_call(call, (void*)data, 16), 0);
+  EXPECT_EQ(call->call_slot_len, SHARED_SIZE - 2 * 256);
+  EXPECT_NE(edge_call_setup_call(call, (void*)data, slots - data + 1), 0);
+}
+
+static struct edge_call* forwarded;
+
+TEST_F(EdgeCall, ForwardRunsSlotCall) {
+  ASSERT_EQ(edge_call_slots_init(256, 1), 1);
+  struct edge_call* slot = edge_call_slot_alloc();
+  ASSERT_NE(slot, nullptr);
+
+  ASSERT_EQ(register_call(1, [](void* buffer) {
+              forwarded = (struct edge_call*)buffer;
+              forwarded->return_data.call_status = CALL_STATUS_OK;
+            }),
+            0);
+  slot->call_id                 = 1;
+  slot->return_data.call_status = CALL_STATUS_ERROR;
+  call->call_id                 = EDGECALL_FORWARD;
+  ASSERT_EQ(edge_call_setup_call(call, slot, sizeof(struct edge_call)), 0);
+
+  forwarded = nullptr;
+  incoming_call_dispatch(buffer);
+  EXPECT_EQ(forwarded, slot);
+  EXPECT_EQ(slot->return_data.call_status, CALL_STATUS_OK);
+  EXPECT_EQ(call->return_data.call_status, CALL_STATUS_OK);
+
+  /* not to itself */
+  forwarded = nullptr;
+  ASSERT_EQ(edge_call_setup_call(call, call, sizeof(struct edge_call)), 0);
+  incoming_call_dispatch(buffer);
+  EXPECT_EQ(forwarded, nullptr);
+  EXPECT_EQ(call->return_data.call_status, CALL_STATUS_BAD_PTR);
+}
+
+int
+main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
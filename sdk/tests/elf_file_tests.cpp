@@ -0,0 +1,404 @@
+//******************************************************************************
+// Copyright (c) 2020, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#include <keystone.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ElfFile.hpp"
+#include "gtest/gtest.h"
+
+#define TEST_FILE "/proc/self/exe"
+
+using Keystone::ElfFile;
+using Keystone::ElfFileKey;
+using Keystone::Enclave;
+using Keystone::Error;
+
+/* An image with its headers in the first segment, a data segment that
+ * does not start on a page, notes in both and debug junk in between:
+ *
+ *   0x0000  ehdr, phdrs          PT_LOAD 0x10000, notes at 0x180
+ *   0x0200  junk                 PT_GNU_STACK at 0x1800, in no segment
+ *   0x2010  data                 PT_LOAD 0x20010, notes at 0x2020
+ *   0x3000  section headers */
+#define TEXT_SIZE 0x200
+#define DATA_OFFSET 0x2010
+#define DATA_SIZE 0x100
+#define DATA_MEMSZ 0x1000
+#define IMAGE_SIZE (0x3000 + 2 * sizeof(Elf64_Shdr))
+
+enum { PH_TEXT, PH_NOTE, PH_STACK, PH_DATA, PH_DATA_NOTE, PH_COUNT };
+
+static Elf64_Phdr*
+phdrs(void* file) {
+  return (Elf64_Phdr*)((uintptr_t)file + ((Elf64_Ehdr*)file)->e_phoff);
+}
+
+static void
+setPhdr(
+    std::vector<unsigned char>* image, int i, uint32_t type, uint64_t offset,
+    uint64_t vaddr, uint64_t filesz, uint64_t memsz) {
+  Elf64_Phdr* ph = &phdrs(image->data())[i];
+  memset(ph, 0, sizeof(*ph));
+  ph->p_type   = type;
+  ph->p_flags  = PF_R;
+  ph->p_offset = offset;
+  ph->p_vaddr  = vaddr;
+  ph->p_paddr  = vaddr;
+  ph->p_filesz = filesz;
+  ph->p_memsz  = memsz;
+  ph->p_align  = PAGE_SIZE;
+}
+
+static std::vector<unsigned char>
+buildImage() {
+  std::vector<unsigned char> image(IMAGE_SIZE, 0xaa);
+
+  Elf64_Ehdr* ehdr = (Elf64_Ehdr*)image.data();
+  memset(ehdr, 0, sizeof(*ehdr));
+  memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+  ehdr->e_ident[EI_CLASS]   = ELFCLASS64;
+  ehdr->e_ident[EI_DATA]    = ELFDATA2LSB;
+  ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+  ehdr->e_type              = ET_EXEC;
+  ehdr->e_version           = EV_CURRENT;
+  ehdr->e_entry             = 0x10000;
+  ehdr->e_phoff             = sizeof(Elf64_Ehdr);
+  ehdr->e_phentsize         = sizeof(Elf64_Phdr);
+  ehdr->e_phnum             = PH_COUNT;
+  ehdr->e_shoff             = 0x3000;
+  ehdr->e_shentsize         = sizeof(Elf64_Shdr);
+  ehdr->e_shnum             = 2;
+  ehdr->e_shstrndx          = 1;
+
+  setPhdr(&image, PH_TEXT, PT_LOAD, 0, 0x10000, TEXT_SIZE, TEXT_SIZE);
+  setPhdr(&image, PH_NOTE, PT_NOTE, 0x180, 0x10180, 0x20, 0x20);
+  setPhdr(&image, PH_STACK, PT_GNU_STACK, 0x1800, 0, 0x10, 0);
+  setPhdr(
+      &image, PH_DATA, PT_LOAD, DATA_OFFSET, 0x20010, DATA_SIZE, DATA_MEMSZ);
+  setPhdr(&image, PH_DATA_NOTE, PT_NOTE, 0x2020, 0x20020, 0x10, 0x10);
+
+  for (size_t i = 0; i < DATA_SIZE; i++) {
+    image[DATA_OFFSET + i] = (unsigned char)i;
+  }
+  for (size_t i = 0x180; i < TEXT_SIZE; i++) {
+    image[i] = 0x11;
+  }
+  return image;
+}
+
+class ExtractLoadable : public ::testing::Test {
+ protected:
+  void SetUp() override { image = buildImage(); }
+
+  std::vector<unsigned char> image;
+};
+
+TEST_F(ExtractLoadable, PacksSegments) {
+  ElfFile file(image.data(), image.size());
+
+  ASSERT_TRUE(file.extractLoadable());
+  EXPECT_TRUE(file.isLoadableOnly());
+  EXPECT_NE(file.getPtr(), image.data());
+
+  /* the data segment keeps its page offset right after the text */
+  Elf64_Phdr* ph = phdrs(file.getPtr());
+  EXPECT_EQ(ph[PH_TEXT].p_offset, 0);
+  EXPECT_EQ(ph[PH_DATA].p_offset, PAGE_SIZE + 0x10);
+  EXPECT_EQ(ph[PH_DATA].p_filesz, DATA_SIZE);
+  EXPECT_EQ(ph[PH_DATA].p_memsz, DATA_MEMSZ);
+  EXPECT_EQ(
+      memcmp(
+          (unsigned char*)file.getPtr() + ph[PH_DATA].p_offset,
+          image.data() + DATA_OFFSET, DATA_SIZE),
+      0);
+
+  /* only the null section header is left, after the data */
+  Elf64_Ehdr* ehdr = (Elf64_Ehdr*)file.getPtr();
+  EXPECT_EQ(ehdr->e_shnum, 1);
+  EXPECT_EQ(ehdr->e_shstrndx, SHN_UNDEF);
+  EXPECT_EQ(ehdr->e_shoff, PAGE_SIZE + 0x10 + DATA_SIZE);
+  EXPECT_EQ(file.getFileSize(), ehdr->e_shoff + sizeof(Elf64_Shdr));
+  EXPECT_LT(file.getFileSize(), image.size());
+
+  /* and the gap before the data is zeroed, not junk */
+  for (size_t i = TEXT_SIZE; i < ph[PH_DATA].p_offset; i++) {
+    ASSERT_EQ(((unsigned char*)file.getPtr())[i], 0);
+  }
+}
+
+TEST_F(ExtractLoadable, RebasesOtherHeaders) {
+  ElfFile file(image.data(), image.size());
+
+  ASSERT_TRUE(file.extractLoadable());
+  Elf64_Phdr* ph = phdrs(file.getPtr());
+
+  /* notes move with the segment that holds them */
+  EXPECT_EQ(ph[PH_NOTE].p_offset, 0x180);
+  EXPECT_EQ(ph[PH_DATA_NOTE].p_offset, PAGE_SIZE + 0x20);
+  EXPECT_EQ(ph[PH_DATA_NOTE].p_filesz, 0x10);
+
+  /* anything else is emptied */
+  EXPECT_EQ(ph[PH_STACK].p_type, PT_GNU_STACK);
+  EXPECT_EQ(ph[PH_STACK].p_filesz, 0);
+}
+
+TEST_F(ExtractLoadable, ResultIsValidElf) {
+  ElfFile file(image.data(), image.size());
+
+  ASSERT_TRUE(file.extractLoadable());
+  elf_t elf;
+  ASSERT_EQ(elf_newFile(file.getPtr(), file.getFileSize(), &elf), 0);
+  EXPECT_EQ(elf_getNumProgramHeaders(&elf), PH_COUNT);
+  EXPECT_EQ(elf_getEntryPoint(&elf), 0x10000);
+
+  /* and extracting it again changes nothing */
+  std::vector<unsigned char> once(
+      (unsigned char*)file.getPtr(),
+      (unsigned char*)file.getPtr() + file.getFileSize());
+  ElfFile again(once.data(), once.size());
+  ASSERT_TRUE(again.extractLoadable());
+  ASSERT_EQ(again.getFileSize(), once.size());
+  EXPECT_EQ(memcmp(again.getPtr(), once.data(), once.size()), 0);
+}
+
+TEST_F(ExtractLoadable, RejectsBrokenImages) {
+  /* a segment past the end of the file */
+  phdrs(image.data())[PH_DATA].p_filesz = IMAGE_SIZE;
+  ElfFile truncated(image.data(), image.size());
+  EXPECT_FALSE(truncated.extractLoadable());
+  EXPECT_FALSE(truncated.isLoadableOnly());
+  EXPECT_EQ(truncated.getPtr(), image.data());
+  EXPECT_EQ(truncated.getFileSize(), image.size());
+
+  memset(image.data(), 0, SELFMAG);
+  ElfFile notElf(image.data(), image.size());
+  EXPECT_FALSE(notElf.extractLoadable());
+
+  ElfFile missing("/nonexistent/eapp");
+  EXPECT_FALSE(missing.extractLoadable());
+}
+
+/* a real binary, with everything a linker puts in one */
+TEST(ExtractLoadableFile, KeepsLoadedContents) {
+  ElfFile file(TEST_FILE);
+  std::vector<unsigned char> original(
+      (unsigned char*)file.getPtr(),
+      (unsigned char*)file.getPtr() + file.getFileSize());
+
+  ASSERT_TRUE(file.extractLoadable());
+  EXPECT_LT(file.getFileSize(), original.size());
+
+  Elf64_Ehdr* ehdr    = (Elf64_Ehdr*)original.data();
+  Elf64_Phdr* before  = (Elf64_Phdr*)(original.data() + ehdr->e_phoff);
+  Elf64_Phdr* after   = (Elf64_Phdr*)((uintptr_t)file.getPtr() + ehdr->e_phoff);
+  unsigned char* data = (unsigned char*)file.getPtr();
+  size_t phEnd        = ehdr->e_phoff + ehdr->e_phnum * sizeof(Elf64_Phdr);
+  size_t loads        = 0;
+
+  for (size_t i = 0; i < ehdr->e_phnum; i++) {
+    if (before[i].p_type != PT_LOAD) {
+      continue;
+    }
+    loads++;
+    EXPECT_EQ(after[i].p_vaddr, before[i].p_vaddr);
+    EXPECT_EQ(after[i].p_offset % PAGE_SIZE, after[i].p_vaddr % PAGE_SIZE);
+    ASSERT_LE(after[i].p_offset + after[i].p_filesz, file.getFileSize());
+
+    /* the headers were rewritten, everything past them is the same */
+    size_t skip = 0;
+    if (before[i].p_offset < phEnd) {
+      skip = phEnd - before[i].p_offset;
+    }
+    EXPECT_EQ(
+        memcmp(
+            data + after[i].p_offset + skip,
+            original.data() + before[i].p_offset + skip,
+            before[i].p_filesz - skip),
+        0);
+  }
+  EXPECT_GT(loads, 0);
+}
+
+/* Image files on disk, rewritten the ways a build would */
+class ElfCache : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char templ[] = "/tmp/keystone-elf-XXXXXX";
+    ASSERT_NE(mkdtemp(templ), nullptr);
+    dir    = templ;
+    image  = buildImage();
+    loader = dir + "/loader";
+    rt     = dir + "/rt";
+    eapp   = dir + "/eapp";
+    write(loader, image);
+    write(rt, image);
+    write(eapp, image);
+  }
+
+  void TearDown() override {
+    unlink(loader.c_str());
+    unlink(rt.c_str());
+    unlink(eapp.c_str());
+    unlink((dir + "/tmp").c_str());
+    rmdir(dir.c_str());
+    ElfFile::clearCache();
+  }
+
+  static void write(const std::string& path, const std::vector<unsigned char>& data) {
+    FILE* file = fopen(path.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    EXPECT_EQ(fwrite(data.data(), 1, data.size(), file), data.size());
+    fclose(file);
+  }
+
+  /* a new file moved over the old one, like most linkers do */
+  void replace(const std::string& path, const std::vector<unsigned char>& data) {
+    write(dir + "/tmp", data);
+    ASSERT_EQ(rename((dir + "/tmp").c_str(), path.c_str()), 0);
+  }
+
+  /* written in place; the clock may not have moved since the last write */
+  static void rewrite(const std::string& path, const std::vector<unsigned char>& data) {
+    struct stat before;
+    ASSERT_EQ(stat(path.c_str(), &before), 0);
+    write(path, data);
+
+    struct timespec times[2] = {before.st_atim, before.st_mtim};
+    times[1].tv_nsec = (times[1].tv_nsec + 1) % 1000000000;
+    ASSERT_EQ(utimensat(AT_FDCWD, path.c_str(), times, 0), 0);
+  }
+
+  std::string measure(bool loadableOnly = false) {
+    char hash[MDSIZE];
+    EXPECT_EQ(
+        Enclave::measure(
+            hash, eapp.c_str(), rt.c_str(), loader.c_str(), loadableOnly),
+        Error::Success);
+    return std::string(hash, MDSIZE);
+  }
+
+  /* the same images from memory, which are never cached */
+  std::string measureInMemory(
+      const std::vector<unsigned char>& eappImage, bool loadableOnly = false) {
+    char hash[MDSIZE];
+    ElfFile loaderFile(image.data(), image.size());
+    ElfFile rtFile(image.data(), image.size());
+    ElfFile eappFile(eappImage.data(), eappImage.size());
+    EXPECT_EQ(
+        Enclave::measure(hash, &eappFile, &rtFile, &loaderFile, loadableOnly),
+        Error::Success);
+    return std::string(hash, MDSIZE);
+  }
+
+  static bool sameKey(const ElfFileKey* a, const ElfFileKey* b) {
+    return !(*a < *b) && !(*b < *a);
+  }
+
+  std::string dir;
+  std::string loader;
+  std::string rt;
+  std::string eapp;
+  std::vector<unsigned char> image;
+};
+
+TEST_F(ElfCache, SharesMappings) {
+  ElfFile first(eapp);
+  ElfFile second(eapp);
+  ElfFile other(rt);
+
+  ASSERT_NE(first.getKey(), nullptr);
+  EXPECT_TRUE(sameKey(first.getKey(), second.getKey()));
+  EXPECT_EQ(first.getPtr(), second.getPtr());
+  EXPECT_FALSE(sameKey(first.getKey(), other.getKey()));
+  EXPECT_NE(first.getPtr(), other.getPtr());
+
+  /* in use, so clearing the cache leaves it there */
+  ElfFile::clearCache();
+  ElfFile third(eapp);
+  EXPECT_EQ(first.getPtr(), third.getPtr());
+
+  ElfFile inMemory(image.data(), image.size());
+  EXPECT_EQ(inMemory.getKey(), nullptr);
+}
+
+TEST_F(ElfCache, ChangedFilesAreMappedAgain) {
+  ElfFile before(eapp);
+  std::vector<unsigned char> changed = image;
+  changed[DATA_OFFSET] ^= 0xff;
+
+  replace(eapp, changed);
+  ElfFile replaced(eapp);
+  EXPECT_FALSE(sameKey(before.getKey(), replaced.getKey()));
+  EXPECT_NE(before.getPtr(), replaced.getPtr());
+  EXPECT_EQ(((unsigned char*)replaced.getPtr())[DATA_OFFSET], changed[DATA_OFFSET]);
+  EXPECT_EQ(((unsigned char*)before.getPtr())[DATA_OFFSET], image[DATA_OFFSET]);
+
+  changed[DATA_OFFSET + 1] ^= 0xff;
+  rewrite(eapp, changed);
+  ElfFile rewritten(eapp);
+  EXPECT_FALSE(sameKey(replaced.getKey(), rewritten.getKey()));
+  EXPECT_NE(replaced.getPtr(), rewritten.getPtr());
+  EXPECT_EQ(
+      ((unsigned char*)rewritten.getPtr())[DATA_OFFSET + 1],
+      changed[DATA_OFFSET + 1]);
+}
+
+TEST_F(ElfCache, MeasurementFollowsFiles) {
+  std::string original = measure();
+  EXPECT_EQ(original, measureInMemory(image));
+  /* a second time from the memo */
+  EXPECT_EQ(measure(), original);
+
+  std::vector<unsigned char> changed = image;
+  changed[DATA_OFFSET] ^= 0xff;
+  replace(eapp, changed);
+  std::string replaced = measure();
+  EXPECT_NE(replaced, original);
+  EXPECT_EQ(replaced, measureInMemory(changed));
+
+  changed[DATA_OFFSET + 1] ^= 0xff;
+  rewrite(eapp, changed);
+  std::string rewritten = measure();
+  EXPECT_NE(rewritten, replaced);
+  EXPECT_EQ(rewritten, measureInMemory(changed));
+
+  /* the old contents under a new identity measure like before */
+  replace(eapp, image);
+  EXPECT_EQ(measure(), original);
+}
+
+TEST_F(ElfCache, LoadableOnlyIsMemoizedApart) {
+  std::string full     = measure();
+  std::string loadable = measure(true);
+
+  EXPECT_NE(full, loadable);
+  EXPECT_EQ(loadable, measureInMemory(image, true));
+  EXPECT_EQ(measure(), full);
+  EXPECT_EQ(measure(true), loadable);
+
+  /* a stripped copy is not what the key of its file stands for */
+  char hash[MDSIZE];
+  ElfFile loaderFile(loader);
+  ElfFile rtFile(rt);
+  ElfFile eappFile(eapp);
+  ASSERT_TRUE(eappFile.extractLoadable());
+  ASSERT_TRUE(rtFile.extractLoadable());
+  ASSERT_EQ(
+      Enclave::measure(hash, &eappFile, &rtFile, &loaderFile), Error::Success);
+  EXPECT_EQ(std::string(hash, MDSIZE), loadable);
+}
+
+int
+main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,119 @@
+//******************************************************************************
+// Copyright (c) 2020, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#include <keystone.h>
+
+#include <memory>
+#include <set>
+
+#include "fake_device.hpp"
+#include "gtest/gtest.h"
+
+/* any file will do as long as the fake device takes it */
+#define TEST_FILE "/proc/self/exe"
+
+using Keystone::Enclave;
+using Keystone::EnclavePool;
+using Keystone::Params;
+
+class Pool : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    FakeDevice::failCreate = false;
+    params.setUntrustedSize(8192);
+    params.setFreeMemSize(65536);
+    created = FakeDevice::created;
+  }
+
+  size_t createdSince() { return FakeDevice::created - created; }
+
+  Params params;
+  size_t created;
+};
+
+TEST_F(Pool, WarmupFillsToHighWatermark) {
+  EnclavePool pool(TEST_FILE, TEST_FILE, TEST_FILE, params, 1, 3, 2);
+
+  pool.warmup(3);
+  EXPECT_EQ(pool.getReady(), 3);
+  EXPECT_EQ(createdSince(), 3);
+  EXPECT_EQ(pool.getFailures(), 0);
+
+  /* never more than the high watermark */
+  pool.warmup(10);
+  EXPECT_EQ(pool.getReady(), 3);
+}
+
+TEST_F(Pool, AcquireHandsOutReadyEnclaves) {
+  EnclavePool pool(TEST_FILE, TEST_FILE, TEST_FILE, params, 1, 3);
+  std::set<Enclave*> handedOut;
+
+  pool.warmup(3);
+  std::unique_ptr<Enclave> first = pool.acquire();
+  ASSERT_NE(first, nullptr);
+  EXPECT_NE(first->getSharedBuffer(), nullptr);
+  handedOut.insert(first.get());
+
+  /* above the low watermark, so nothing new is built */
+  EXPECT_EQ(pool.getReady(), 2);
+  EXPECT_EQ(createdSince(), 3);
+
+  /* down to the low watermark, which refills the pool */
+  std::unique_ptr<Enclave> second = pool.acquire();
+  ASSERT_NE(second, nullptr);
+  handedOut.insert(second.get());
+  pool.warmup(3);
+  EXPECT_EQ(pool.getReady(), 3);
+  EXPECT_EQ(createdSince(), 5);
+
+  EXPECT_EQ(handedOut.size(), 2);
+  EXPECT_EQ(pool.getHits(), 2);
+  EXPECT_EQ(pool.getMisses(), 0);
+}
+
+TEST_F(Pool, MissWhileRefillIsOff) {
+  /* the refill thread fails and turns refilling off */
+  FakeDevice::failCreate = true;
+  EnclavePool pool(TEST_FILE, TEST_FILE, TEST_FILE, params, 0, 1);
+  pool.warmup(1);
+  EXPECT_EQ(pool.getReady(), 0);
+  EXPECT_GE(pool.getFailures(), 1);
+  uint64_t failures = pool.getFailures();
+
+  /* an empty pool initializes on the caller's thread */
+  FakeDevice::failCreate = false;
+  std::unique_ptr<Enclave> enclave = pool.acquire();
+  ASSERT_NE(enclave, nullptr);
+  EXPECT_EQ(pool.getHits(), 0);
+  EXPECT_EQ(pool.getMisses(), 1);
+  EXPECT_EQ(pool.getFailures(), failures);
+
+  /* and the miss turned refilling back on */
+  pool.warmup(1);
+  EXPECT_EQ(pool.getReady(), 1);
+  EXPECT_NE(pool.acquire(), nullptr);
+  EXPECT_EQ(pool.getHits(), 1);
+}
+
+TEST_F(Pool, BadImageFails) {
+  EnclavePool pool(
+      "/nonexistent/eapp", TEST_FILE, TEST_FILE, params, 1, 2);
+
+  /* returns once refilling gives up */
+  pool.warmup(2);
+  EXPECT_EQ(pool.getReady(), 0);
+  EXPECT_GE(pool.getFailures(), 1);
+  uint64_t failures = pool.getFailures();
+
+  EXPECT_EQ(pool.acquire(), nullptr);
+  EXPECT_EQ(pool.getMisses(), 1);
+  EXPECT_GE(pool.getFailures(), failures + 1);
+  EXPECT_EQ(createdSince(), 0);
+}
+
+int
+main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,157 @@
+//******************************************************************************
+// Copyright (c) 2020, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#include "fake_device.hpp"
+
+#include <cstdlib>
+#include <map>
+#include <mutex>
+
+#include "KeystoneDevice.hpp"
+
+namespace FakeDevice {
+
+std::atomic<size_t> created(0);
+std::atomic<bool> failCreate(false);
+
+static std::mutex stateLock;
+static RunFunc runFunc;
+
+/* KeystoneDevice has no room for any of this, so it is kept by device */
+struct State {
+  size_t utmSize;
+  bool finalized;
+  void* utm;
+};
+static std::map<const Keystone::KeystoneDevice*, State> states;
+
+void
+setRun(RunFunc func) {
+  std::lock_guard<std::mutex> guard(stateLock);
+  runFunc = func;
+}
+
+static Keystone::Error
+run(const Keystone::KeystoneDevice* dev, bool resume) {
+  RunFunc func;
+  State state;
+  {
+    std::lock_guard<std::mutex> guard(stateLock);
+    func  = runFunc;
+    state = states[dev];
+  }
+  if (!func) {
+    return Keystone::Error::Success;
+  }
+  return func(state.utm, state.utmSize, resume);
+}
+
+}  // namespace FakeDevice
+
+namespace Keystone {
+
+using FakeDevice::stateLock;
+using FakeDevice::states;
+
+KeystoneDevice::KeystoneDevice() {
+  eid          = -1;
+  fd           = -1;
+  runUntilEdge = true;
+}
+
+bool
+KeystoneDevice::initDevice(Params params) {
+  return true;
+}
+
+Error
+KeystoneDevice::create(uint64_t minPages) {
+  if (FakeDevice::failCreate) {
+    return Error::IoctlErrorCreate;
+  }
+  eid      = (int)FakeDevice::created++;
+  physAddr = 0x80000000;
+
+  std::lock_guard<std::mutex> guard(stateLock);
+  states[this] = FakeDevice::State();
+  return Error::Success;
+}
+
+uintptr_t
+KeystoneDevice::initUTM(size_t size) {
+  std::lock_guard<std::mutex> guard(stateLock);
+  states[this].utmSize = size;
+  return 0xc0000000;
+}
+
+Error
+KeystoneDevice::finalize(
+    uintptr_t runtimePhysAddr, uintptr_t eappPhysAddr, uintptr_t freePhysAddr,
+    uintptr_t freeRequested, uintptr_t timeslice, bool checkpoint) {
+  std::lock_guard<std::mutex> guard(stateLock);
+  states[this].finalized = true;
+  return Error::Success;
+}
+
+Error
+KeystoneDevice::destroy() {
+  std::lock_guard<std::mutex> guard(stateLock);
+  auto it = states.find(this);
+  if (it != states.end()) {
+    free(it->second.utm);
+    states.erase(it);
+  }
+  eid = -1;
+  return Error::Success;
+}
+
+Error
+KeystoneDevice::reset() {
+  return Error::Success;
+}
+
+Error
+KeystoneDevice::clone(int templateEid) {
+  return Error::Success;
+}
+
+Error
+KeystoneDevice::checkpoint(void* image, size_t size) {
+  return Error::IoctlErrorCheckpoint;
+}
+
+Error
+KeystoneDevice::restore(const void* image, size_t size) {
+  return Error::IoctlErrorRestore;
+}
+
+Error
+KeystoneDevice::run(uintptr_t* ret) {
+  return FakeDevice::run(this, false);
+}
+
+Error
+KeystoneDevice::resume(uintptr_t* ret) {
+  return FakeDevice::run(this, true);
+}
+
+/* the EPM before finalize, the UTM after; the UTM goes with the enclave */
+void*
+KeystoneDevice::map(uintptr_t addr, size_t size) {
+  void* ptr = calloc(1, size);
+
+  std::lock_guard<std::mutex> guard(stateLock);
+  FakeDevice::State& state = states[this];
+  if (state.finalized && state.utm == NULL) {
+    state.utm = ptr;
+  }
+  return ptr;
+}
+
+void
+KeystoneDevice::unmap(void* ptr, size_t size) {
+  free(ptr);
+}
+
+}  // namespace Keystone
@@ -0,0 +1,31 @@
+//******************************************************************************
+// Copyright (c) 2020, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+
+#include "Error.hpp"
+
+/* Tests that create enclaves link fake_device.cpp instead of
+ * KeystoneDevice.cpp: the EPM and the UTM are plain host memory and
+ * the enclave itself is fakeDeviceRun. */
+namespace FakeDevice {
+
+/* Called for run (resume == false) and for every resume with the
+ * enclave's untrusted buffer, i.e. what the eapp would see. Returns
+ * Error::EdgeCallHost to stop in an edge call, Error::Success to exit.
+ * By default the enclave exits right away. */
+typedef std::function<Keystone::Error(void* buffer, size_t size, bool resume)>
+    RunFunc;
+void setRun(RunFunc func);
+
+/* enclaves that made it to the driver's create call */
+extern std::atomic<size_t> created;
+/* makes create fail, like a driver out of EPM */
+extern std::atomic<bool> failCreate;
+
+}  // namespace FakeDevice
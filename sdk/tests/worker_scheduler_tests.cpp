@@ -0,0 +1,291 @@
+//******************************************************************************
+// Copyright (c) 2020, The Regents of the University of California (Regents).
+// All Rights Reserved. See LICENSE for license details.
+//------------------------------------------------------------------------------
+#include <keystone.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "WorkerScheduler.hpp"
+#include "edge/edge_common.h"
+#include "fake_device.hpp"
+#include "gtest/gtest.h"
+extern "C" {
+#include "shared/worker_call.h"
+}
+
+#define TEST_FILE "/proc/self/exe"
+#define OTHER_CALL 42
+
+using Keystone::Error;
+using Keystone::JobResult;
+using Keystone::Params;
+using Keystone::WorkerScheduler;
+
+/* Jobs starting with one of these make the fake worker misbehave */
+#define JOB_BLOCK '#'
+#define JOB_WRONG_ID '!'
+
+static std::mutex blockLock;
+static std::condition_variable blockCond;
+static bool blocked;
+static bool released;
+
+/* the fake worker's only state, kept on the thread that runs its enclave */
+static thread_local bool greeted;
+static std::atomic<unsigned long> otherCallStatus;
+
+/* Does what worker_loop() does: reports the result of the last job and
+ * asks for the next one. A job's output is its input reversed and its
+ * status is the input length. With greet, it first makes an edge call
+ * that is not part of the worker protocol. */
+static Error
+fakeWorker(void* buffer, size_t size, bool resume, bool greet) {
+  struct edge_call* call = (struct edge_call*)buffer;
+  struct worker_msg* msg =
+      (struct worker_msg*)((uintptr_t)buffer + sizeof(struct edge_call));
+  std::vector<unsigned char> input;
+  uint64_t id = WORKER_JOB_NONE;
+
+  if (!resume) {
+    greeted = false;
+  }
+  if (greet && !greeted) {
+    if (resume) {
+      otherCallStatus = call->return_data.call_status;
+      greeted         = true;
+      resume          = false;
+    } else {
+      call->call_id         = OTHER_CALL;
+      call->call_arg_offset = 0;
+      call->call_arg_size   = 0;
+      return Error::EdgeCallHost;
+    }
+  }
+
+  if (resume) {
+    if (call->return_data.call_status != CALL_STATUS_OK) {
+      return Error::DeviceError;
+    }
+    struct worker_msg* job =
+        (struct worker_msg*)((uintptr_t)buffer + call->return_data.call_ret_offset);
+    if (job->flags & WORKER_MSG_EXIT) {
+      return Error::Success;
+    }
+    id = job->job_id;
+    input.assign(job->data, job->data + job->len);
+  }
+
+  if (!input.empty() && input[0] == JOB_BLOCK) {
+    std::unique_lock<std::mutex> guard(blockLock);
+    blocked = true;
+    blockCond.notify_all();
+    blockCond.wait(guard, [] { return released; });
+  }
+
+  msg->job_id = id;
+  if (!input.empty() && input[0] == JOB_WRONG_ID) {
+    msg->job_id++;
+  }
+  msg->flags  = 0;
+  msg->status = input.size();
+  msg->len    = input.size();
+  std::reverse_copy(input.begin(), input.end(), msg->data);
+
+  call->call_id         = WORKER_CALL_NEXT_JOB;
+  call->call_arg_offset = sizeof(struct edge_call);
+  call->call_arg_size   = sizeof(struct worker_msg) + input.size();
+  return Error::EdgeCallHost;
+}
+
+class Scheduler : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    FakeDevice::failCreate = false;
+    FakeDevice::setRun([](void* buffer, size_t size, bool resume) {
+      return fakeWorker(buffer, size, resume, false);
+    });
+    blocked  = false;
+    released = false;
+    params.setUntrustedSize(8192);
+    params.setFreeMemSize(65536);
+  }
+
+  void TearDown() override { FakeDevice::setRun(nullptr); }
+
+  Error submit(
+      WorkerScheduler* scheduler, const std::string& data,
+      std::future<JobResult>* result) {
+    return scheduler->submit(data.data(), data.size(), result);
+  }
+
+  static std::string output(const JobResult& result) {
+    return std::string(result.output.begin(), result.output.end());
+  }
+
+  Params params;
+};
+
+TEST_F(Scheduler, RunsEveryJob) {
+  WorkerScheduler scheduler(TEST_FILE, TEST_FILE, TEST_FILE, params, 2);
+  std::vector<std::future<JobResult>> results(50);
+
+  ASSERT_EQ(scheduler.start(), Error::Success);
+  EXPECT_EQ(scheduler.getWorkers(), 2);
+
+  for (size_t i = 0; i < results.size(); i++) {
+    ASSERT_EQ(submit(&scheduler, "job " + std::to_string(i), &results[i]),
+              Error::Success);
+  }
+  for (size_t i = 0; i < results.size(); i++) {
+    std::string input = "job " + std::to_string(i);
+    JobResult result  = results[i].get();
+    EXPECT_EQ(result.status, (int64_t)input.size());
+    EXPECT_EQ(output(result), std::string(input.rbegin(), input.rend()));
+  }
+
+  scheduler.stop();
+  EXPECT_EQ(scheduler.getCompleted(), results.size());
+  EXPECT_EQ(scheduler.getWorkers(), 0);
+}
+
+TEST_F(Scheduler, StopFinishesQueuedJobs) {
+  WorkerScheduler scheduler(TEST_FILE, TEST_FILE, TEST_FILE, params, 1);
+  std::vector<std::future<JobResult>> results(10);
+
+  ASSERT_EQ(scheduler.start(), Error::Success);
+  for (auto& result : results) {
+    ASSERT_EQ(submit(&scheduler, "queued", &result), Error::Success);
+  }
+  scheduler.stop();
+
+  for (auto& result : results) {
+    EXPECT_EQ(result.get().status, 6);
+  }
+  EXPECT_EQ(scheduler.getCompleted(), results.size());
+}
+
+TEST_F(Scheduler, IdleWorkerSteals) {
+  WorkerScheduler scheduler(TEST_FILE, TEST_FILE, TEST_FILE, params, 2);
+  std::future<JobResult> stuck;
+  std::vector<std::future<JobResult>> results(20);
+
+  ASSERT_EQ(scheduler.start(), Error::Success);
+
+  /* the first job goes to the first worker, which then hangs on it */
+  ASSERT_EQ(submit(&scheduler, std::string(1, JOB_BLOCK), &stuck),
+            Error::Success);
+  {
+    std::unique_lock<std::mutex> guard(blockLock);
+    blockCond.wait(guard, [] { return blocked; });
+  }
+
+  /* half of these are queued behind it, and the other worker steals them */
+  for (auto& result : results) {
+    ASSERT_EQ(submit(&scheduler, "stolen", &result), Error::Success);
+  }
+  for (auto& result : results) {
+    EXPECT_EQ(output(result.get()), "nelots");
+  }
+  EXPECT_GE(scheduler.getSteals(), results.size() / 2);
+
+  {
+    std::lock_guard<std::mutex> guard(blockLock);
+    released = true;
+  }
+  blockCond.notify_all();
+  EXPECT_EQ(stuck.get().status, 1);
+}
+
+TEST_F(Scheduler, ResultForWrongJobFails) {
+  WorkerScheduler scheduler(TEST_FILE, TEST_FILE, TEST_FILE, params, 1);
+  std::future<JobResult> bad, good;
+
+  ASSERT_EQ(scheduler.start(), Error::Success);
+  ASSERT_EQ(submit(&scheduler, std::string(1, JOB_WRONG_ID), &bad),
+            Error::Success);
+  ASSERT_EQ(submit(&scheduler, "fine", &good), Error::Success);
+
+  JobResult result = bad.get();
+  EXPECT_EQ(result.status, -1);
+  EXPECT_TRUE(result.output.empty());
+  EXPECT_EQ(good.get().status, 4);
+}
+
+TEST_F(Scheduler, OtherCallsGoToFallback) {
+  std::atomic<size_t> calls(0);
+  FakeDevice::setRun([](void* buffer, size_t size, bool resume) {
+    return fakeWorker(buffer, size, resume, true);
+  });
+
+  {
+    WorkerScheduler scheduler(TEST_FILE, TEST_FILE, TEST_FILE, params, 2);
+    scheduler.setOcallDispatch([&calls](void* buffer) {
+      struct edge_call* call = (struct edge_call*)buffer;
+      EXPECT_EQ(call->call_id, OTHER_CALL);
+      call->return_data.call_status = CALL_STATUS_OK;
+      calls++;
+    });
+    otherCallStatus = CALL_STATUS_ERROR;
+    ASSERT_EQ(scheduler.start(), Error::Success);
+    scheduler.stop();
+  }
+  EXPECT_EQ(calls, 2);
+  EXPECT_EQ(otherCallStatus, CALL_STATUS_OK);
+
+  /* without one, the call is refused */
+  {
+    WorkerScheduler scheduler(TEST_FILE, TEST_FILE, TEST_FILE, params, 1);
+    ASSERT_EQ(scheduler.start(), Error::Success);
+    scheduler.stop();
+  }
+  EXPECT_EQ(otherCallStatus, CALL_STATUS_BAD_CALL_ID);
+}
+
+TEST_F(Scheduler, Rejects) {
+  WorkerScheduler scheduler(TEST_FILE, TEST_FILE, TEST_FILE, params, 1);
+  std::future<JobResult> result;
+  std::vector<unsigned char> big(WORKER_MSG_DATA_MAX + 1);
+
+  /* not started */
+  EXPECT_EQ(submit(&scheduler, "early", &result), Error::JobRejected);
+
+  ASSERT_EQ(scheduler.start(), Error::Success);
+  EXPECT_EQ(
+      scheduler.submit(big.data(), big.size(), &result), Error::JobRejected);
+  EXPECT_EQ(
+      scheduler.submit(big.data(), WORKER_MSG_DATA_MAX, &result),
+      Error::Success);
+  EXPECT_EQ(result.get().status, (int64_t)WORKER_MSG_DATA_MAX);
+}
+
+TEST_F(Scheduler, StartFailures) {
+  /* no room for a job after the edge call header */
+  Params small = params;
+  small.setUntrustedSize(WORKER_MSG_MAX);
+  WorkerScheduler tooSmall(TEST_FILE, TEST_FILE, TEST_FILE, small, 1);
+  EXPECT_EQ(tooSmall.start(), Error::JobRejected);
+  EXPECT_EQ(tooSmall.getWorkers(), 0);
+
+  FakeDevice::failCreate = true;
+  WorkerScheduler noDevice(TEST_FILE, TEST_FILE, TEST_FILE, params, 2);
+  EXPECT_EQ(noDevice.start(), Error::DeviceError);
+  EXPECT_EQ(noDevice.getWorkers(), 0);
+
+  WorkerScheduler noImage("/nonexistent/eapp", TEST_FILE, TEST_FILE, params, 2);
+  EXPECT_EQ(noImage.start(), Error::FileInitFailure);
+  EXPECT_EQ(noImage.getWorkers(), 0);
+}
+
+int
+main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -8,6 +8,7 @@
 #include "page.h"
 #include "cpu.h"
 #include "platform-hook.h"
+#include "hmac_sha3/hmac_sha3.h"
 #include <sbi/sbi_string.h>
 #include <sbi/riscv_asm.h>
 #include <sbi/riscv_locks.h>
@@ -54,6 +55,8 @@ static inline void context_switch_to_enclave(struct sbi_trap_regs* regs,
     // passing parameters for a first run
     regs->mepc = (uintptr_t) enclaves[eid].params.dram_base - 4; // regs->mepc will be +4 before sbi_ecall_handler return
     regs->mstatus = (1 << MSTATUS_MPP_SHIFT);
+    // $a0: timeslice (cycles) requested by the host, 0 = tickless
+    regs->a0 = (uintptr_t) enclaves[eid].params.timeslice;
     // $a1: (PA) DRAM base,
     regs->a1 = (uintptr_t) enclaves[eid].params.dram_base;
     // $a2: DRAM size,
@@ -79,7 +82,8 @@ static inline void context_switch_to_enclave(struct sbi_trap_regs* regs,
   osm_pmp_set(PMP_NO_PERM);
   int memid;
   for(memid=0; memid < ENCLAVE_REGIONS_MAX; memid++) {
-    if(enclaves[eid].regions[memid].type != REGION_INVALID) {
+    if(enclaves[eid].regions[memid].type != REGION_INVALID &&
+       enclaves[eid].regions[memid].type != REGION_CHECKPOINT) {
       pmp_set_keystone(enclaves[eid].regions[memid].pmp_rid, PMP_ALL_PERM);
     }
   }
@@ -96,7 +100,8 @@ static inline void context_switch_to_host(struct sbi_trap_regs *regs,
   // set PMP
   int memid;
   for(memid=0; memid < ENCLAVE_REGIONS_MAX; memid++) {
-    if(enclaves[eid].regions[memid].type != REGION_INVALID) {
+    if(enclaves[eid].regions[memid].type != REGION_INVALID &&
+       enclaves[eid].regions[memid].type != REGION_CHECKPOINT) {
       pmp_set_keystone(enclaves[eid].regions[memid].pmp_rid, PMP_NO_PERM);
     }
   }
@@ -318,10 +323,286 @@ static int is_create_args_valid(struct keystone_sbi_create_t* args)
     return 0;
   if (args->user_paddr > args->free_paddr)
     return 0;
-  
+
+  // the checkpoint must hold everything below free memory
+  if (args->checkpoint_region.size &&
+      (args->checkpoint_region.paddr >=
+       args->checkpoint_region.paddr + args->checkpoint_region.size ||
+       args->checkpoint_region.size < args->free_paddr - epm_start))
+    return 0;
+
   return 1;
 }
 
+/* What a clone needs from its template, read under encl_lock */
+struct enclave_template
+{
+  enclave_id eid;
+  struct runtime_params_t params;
+  byte hash[MDSIZE];
+};
+
+/* Fills the EPM of an enclave being created and sets its hash. Called
+ * with encl_lock held. */
+typedef unsigned long (*enclave_fill_fn)(struct enclave* enclave, void* arg);
+
+/* Measures the pages the host loaded */
+static unsigned long measure_enclave_epm(struct enclave* enclave, void* arg)
+{
+  return validate_and_hash_enclave(enclave);
+}
+
+/* Fills a new enclave with the measured pages of its template instead of
+ * hashing them. The template may have been destroyed (and its eid reused)
+ * since it was looked up, so it must still be the same FRESH image. */
+static unsigned long copy_template_epm(struct enclave* enclave, void* arg)
+{
+  struct enclave_template* tmpl = (struct enclave_template*) arg;
+  struct enclave* src = &enclaves[tmpl->eid];
+
+  if(src->state != FRESH
+     || src->params.dram_base != tmpl->params.dram_base
+     || src->params.free_base != tmpl->params.free_base
+     || sbi_memcmp(src->hash, tmpl->hash, MDSIZE) != 0)
+    return SBI_ERR_SM_ENCLAVE_NOT_FRESH;
+
+  sbi_memcpy((void*) enclave->params.dram_base, (void*) src->params.dram_base,
+             src->params.free_base - src->params.dram_base);
+  sbi_memcpy(enclave->hash, src->hash, MDSIZE);
+  return SBI_ERR_SM_ENCLAVE_SUCCESS;
+}
+
+/****************************
+ *
+ * Checkpoint images
+ *
+ ****************************/
+
+#if __riscv_xlen == 32
+#define CHECKPOINT_SATP_PPN SATP32_PPN
+#else
+#define CHECKPOINT_SATP_PPN SATP64_PPN
+#endif
+
+_Static_assert(sizeof(struct thread_state) <= SM_CHECKPOINT_STATE_SIZE,
+               "thread state does not fit its checkpoint chunk");
+
+/* One chunk of an image on its way in or out; used under encl_lock */
+static byte checkpoint_buf[RISCV_PGSIZE];
+
+struct checkpoint_stream
+{
+  byte enc_key[MDSIZE];
+  byte mac_key[MDSIZE];
+  byte nonce[SM_CHECKPOINT_NONCE_SIZE];
+  uint64_t ctr;
+  hmac_sha3_ctx_t mac;
+};
+
+/* The keys come from the SM's private key and the measurement, so only
+ * this SM can open an image, and only for the measurement it was taken
+ * of; the enclave itself cannot derive them. The nonce makes them unique
+ * to the image. The header is the first thing MAC'd. */
+static int checkpoint_stream_init(struct checkpoint_stream* s,
+                                  struct keystone_sbi_checkpoint_t* hdr)
+{
+  byte seal[SEALING_KEY_SIZE];
+  byte keys[2 * MDSIZE];
+  int ret;
+
+  ret = sm_derive_checkpoint_key(seal, hdr->hash);
+  if(!ret)
+    ret = kdf(hdr->nonce, SM_CHECKPOINT_NONCE_SIZE, seal, SEALING_KEY_SIZE,
+              NULL, 0, keys, sizeof(keys));
+  sbi_memcpy(s->enc_key, keys, MDSIZE);
+  sbi_memcpy(s->mac_key, keys + MDSIZE, MDSIZE);
+  sbi_memset(seal, 0, SEALING_KEY_SIZE);
+  sbi_memset(keys, 0, sizeof(keys));
+  if(ret)
+    return ret;
+
+  sbi_memcpy(s->nonce, hdr->nonce, SM_CHECKPOINT_NONCE_SIZE);
+  s->ctr = 0;
+  hmac_sha3_init(&s->mac, s->mac_key, MDSIZE);
+  hmac_sha3_update(&s->mac, (unsigned char*) hdr,
+                   sizeof(*hdr) - SM_CHECKPOINT_MAC_SIZE);
+  return 0;
+}
+
+static void checkpoint_stream_wipe(struct checkpoint_stream* s)
+{
+  sbi_memset(s, 0, sizeof(*s));
+  sbi_memset(checkpoint_buf, 0, RISCV_PGSIZE);
+}
+
+/* SHA3-512 of key, nonce and block counter as a keystream; XORing it in
+ * both encrypts and decrypts. len is a multiple of MDSIZE. */
+static void checkpoint_crypt(struct checkpoint_stream* s, size_t len)
+{
+  hash_ctx ctx;
+  byte stream[MDSIZE];
+  size_t i, j;
+
+  for(i = 0; i < len; i += MDSIZE) {
+    hash_init(&ctx);
+    hash_extend(&ctx, s->enc_key, MDSIZE);
+    hash_extend(&ctx, s->nonce, SM_CHECKPOINT_NONCE_SIZE);
+    hash_extend(&ctx, &s->ctr, sizeof(s->ctr));
+    hash_finalize(stream, &ctx);
+    s->ctr++;
+
+    for(j = 0; j < MDSIZE; j++)
+      checkpoint_buf[i + j] ^= stream[j];
+  }
+  sbi_memset(stream, 0, MDSIZE);
+}
+
+/* Encrypts checkpoint_buf and hands it to the host */
+static int put_checkpoint_chunk(struct checkpoint_stream* s,
+                                uintptr_t dst, size_t len)
+{
+  checkpoint_crypt(s, len);
+  hmac_sha3_update(&s->mac, checkpoint_buf, len);
+  return copy_from_sm(dst, checkpoint_buf, len);
+}
+
+/* Fetches a chunk from the host into checkpoint_buf and decrypts it. The
+ * MAC is taken over exactly the bytes that get decrypted, so the host
+ * can't change the image while it is being read. */
+static int get_checkpoint_chunk(struct checkpoint_stream* s,
+                                uintptr_t src, size_t len)
+{
+  if(copy_to_sm(checkpoint_buf, src, len))
+    return -1;
+  hmac_sha3_update(&s->mac, checkpoint_buf, len);
+  checkpoint_crypt(s, len);
+  return 0;
+}
+
+static int checkpoint_mac_equal(const byte* a, const byte* b)
+{
+  byte diff = 0;
+  int i;
+
+  for(i = 0; i < SM_CHECKPOINT_MAC_SIZE; i++)
+    diff |= a[i] ^ b[i];
+  return diff == 0;
+}
+
+/* Rebases a PA from the EPM or UTM the enclave was checkpointed in to the
+ * one it is restored into. Anything else can't be moved. */
+static int relocate_checkpoint_pa(uintptr_t* pa,
+                                  struct runtime_params_t* from,
+                                  struct runtime_params_t* to)
+{
+  if(*pa >= from->dram_base && *pa - from->dram_base < from->dram_size)
+    *pa = *pa - from->dram_base + to->dram_base;
+  else if(*pa >= from->untrusted_base &&
+          *pa - from->untrusted_base < from->untrusted_size)
+    *pa = *pa - from->untrusted_base + to->untrusted_base;
+  else
+    return -1;
+  return 0;
+}
+
+/* Rewrites every valid PTE below a (new) page table. Tables must live in
+ * the EPM and superpages must stay aligned after the move. */
+static int relocate_page_table(uintptr_t table, int level,
+                               struct runtime_params_t* from,
+                               struct runtime_params_t* to)
+{
+  uintptr_t* ptes = (uintptr_t*) table;
+  uintptr_t pa, flags;
+  size_t i;
+
+  for(i = 0; i < RISCV_PGSIZE / sizeof(uintptr_t); i++) {
+    if(!(ptes[i] & PTE_V))
+      continue;
+
+    pa = (ptes[i] >> PTE_PPN_SHIFT) << RISCV_PGSHIFT;
+    flags = ptes[i] & ((1UL << PTE_PPN_SHIFT) - 1);
+    if(relocate_checkpoint_pa(&pa, from, to))
+      return -1;
+
+    if(flags & (PTE_R | PTE_W | PTE_X)) {
+      if(pa & ((RISCV_PGSIZE << (level * RISCV_PGLEVEL_BITS)) - 1))
+        return -1;
+    } else {
+      if(level == 0 || pa < to->dram_base || pa - to->dram_base >= to->dram_size)
+        return -1;
+      if(relocate_page_table(pa, level - 1, from, to))
+        return -1;
+    }
+    ptes[i] = ((pa >> RISCV_PGSHIFT) << PTE_PPN_SHIFT) | flags;
+  }
+  return 0;
+}
+
+struct checkpoint_restore
+{
+  struct keystone_sbi_checkpoint_t hdr;
+  uintptr_t image;
+};
+
+/* Decrypts a checkpoint into a new enclave's EPM and moves its page
+ * tables and thread state over. Nothing of the image is kept unless the
+ * MAC over all of it matches. */
+static unsigned long restore_checkpoint_epm(struct enclave* enclave, void* arg)
+{
+  struct checkpoint_restore* restore = (struct checkpoint_restore*) arg;
+  struct keystone_sbi_checkpoint_t* hdr = &restore->hdr;
+  struct checkpoint_stream s;
+  struct thread_state thread;
+  byte mac[SM_CHECKPOINT_MAC_SIZE];
+  uintptr_t src = restore->image + sizeof(*hdr);
+  uintptr_t base = enclave->params.dram_base;
+  uintptr_t end = base + enclave->params.dram_size;
+  uintptr_t page, root;
+  unsigned long ret = SBI_ERR_SM_ENCLAVE_UNKNOWN_ERROR;
+
+  if(checkpoint_stream_init(&s, hdr))
+    goto wipe;
+
+  ret = SBI_ERR_SM_ENCLAVE_CHECKPOINT_INVALID;
+  if(get_checkpoint_chunk(&s, src, SM_CHECKPOINT_STATE_SIZE))
+    goto wipe;
+  sbi_memcpy(&thread, checkpoint_buf, sizeof(thread));
+  src += SM_CHECKPOINT_STATE_SIZE;
+
+  for(page = base; page < end; page += RISCV_PGSIZE, src += RISCV_PGSIZE) {
+    if(get_checkpoint_chunk(&s, src, RISCV_PGSIZE))
+      goto wipe;
+    sbi_memcpy((void*) page, checkpoint_buf, RISCV_PGSIZE);
+  }
+
+  hmac_sha3_final(&s.mac, mac);
+  if(!checkpoint_mac_equal(mac, hdr->mac))
+    goto wipe;
+
+  /* the image is authentic, point it at its new home */
+  root = (thread.prev_csrs.satp & CHECKPOINT_SATP_PPN) << RISCV_PGSHIFT;
+  if(relocate_checkpoint_pa(&root, &hdr->params, &enclave->params)
+     || root < base || root >= end
+     || relocate_page_table(root, RISCV_PGLEVEL_TOP - 1,
+                            &hdr->params, &enclave->params))
+    goto wipe;
+  thread.prev_csrs.satp = (thread.prev_csrs.satp & ~CHECKPOINT_SATP_PPN)
+                          | (root >> RISCV_PGSHIFT);
+
+  enclave->threads[0] = thread;
+  sbi_memcpy(enclave->hash, hdr->hash, MDSIZE);
+  enclave->restored = 1;
+  enclave->state = STOPPED;
+  ret = SBI_ERR_SM_ENCLAVE_SUCCESS;
+
+wipe:
+  if(ret)
+    sbi_memset((void*) base, 0, end - base);
+  checkpoint_stream_wipe(&s);
+  sbi_memset(&thread, 0, sizeof(thread));
+  return ret;
+}
+
 /*********************************
  *
  * Enclave SBI functions
@@ -330,22 +611,25 @@ static int is_create_args_valid(struct keystone_sbi_create_t* args)
  *********************************/
 
 
-/* This handles creation of a new enclave, based on arguments provided
- * by the untrusted host.
- *
- * This may fail if: it cannot allocate PMP regions, EIDs, etc
+/* Creates an enclave whose EPM is filled by fill: measuring the pages
+ * the host loaded, copying a template's measured pages or decrypting a
+ * checkpoint. The latter two keep the hash they came with.
  */
-unsigned long create_enclave(unsigned long *eidptr, struct keystone_sbi_create_t create_args)
+static unsigned long __create_enclave(unsigned long *eidptr,
+                                      struct keystone_sbi_create_t create_args,
+                                      enclave_fill_fn fill, void* arg)
 {
   /* EPM and UTM parameters */
   uintptr_t base = create_args.epm_region.paddr;
   size_t size = create_args.epm_region.size;
   uintptr_t utbase = create_args.utm_region.paddr;
   size_t utsize = create_args.utm_region.size;
+  uintptr_t ckbase = create_args.checkpoint_region.paddr;
+  size_t cksize = create_args.checkpoint_region.size;
 
   enclave_id eid;
   unsigned long ret;
-  int region, shared_region;
+  int region, shared_region, ckpt_region = -1;
 
   /* Runtime parameters */
   if(!is_create_args_valid(&create_args))
@@ -361,6 +645,7 @@ unsigned long create_enclave(unsigned long *eidptr, struct keystone_sbi_create_t
   params.untrusted_base = utbase;
   params.untrusted_size = utsize;
   params.free_requested = create_args.free_requested;
+  params.timeslice = create_args.timeslice;
 
 
   // allocate eid
@@ -381,6 +666,14 @@ unsigned long create_enclave(unsigned long *eidptr, struct keystone_sbi_create_t
   if(pmp_set_global(region, PMP_NO_PERM))
     goto free_shared_region;
 
+  // the checkpoint is never accessible to anyone but the SM
+  if(cksize) {
+    if(pmp_region_init_atomic(ckbase, cksize, PMP_PRI_ANY, &ckpt_region, 0))
+      goto unset_region;
+    if(pmp_set_global(ckpt_region, PMP_NO_PERM))
+      goto free_ckpt_region;
+  }
+
   // cleanup some memory regions for sanity See issue #38
   clean_enclave_memory(utbase, utsize);
 
@@ -392,12 +685,17 @@ unsigned long create_enclave(unsigned long *eidptr, struct keystone_sbi_create_t
   enclaves[eid].regions[0].type = REGION_EPM;
   enclaves[eid].regions[1].pmp_rid = shared_region;
   enclaves[eid].regions[1].type = REGION_UTM;
+  if(ckpt_region != -1) {
+    enclaves[eid].regions[2].pmp_rid = ckpt_region;
+    enclaves[eid].regions[2].type = REGION_CHECKPOINT;
+  }
 #if __riscv_xlen == 32
   enclaves[eid].encl_satp = ((base >> RISCV_PGSHIFT) | (SATP_MODE_SV32 << HGATP_MODE_SHIFT));
 #else
   enclaves[eid].encl_satp = ((base >> RISCV_PGSHIFT) | (SATP_MODE_SV39 << HGATP_MODE_SHIFT));
 #endif
   enclaves[eid].n_thread = 0;
+  enclaves[eid].restored = 0;
   enclaves[eid].params = params;
 
   /* Init enclave state (regs etc) */
@@ -407,17 +705,24 @@ unsigned long create_enclave(unsigned long *eidptr, struct keystone_sbi_create_t
      it may modify the enclave struct */
   ret = platform_create_enclave(&enclaves[eid]);
   if (ret)
-    goto unset_region;
+    goto unset_ckpt_region;
 
   /* Validate memory, prepare hash and signature for attestation */
   spin_lock(&encl_lock); // FIXME This should error for second enter.
  
-  ret = validate_and_hash_enclave(&enclaves[eid]);
-  /* The enclave is fresh if it has been validated and hashed but not run yet. */
+  ret = fill(&enclaves[eid], arg);
   if (ret)
     goto unlock;
 
-  enclaves[eid].state = FRESH;
+  /* The pages are exactly what was measured, keep them for reset */
+  if(ckpt_region != -1)
+    sbi_memcpy((void*) ckbase, (void*) enclaves[eid].params.dram_base,
+               enclaves[eid].params.free_base - enclaves[eid].params.dram_base);
+
+  /* The enclave is fresh if it has been validated and hashed but not run
+   * yet. A restored one comes back STOPPED. */
+  if(enclaves[eid].state != STOPPED)
+    enclaves[eid].state = FRESH;
   /* EIDs are unsigned int in size, copy via simple copy */
   *eidptr = eid;
 
@@ -428,6 +733,14 @@ unlock:
   spin_unlock(&encl_lock);
 // free_platform:
   platform_destroy_enclave(&enclaves[eid]);
+unset_ckpt_region:
+  if(ckpt_region != -1)
+    pmp_unset_global(ckpt_region);
+free_ckpt_region:
+  if(ckpt_region != -1) {
+    pmp_region_free_atomic(ckpt_region);
+    enclaves[eid].regions[2].type = REGION_INVALID;
+  }
 unset_region:
   pmp_unset_global(region);
 free_shared_region:
@@ -440,6 +753,59 @@ error:
   return ret;
 }
 
+/* This handles creation of a new enclave, based on arguments provided
+ * by the untrusted host.
+ *
+ * This may fail if: it cannot allocate PMP regions, EIDs, etc
+ */
+unsigned long create_enclave(unsigned long *eidptr, struct keystone_sbi_create_t create_args)
+{
+  return __create_enclave(eidptr, create_args, measure_enclave_epm, NULL);
+}
+
+/*
+ * Creates an enclave as a copy of a FRESH template enclave. Only the EPM
+ * and UTM regions (and optionally a checkpoint) come from the host; the
+ * layout, the parameters and the measurement are the template's, so the
+ * EPM must be the same size. Costs a copy of the image instead of a file
+ * load and a hash over it.
+ */
+unsigned long clone_enclave(unsigned long *eidptr, enclave_id template_eid,
+                            struct keystone_sbi_create_t create_args)
+{
+  struct enclave_template tmpl;
+  uintptr_t base = create_args.epm_region.paddr;
+  int cloneable;
+
+  spin_lock(&encl_lock);
+  cloneable = (ENCLAVE_EXISTS(template_eid)
+               && enclaves[template_eid].state == FRESH);
+  if(cloneable) {
+    tmpl.eid = template_eid;
+    tmpl.params = enclaves[template_eid].params;
+    sbi_memcpy(tmpl.hash, enclaves[template_eid].hash, MDSIZE);
+  }
+  spin_unlock(&encl_lock);
+
+  if(!cloneable)
+    return SBI_ERR_SM_ENCLAVE_NOT_FRESH;
+
+  if(create_args.epm_region.size != tmpl.params.dram_size)
+    return SBI_ERR_SM_ENCLAVE_ILLEGAL_ARGUMENT;
+
+  /* same offsets inside the new EPM */
+  create_args.runtime_paddr = base +
+      (tmpl.params.runtime_base - tmpl.params.dram_base);
+  create_args.user_paddr = base +
+      (tmpl.params.user_base - tmpl.params.dram_base);
+  create_args.free_paddr = base +
+      (tmpl.params.free_base - tmpl.params.dram_base);
+  create_args.free_requested = tmpl.params.free_requested;
+  create_args.timeslice = tmpl.params.timeslice;
+
+  return __create_enclave(eidptr, create_args, copy_template_epm, &tmpl);
+}
+
 /*
  * Fully destroys an enclave
  * Deallocates EID, clears epm, etc
@@ -579,7 +945,7 @@ unsigned long stop_enclave(struct sbi_trap_regs *regs, uint64_t request, enclave
 
 unsigned long resume_enclave(struct sbi_trap_regs *regs, enclave_id eid)
 {
-  int resumable;
+  int resumable, restored = 0;
 
   spin_lock(&encl_lock);
   resumable = (ENCLAVE_EXISTS(eid)
@@ -592,15 +958,188 @@ unsigned long resume_enclave(struct sbi_trap_regs *regs, enclave_id eid)
   } else {
     enclaves[eid].n_thread++;
     enclaves[eid].state = RUNNING;
+    restored = enclaves[eid].restored;
+    enclaves[eid].restored = 0;
   }
   spin_unlock(&encl_lock);
 
   // Enclave is OK to resume, context switch to it
   context_switch_to_enclave(regs, eid, 0);
 
+  /* The pending edge call returns this to a restored enclave, along with
+   * the DRAM base its runtime has to rebase its PAs to */
+  if(restored) {
+    regs->a1 = enclaves[eid].params.dram_base;
+    return SBI_ERR_SM_ENCLAVE_RESTORED;
+  }
+
   return SBI_ERR_SM_ENCLAVE_SUCCESS;
 }
 
+/*
+ * Returns an enclave that is not running to the state it had right
+ * after create: the loader, runtime and eapp pages are restored from the
+ * checkpoint, free memory and the UTM are cleared, and the thread state
+ * starts over. The measurement stays valid, so the enclave is FRESH
+ * again. Only works for enclaves created with a checkpoint region.
+ */
+unsigned long reset_enclave(enclave_id eid)
+{
+  int resettable;
+  int ckpt, utm;
+  uintptr_t base, free, end;
+
+  spin_lock(&encl_lock);
+  ckpt = ENCLAVE_EXISTS(eid) ?
+         get_enclave_region_index(eid, REGION_CHECKPOINT) : -1;
+  resettable = (ckpt != -1
+                && (enclaves[eid].state == FRESH ||
+                    enclaves[eid].state == STOPPED)
+                && enclaves[eid].n_thread == 0);
+
+  if(!resettable) {
+    spin_unlock(&encl_lock);
+    return SBI_ERR_SM_ENCLAVE_NOT_RESETTABLE;
+  }
+
+  /* Held throughout, like the hashing in create, so nothing can destroy
+   * or run the enclave while its memory is being rewritten */
+  base = enclaves[eid].params.dram_base;
+  free = enclaves[eid].params.free_base;
+  end = base + enclaves[eid].params.dram_size;
+
+  sbi_memcpy((void*) base, (void*) get_enclave_region_base(eid, ckpt),
+             free - base);
+  sbi_memset((void*) free, 0, end - free);
+
+  utm = get_enclave_region_index(eid, REGION_UTM);
+  if(utm != -1)
+    clean_enclave_memory(get_enclave_region_base(eid, utm),
+                         get_enclave_region_size(eid, utm));
+
+  clean_state(&enclaves[eid].threads[0]);
+  enclaves[eid].n_thread = 0;
+  enclaves[eid].state = FRESH;
+  spin_unlock(&encl_lock);
+
+  return SBI_ERR_SM_ENCLAVE_SUCCESS;
+}
+
+/*
+ * Writes an encrypted and MAC'd image of a stopped enclave, its thread
+ * state and all of its EPM, to a host buffer of at least
+ * SM_CHECKPOINT_SIZE(EPM size) bytes. The enclave must be stopped in an
+ * edge call, which it finishes once restored. Enclaves with memory other
+ * than their EPM and UTM can't be moved and are refused.
+ */
+unsigned long checkpoint_enclave(enclave_id eid, uintptr_t image, uintptr_t size)
+{
+  struct keystone_sbi_checkpoint_t hdr;
+  struct checkpoint_stream s;
+  uintptr_t dst, page, base, end;
+  uint64_t nonce;
+  unsigned long ret;
+  int i;
+
+  spin_lock(&encl_lock);
+  if(!ENCLAVE_EXISTS(eid)
+     || enclaves[eid].state != STOPPED
+     || enclaves[eid].n_thread != 0
+     || enclaves[eid].threads[0].prev_state.slot != 0
+     || get_enclave_region_index(eid, REGION_OTHER) != -1) {
+    spin_unlock(&encl_lock);
+    return SBI_ERR_SM_ENCLAVE_NOT_CHECKPOINTABLE;
+  }
+
+  base = enclaves[eid].params.dram_base;
+  end = base + enclaves[eid].params.dram_size;
+  if(size < SM_CHECKPOINT_SIZE(end - base)) {
+    spin_unlock(&encl_lock);
+    return SBI_ERR_SM_ENCLAVE_ILLEGAL_ARGUMENT;
+  }
+
+  sbi_memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = SM_CHECKPOINT_MAGIC;
+  hdr.version = SM_CHECKPOINT_VERSION;
+  sbi_memcpy(hdr.hash, enclaves[eid].hash, MDSIZE);
+  for(i = 0; i < SM_CHECKPOINT_NONCE_SIZE; i += sizeof(nonce)) {
+    nonce = platform_random();
+    sbi_memcpy(hdr.nonce + i, &nonce, sizeof(nonce));
+  }
+  hdr.params = enclaves[eid].params;
+
+  ret = SBI_ERR_SM_ENCLAVE_UNKNOWN_ERROR;
+  if(checkpoint_stream_init(&s, &hdr))
+    goto wipe;
+
+  /* Held throughout, like the hashing in create, so the enclave can't
+   * run or go away while its memory is being read */
+  ret = SBI_ERR_SM_ENCLAVE_ILLEGAL_ARGUMENT;
+  dst = image + sizeof(hdr);
+  sbi_memset(checkpoint_buf, 0, SM_CHECKPOINT_STATE_SIZE);
+  sbi_memcpy(checkpoint_buf, &enclaves[eid].threads[0],
+             sizeof(struct thread_state));
+  if(put_checkpoint_chunk(&s, dst, SM_CHECKPOINT_STATE_SIZE))
+    goto wipe;
+  dst += SM_CHECKPOINT_STATE_SIZE;
+
+  for(page = base; page < end; page += RISCV_PGSIZE, dst += RISCV_PGSIZE) {
+    sbi_memcpy(checkpoint_buf, (void*) page, RISCV_PGSIZE);
+    if(put_checkpoint_chunk(&s, dst, RISCV_PGSIZE))
+      goto wipe;
+  }
+
+  hmac_sha3_final(&s.mac, hdr.mac);
+  if(copy_from_sm(image, &hdr, sizeof(hdr)))
+    goto wipe;
+  ret = SBI_ERR_SM_ENCLAVE_SUCCESS;
+
+wipe:
+  checkpoint_stream_wipe(&s);
+  spin_unlock(&encl_lock);
+  return ret;
+}
+
+/*
+ * Creates an enclave from a checkpoint image. Only the EPM and UTM come
+ * from the host and must be the sizes of the checkpointed enclave's. The
+ * enclave keeps its measurement and comes back STOPPED in the edge call
+ * it was checkpointed in; its first resume tells the runtime where its
+ * memory went (see resume_enclave).
+ */
+unsigned long restore_enclave(unsigned long *eidptr,
+                              struct keystone_sbi_create_t create_args,
+                              uintptr_t image, uintptr_t size)
+{
+  struct checkpoint_restore restore;
+  struct runtime_params_t* from = &restore.hdr.params;
+  uintptr_t base = create_args.epm_region.paddr;
+
+  if(copy_to_sm(&restore.hdr, image, sizeof(restore.hdr)))
+    return SBI_ERR_SM_ENCLAVE_REGION_OVERLAPS;
+
+  if(restore.hdr.magic != SM_CHECKPOINT_MAGIC
+     || restore.hdr.version != SM_CHECKPOINT_VERSION)
+    return SBI_ERR_SM_ENCLAVE_CHECKPOINT_INVALID;
+
+  if(create_args.epm_region.size != from->dram_size
+     || create_args.utm_region.size != from->untrusted_size
+     || size < SM_CHECKPOINT_SIZE(from->dram_size))
+    return SBI_ERR_SM_ENCLAVE_ILLEGAL_ARGUMENT;
+
+  /* same offsets inside the new EPM, checked against the MAC later */
+  create_args.runtime_paddr = base + (from->runtime_base - from->dram_base);
+  create_args.user_paddr = base + (from->user_base - from->dram_base);
+  create_args.free_paddr = base + (from->free_base - from->dram_base);
+  create_args.free_requested = from->free_requested;
+  create_args.timeslice = from->timeslice;
+  /* reset goes back to the measured pages, which we don't have */
+  create_args.checkpoint_region.size = 0;
+
+  restore.image = image;
+  return __create_enclave(eidptr, create_args, restore_checkpoint_epm, &restore);
+}
+
 unsigned long attest_enclave(uintptr_t report_ptr, uintptr_t data, uintptr_t size, enclave_id eid)
 {
   int attestable;
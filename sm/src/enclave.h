@@ -37,6 +37,7 @@ typedef unsigned int enclave_id;
  * EPM is the 'home' for the enclave, contains runtime code/etc
  * UTM is the untrusted shared pages
  * OTHER is managed by some other component (e.g. platform_)
+ * CHECKPOINT holds the pristine EPM pages for reset, SM access only
  * INVALID is an unused index
  */
 enum enclave_region_type{
@@ -44,6 +45,7 @@ enum enclave_region_type{
   REGION_EPM,
   REGION_UTM,
   REGION_OTHER,
+  REGION_CHECKPOINT,
 };
 
 struct enclave_region
@@ -73,6 +75,8 @@ struct enclave
   /* enclave execution context */
   unsigned int n_thread;
   struct thread_state threads[MAX_ENCL_THREADS];
+  /* restored from a checkpoint and not resumed since */
+  int restored;
 
   struct platform_enclave_data ped;
 };
@@ -109,9 +113,13 @@ struct sealing_key
 /*** SBI functions & external functions ***/
 // callables from the host
 unsigned long create_enclave(unsigned long *eid, struct keystone_sbi_create_t create_args);
+unsigned long clone_enclave(unsigned long *eid, enclave_id template_eid, struct keystone_sbi_create_t create_args);
 unsigned long destroy_enclave(enclave_id eid);
 unsigned long run_enclave(struct sbi_trap_regs *regs, enclave_id eid);
 unsigned long resume_enclave(struct sbi_trap_regs *regs, enclave_id eid);
+unsigned long reset_enclave(enclave_id eid);
+unsigned long checkpoint_enclave(enclave_id eid, uintptr_t image, uintptr_t size);
+unsigned long restore_enclave(unsigned long *eid, struct keystone_sbi_create_t create_args, uintptr_t image, uintptr_t size);
 // callables from the enclave
 unsigned long exit_enclave(struct sbi_trap_regs *regs, enclave_id eid);
 unsigned long stop_enclave(struct sbi_trap_regs *regs, uint64_t request, enclave_id eid);
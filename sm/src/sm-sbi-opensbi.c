@@ -40,6 +40,18 @@ static int sbi_ecall_keystone_enclave_handler(unsigned long extid, unsigned long
     case SBI_SM_DESTROY_ENCLAVE:
       retval = sbi_sm_destroy_enclave(regs->a0);
       break;
+    case SBI_SM_CLONE_ENCLAVE:
+      retval = sbi_sm_clone_enclave(out_val, regs->a0, regs->a1);
+      break;
+    case SBI_SM_RESET_ENCLAVE:
+      retval = sbi_sm_reset_enclave(regs->a0);
+      break;
+    case SBI_SM_CHECKPOINT_ENCLAVE:
+      retval = sbi_sm_checkpoint_enclave(regs->a0, regs->a1, regs->a2);
+      break;
+    case SBI_SM_RESTORE_ENCLAVE:
+      retval = sbi_sm_restore_enclave(out_val, regs->a0, regs->a1, regs->a2);
+      break;
     case SBI_SM_RUN_ENCLAVE:
       retval = sbi_sm_run_enclave((struct sbi_trap_regs*) regs, regs->a0);
       __builtin_unreachable();
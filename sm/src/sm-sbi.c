@@ -26,6 +26,20 @@ unsigned long sbi_sm_create_enclave(unsigned long* eid, uintptr_t create_args)
   return ret;
 }
 
+unsigned long sbi_sm_clone_enclave(unsigned long* eid, unsigned long template_eid, uintptr_t create_args)
+{
+  struct keystone_sbi_create_t create_args_local;
+  unsigned long ret;
+
+  ret = copy_enclave_create_args(create_args, &create_args_local);
+
+  if (ret)
+    return ret;
+
+  ret = clone_enclave(eid, (unsigned int) template_eid, create_args_local);
+  return ret;
+}
+
 unsigned long sbi_sm_destroy_enclave(unsigned long eid)
 {
   unsigned long ret;
@@ -33,9 +47,41 @@ unsigned long sbi_sm_destroy_enclave(unsigned long eid)
   return ret;
 }
 
+unsigned long sbi_sm_reset_enclave(unsigned long eid)
+{
+  unsigned long ret;
+  ret = reset_enclave((unsigned int)eid);
+  return ret;
+}
+
+unsigned long sbi_sm_checkpoint_enclave(unsigned long eid, uintptr_t image, uintptr_t size)
+{
+  unsigned long ret;
+  ret = checkpoint_enclave((unsigned int) eid, image, size);
+  return ret;
+}
+
+unsigned long sbi_sm_restore_enclave(unsigned long* eid, uintptr_t create_args, uintptr_t image, uintptr_t size)
+{
+  struct keystone_sbi_create_t create_args_local;
+  unsigned long ret;
+
+  ret = copy_enclave_create_args(create_args, &create_args_local);
+
+  if (ret)
+    return ret;
+
+  ret = restore_enclave(eid, create_args_local, image, size);
+  return ret;
+}
+
 unsigned long sbi_sm_run_enclave(struct sbi_trap_regs *regs, unsigned long eid)
 {
-  regs->a0 = run_enclave(regs, (unsigned int) eid);
+  unsigned long ret;
+  ret = run_enclave(regs, (unsigned int) eid);
+  /* on success, $a0 carries a boot parameter to the enclave */
+  if (ret != SBI_ERR_SM_ENCLAVE_SUCCESS)
+    regs->a0 = ret;
   regs->mepc += 4;
   sbi_trap_exit(regs);
   return 0;
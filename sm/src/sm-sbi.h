@@ -11,9 +11,21 @@
 unsigned long
 sbi_sm_create_enclave(unsigned long *out_val, uintptr_t create_args);
 
+unsigned long
+sbi_sm_clone_enclave(unsigned long *out_val, unsigned long template_eid, uintptr_t create_args);
+
 unsigned long
 sbi_sm_destroy_enclave(unsigned long eid);
 
+unsigned long
+sbi_sm_reset_enclave(unsigned long eid);
+
+unsigned long
+sbi_sm_checkpoint_enclave(unsigned long eid, uintptr_t image, uintptr_t size);
+
+unsigned long
+sbi_sm_restore_enclave(unsigned long *out_val, uintptr_t create_args, uintptr_t image, uintptr_t size);
+
 unsigned long
 sbi_sm_run_enclave(struct sbi_trap_regs *regs, unsigned long eid);
 
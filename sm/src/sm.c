@@ -80,6 +80,26 @@ int sm_derive_sealing_key(unsigned char *key, const unsigned char *key_ident,
              info, MDSIZE + key_ident_size, key, SEALING_KEY_SIZE);
 }
 
+/*
+ * Like a sealing key, but the info starts with a label rather than the
+ * enclave hash, so no key_ident an enclave passes to get_sealing_key
+ * can produce it.
+ */
+#define CHECKPOINT_KEY_LABEL "keystone-sm-checkpoint"
+
+int sm_derive_checkpoint_key(unsigned char *key,
+                             const unsigned char *enclave_hash)
+{
+  unsigned char info[sizeof(CHECKPOINT_KEY_LABEL) - 1 + MDSIZE];
+
+  sbi_memcpy(info, CHECKPOINT_KEY_LABEL, sizeof(CHECKPOINT_KEY_LABEL) - 1);
+  sbi_memcpy(info + sizeof(CHECKPOINT_KEY_LABEL) - 1, enclave_hash, MDSIZE);
+
+  return kdf(NULL, 0,
+             (const unsigned char *)sm_private_key, PRIVATE_KEY_SIZE,
+             info, sizeof(info), key, SEALING_KEY_SIZE);
+}
+
 static void sm_print_hash(void)
 {
   for (int i=0; i<MDSIZE; i++)
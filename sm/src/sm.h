@@ -23,6 +23,8 @@ int sm_derive_sealing_key(unsigned char *key,
                           const unsigned char *key_ident,
                           size_t key_ident_size,
                           const unsigned char *enclave_hash);
+int sm_derive_checkpoint_key(unsigned char *key,
+                             const unsigned char *enclave_hash);
 
 int osm_pmp_set(uint8_t perm);
 #endif